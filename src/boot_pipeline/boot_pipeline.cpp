@@ -0,0 +1,257 @@
+#include <logging/log.h>
+LOG_MODULE_REGISTER(boot_pipeline, LOG_LEVEL_DBG);
+
+#include "boot_pipeline.h"
+#include "watchdog_config/task_watchdog.h"
+
+/*
+ * Worker threads in addition to the calling thread. Stages making TLS connections run on the caller,
+ * so worker stacks only need to fit keypair generation; the boot_worker entries of the stack_monitor
+ * report show the measured peak.
+ */
+#define BOOT_WORKER_COUNT      (2)
+#define BOOT_WORKER_STACK_SIZE (4 * 1024)
+
+/* Period at which the calling thread checks in while waiting for worker stages within their timeouts */
+#define BOOT_WDT_CHECK_IN_PERIOD_MS (1000)
+
+K_THREAD_STACK_ARRAY_DEFINE(boot_worker_stacks, BOOT_WORKER_COUNT, BOOT_WORKER_STACK_SIZE);
+static struct k_thread boot_worker_threads[BOOT_WORKER_COUNT];
+
+BootPipeline::BootPipeline(const struct boot_stage* stages, size_t count, void* ctx)
+	: stages_(stages), count_(MIN(count, BOOT_STAGE_MAX)), ctx_(ctx)
+{
+	__ASSERT(count <= BOOT_STAGE_MAX, "Too many boot stages");
+
+	k_mutex_init(&lock_);
+	k_sem_init(&progress_, 0, BOOT_WORKER_COUNT + 1);
+
+	for (size_t i = 0; i < BOOT_STAGE_MAX; i++) {
+		start_ms_[i] = -1;
+		end_ms_[i] = -1;
+	}
+}
+
+/**
+ * @brief	Run all stages, overlapping those that do not depend on each other
+ * @author	Lee Tze Han
+ * @param	wdt_task_id	Task watchdog id of the calling thread, checked in while waiting for stages
+ * 				on worker threads that are within their timeouts
+ * @return	True if every stage completed successfully
+ * @note	Blocks until no further stage can be run
+ */
+bool BootPipeline::run(int wdt_task_id)
+{
+	wdt_task_id_ = wdt_task_id;
+
+	int64_t boot_start_ms = k_uptime_get();
+	finished_ = !has_ready_stage();
+
+	int priority = k_thread_priority_get(k_current_get());
+	for (int i = 0; i < BOOT_WORKER_COUNT; i++) {
+		k_thread_create(&boot_worker_threads[i], boot_worker_stacks[i],
+				K_THREAD_STACK_SIZEOF(boot_worker_stacks[i]), worker_entry, this, NULL, NULL, priority,
+				0, K_NO_WAIT);
+		k_thread_name_set(&boot_worker_threads[i], "boot_worker");
+	}
+
+	work(true);
+
+	/* Stage state is owned by this object, so workers must have exited before returning */
+	for (int i = 0; i < BOOT_WORKER_COUNT; i++) {
+		k_thread_join(&boot_worker_threads[i], K_FOREVER);
+	}
+
+	for (size_t i = 0; i < count_; i++) {
+		if (completed_ & BOOT_DEP(i)) {
+			LOG_INF("Boot stage %-16s %6u - %6u ms", stages_[i].name, (uint32_t)start_ms_[i],
+				(uint32_t)end_ms_[i]);
+		}
+		else if (failed_ & BOOT_DEP(i)) {
+			LOG_ERR("Boot stage %-16s failed", stages_[i].name);
+		}
+		else {
+			LOG_WRN("Boot stage %-16s skipped", stages_[i].name);
+		}
+	}
+
+	bool success = completed_ == BIT_MASK(count_);
+	LOG_INF("Boot pipeline %s in %u ms", success ? "completed" : "failed",
+		(uint32_t)(k_uptime_get() - boot_start_ms));
+
+	return success;
+}
+
+/**
+ * @brief	Get the time taken by a stage
+ * @author	Lee Tze Han
+ * @param	id	Index of the stage
+ * @return	Duration in milliseconds, or -1 if the stage did not complete
+ */
+int64_t BootPipeline::get_stage_duration_ms(size_t id) const
+{
+	if (id >= count_ || end_ms_[id] < 0) {
+		return -1;
+	}
+
+	return end_ms_[id] - start_ms_[id];
+}
+
+/**
+ * @brief	Entry point for worker threads
+ * @author	Lee Tze Han
+ * @param	pipeline	BootPipeline being run
+ */
+void BootPipeline::worker_entry(void* pipeline, void* dummy1, void* dummy2)
+{
+	ARG_UNUSED(dummy1);
+	ARG_UNUSED(dummy2);
+
+	static_cast<BootPipeline*>(pipeline)->work(false);
+}
+
+/**
+ * @brief	Run ready stages until the pipeline is finished
+ * @author	Lee Tze Han
+ * @param	caller	True on the thread that called run
+ */
+void BootPipeline::work(bool caller)
+{
+	k_mutex_lock(&lock_, K_FOREVER);
+
+	while (!finished_) {
+		int id = claim_ready_stage(caller);
+		if (id < 0) {
+			/*
+			 * Stages on worker threads may block for a long time (e.g. waiting for the network), but
+			 * only up to their timeout; a hung stage stops the check-ins so the watchdog can reset
+			 */
+			bool check_in = caller && stages_within_timeout();
+			k_mutex_unlock(&lock_);
+
+			if (caller) {
+				if (check_in) {
+					task_watchdog::check_in(wdt_task_id_);
+				}
+				k_sem_take(&progress_, K_MSEC(BOOT_WDT_CHECK_IN_PERIOD_MS));
+			}
+			else {
+				k_sem_take(&progress_, K_FOREVER);
+			}
+
+			k_mutex_lock(&lock_, K_FOREVER);
+			continue;
+		}
+
+		k_mutex_unlock(&lock_);
+
+		LOG_DBG("Starting boot stage %s", stages_[id].name);
+		bool success = stages_[id].run(ctx_);
+
+		k_mutex_lock(&lock_, K_FOREVER);
+		finish_stage(id, success);
+	}
+
+	k_mutex_unlock(&lock_);
+}
+
+/**
+ * @brief	Claim the first stage whose dependencies have completed
+ * @author	Lee Tze Han
+ * @param	caller	True if claiming for the thread that called run, which only runs on_caller stages
+ * @return	Index of the claimed stage, or -1 if none is ready
+ * @note	Must be called with lock_ held
+ */
+int BootPipeline::claim_ready_stage(bool caller)
+{
+	for (size_t i = 0; i < count_; i++) {
+		if ((started_ & BOOT_DEP(i)) || (stages_[i].deps & ~completed_)) {
+			continue;
+		}
+		/* The caller keeps checking in for worker stages, so it must not block in one itself */
+		if (stages_[i].on_caller != caller) {
+			continue;
+		}
+
+		started_ |= BOOT_DEP(i);
+		start_ms_[i] = k_uptime_get();
+		running_++;
+
+		return i;
+	}
+
+	return -1;
+}
+
+/**
+ * @brief	Check if any stage can be started
+ * @author	Lee Tze Han
+ * @return	True if a stage that has not started has all of its dependencies completed
+ * @note	Must be called with lock_ held
+ */
+bool BootPipeline::has_ready_stage(void) const
+{
+	for (size_t i = 0; i < count_; i++) {
+		if (!(started_ & BOOT_DEP(i)) && !(stages_[i].deps & ~completed_)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * @brief	Check if every running stage is within its timeout
+ * @author	Lee Tze Han
+ * @return	True if no running stage has exceeded its timeout
+ * @note	Must be called with lock_ held
+ */
+bool BootPipeline::stages_within_timeout(void)
+{
+	int64_t now = k_uptime_get();
+	uint32_t running = started_ & ~(completed_ | failed_);
+	bool within_timeout = true;
+
+	for (size_t i = 0; i < count_; i++) {
+		if (!(running & BOOT_DEP(i)) || now - start_ms_[i] <= stages_[i].timeout_ms) {
+			continue;
+		}
+
+		within_timeout = false;
+		if (!(overdue_ & BOOT_DEP(i))) {
+			overdue_ |= BOOT_DEP(i);
+			LOG_ERR("Boot stage %s has not completed within %u ms - no longer checking in", stages_[i].name,
+				stages_[i].timeout_ms);
+		}
+	}
+
+	return within_timeout;
+}
+
+/**
+ * @brief	Record the result of a stage and wake waiting threads
+ * @author	Lee Tze Han
+ * @param	id	Index of the stage
+ * @param	success	Result returned by the stage
+ * @note	Must be called with lock_ held
+ */
+void BootPipeline::finish_stage(size_t id, bool success)
+{
+	end_ms_[id] = k_uptime_get();
+	running_--;
+
+	if (success) {
+		completed_ |= BOOT_DEP(id);
+	}
+	else {
+		failed_ |= BOOT_DEP(id);
+		LOG_WRN("Boot stage %s failed", stages_[id].name);
+	}
+
+	/* Stages depending on a failed stage never become ready */
+	finished_ = running_ == 0 && !has_ready_stage();
+
+	for (int i = 0; i < BOOT_WORKER_COUNT + 1; i++) {
+		k_sem_give(&progress_);
+	}
+}
@@ -0,0 +1,91 @@
+/*******************************************************************************************************
+ * Copyright (c) 2021 Government Technology Agency of Singapore (GovTech)
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied.
+ *
+ * See the License for the specific language governing permissions and limitations under the License.
+ *******************************************************************************************************/
+#ifndef _BOOT_PIPELINE_H_
+#define _BOOT_PIPELINE_H_
+
+#include <zephyr.h>
+
+/* Maximum number of stages in a pipeline (must fit in the width of the dependency mask) */
+#define BOOT_STAGE_MAX (16)
+
+/* Dependency mask entry for the stage at index id */
+#define BOOT_DEP(id) BIT(id)
+
+typedef bool (*boot_stage_fn)(void* ctx);
+
+struct boot_stage {
+	const char* name;
+	boot_stage_fn run;
+	/* Stages (BOOT_DEP mask) that must complete successfully before this stage starts */
+	uint32_t deps;
+	/*
+	 * Run on the thread calling BootPipeline::run, e.g. for stages that need its larger stack; other
+	 * stages only run on worker threads
+	 */
+	bool on_caller;
+	/*
+	 * Longest time a stage on a worker thread may run while the calling thread keeps checking in
+	 * for it; beyond this, check-ins stop and the task watchdog deadline of the caller applies
+	 */
+	uint32_t timeout_ms;
+};
+
+/*
+ * Runs boot stages as soon as their dependencies have completed, on the calling thread and a small
+ * pool of worker threads. Stages that depend on a failed stage are skipped.
+ */
+class BootPipeline
+{
+public:
+	BootPipeline(const struct boot_stage* stages, size_t count, void* ctx);
+
+	bool run(int wdt_task_id);
+
+	int64_t get_stage_duration_ms(size_t id) const;
+
+private:
+	static void worker_entry(void* pipeline, void* dummy1, void* dummy2);
+	void work(bool caller);
+
+	int claim_ready_stage(bool caller);
+	bool has_ready_stage(void) const;
+	bool stages_within_timeout(void);
+	void finish_stage(size_t id, bool success);
+
+	const struct boot_stage* stages_;
+	size_t count_;
+	void* ctx_;
+
+	int wdt_task_id_ = -1;
+
+	/* Guards the stage state below */
+	struct k_mutex lock_;
+	/* Given whenever a stage completes, to wake threads waiting for a ready stage */
+	struct k_sem progress_;
+
+	uint32_t started_ = 0;
+	uint32_t completed_ = 0;
+	uint32_t failed_ = 0;
+	int running_ = 0;
+	bool finished_ = false;
+	/* Running stages that have exceeded their timeout */
+	uint32_t overdue_ = 0;
+
+	int64_t start_ms_[BOOT_STAGE_MAX];
+	int64_t end_ms_[BOOT_STAGE_MAX];
+};
+
+#endif // _BOOT_PIPELINE_H_
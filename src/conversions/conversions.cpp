@@ -2,30 +2,117 @@
 LOG_MODULE_REGISTER(conversions, LOG_LEVEL_DBG);
 
 #include <sstream>
-#include <mbedtls/sha256.h>
 #include "conversions.h"
 
+Sha256Hasher::Sha256Hasher(void)
+{
+	mbedtls_sha256_init(&ctx_);
+
+	int rc = mbedtls_sha256_starts_ret(&ctx_, 0);
+	if (rc < 0) {
+		LOG_WRN("mbedtls_sha256_starts_ret failed: %d", rc);
+	}
+	ok_ = (rc == 0);
+}
+
+Sha256Hasher::~Sha256Hasher(void)
+{
+	mbedtls_sha256_free(&ctx_);
+}
+
 /**
- *  @brief	Generates SHA256 hash from input
+ *  @brief	Feeds the next piece of input into the hash
  *  @author	Lee Tze Han
- *  @param	input	String to be hashed
- *  @return	SHA256 hash (Lowercase hex string)
+ *  @param	piece	Data to be hashed
+ *  @return	Reference to this hasher for chaining
+ */
+Sha256Hasher& Sha256Hasher::update(const string_piece& piece)
+{
+	if (ok_) {
+		int rc = mbedtls_sha256_update_ret(&ctx_, (const unsigned char*)piece.data, piece.len);
+		if (rc < 0) {
+			LOG_WRN("mbedtls_sha256_update_ret failed: %d", rc);
+			ok_ = false;
+		}
+	}
+
+	return *this;
+}
+
+/**
+ *  @brief	Completes the hash and writes it out as a lowercase hex string
+ *  @author	Lee Tze Han
+ *  @param	hex_out	Buffer of at least SHA256_HEX_SIZE bytes; set to an empty string on failure
+ *  @return	Success status
  */
-std::string hash_sha256(std::string input)
+bool Sha256Hasher::finish_hex(char* hex_out)
 {
+	static const char hex_digits[] = "0123456789abcdef";
 	unsigned char buf[32];
-	int rc = mbedtls_sha256_ret((const unsigned char*)input.c_str(), input.size(), buf, 0);
+
+	hex_out[0] = '\0';
+	if (!ok_) {
+		return false;
+	}
+
+	int rc = mbedtls_sha256_finish_ret(&ctx_, buf);
+	ok_ = false;
 	if (rc < 0) {
-		LOG_WRN("mbedtls_sha256_ret failed: %d", rc);
-		return "";
+		LOG_WRN("mbedtls_sha256_finish_ret failed: %d", rc);
+		return false;
 	}
 
 	/* Convert byte buffer to hex string */
-	char hash[32 * 2 + 1];
 	for (int i = 0; i < 32; i++) {
-		snprintf(&hash[i * 2], sizeof(hash) - (2 * i), "%02x", buf[i]);
+		hex_out[i * 2] = hex_digits[buf[i] >> 4];
+		hex_out[i * 2 + 1] = hex_digits[buf[i] & 0x0f];
+	}
+	hex_out[64] = '\0';
+
+	return true;
+}
+
+/**
+ *  @brief	Generates SHA256 hash from the concatenation of pieces without building the concatenated string
+ *  @author	Lee Tze Han
+ *  @param	pieces	Strings to be hashed, in order
+ *  @param	hex_out	Buffer of at least SHA256_HEX_SIZE bytes for the lowercase hex string
+ *  @return	Success status
+ */
+bool hash_sha256(std::initializer_list<string_piece> pieces, char* hex_out)
+{
+	Sha256Hasher hasher;
+	for (const string_piece& piece : pieces) {
+		hasher.update(piece);
 	}
-	hash[64] = '\0';
+
+	return hasher.finish_hex(hex_out);
+}
+
+/**
+ *  @brief	Generates SHA256 hash from the concatenation of pieces
+ *  @author	Lee Tze Han
+ *  @param	pieces	Strings to be hashed, in order
+ *  @return	SHA256 hash (Lowercase hex string), or an empty string on failure
+ */
+std::string hash_sha256(std::initializer_list<string_piece> pieces)
+{
+	char hash[SHA256_HEX_SIZE];
+	hash_sha256(pieces, hash);
+
+	return hash;
+}
+
+/**
+ *  @brief	Generates SHA256 hash from input
+ *  @author	Lee Tze Han
+ *  @param	input	String to be hashed
+ *  @return	SHA256 hash (Lowercase hex string), or an empty string on failure
+ */
+std::string hash_sha256(const std::string& input)
+{
+	char hash[SHA256_HEX_SIZE];
+	Sha256Hasher().update(input).finish_hex(hash);
 
 	return hash;
 }
@@ -41,4 +128,4 @@ std::string int_to_string(int v)
 	std::ostringstream oss;
 	oss << v;
 	return oss.str();
-}
\ No newline at end of file
+}
@@ -16,9 +16,44 @@
 #ifndef _CONVERSIONS_H_
 #define _CONVERSIONS_H_
 
+#include <cstring>
+#include <initializer_list>
 #include <string>
+#include <mbedtls/sha256.h>
 
-std::string hash_sha256(std::string input);
+/* Size of buffer for a SHA256 hash as a lowercase hex string, including null terminator */
+#define SHA256_HEX_SIZE (32 * 2 + 1)
+
+/* Non-owning view of a string to be hashed; the referenced data must outlive the hashing call */
+struct string_piece {
+	string_piece(const std::string& str) : data(str.data()), len(str.size()) {}
+	string_piece(const char* str) : data(str), len(strlen(str)) {}
+
+	const char* data;
+	size_t len;
+};
+
+/*
+ * Incremental SHA256 hasher. Hashing through mbedtls_sha256_context picks up an
+ * alternative (e.g. hardware accelerated) implementation if MBEDTLS_SHA256_ALT is provided.
+ */
+class Sha256Hasher
+{
+public:
+	Sha256Hasher(void);
+	~Sha256Hasher(void);
+
+	Sha256Hasher& update(const string_piece& piece);
+	bool finish_hex(char* hex_out);
+
+private:
+	mbedtls_sha256_context ctx_;
+	bool ok_;
+};
+
+bool hash_sha256(std::initializer_list<string_piece> pieces, char* hex_out);
+std::string hash_sha256(std::initializer_list<string_piece> pieces);
+std::string hash_sha256(const std::string& input);
 std::string int_to_string(int v);
 
-#endif // _CONVERSIONS_H_
\ No newline at end of file
+#endif // _CONVERSIONS_H_
@@ -5,13 +5,15 @@ LOG_MODULE_REGISTER(crypto_engine, LOG_LEVEL_DBG);
 #include <mbedtls/x509.h>
 #include <mbedtls/x509_csr.h>
 #include <net/tls_credentials.h>
+#include <sys/timeutil.h>
 #include "crypto_engine.h"
 #include "device_uuid/device_uuid.h"
+#include "diagnostics/tls_heap_monitor.h"
 #include "persist_store/persist_store.h"
 #include "time_engine/time_engine.h"
 #include "tls_certs.h"
 #include "user_config.h"
-#include "watchdog_config/watchdog_config.h"
+#include "watchdog_config/task_watchdog.h"
 #if defined(USER_CONFIG_USE_ECC_SECP256R1)
 #include "mbedtls/ecdsa.h"
 #endif // USER_CONFIG_USE_ECC_SECP256R1
@@ -22,13 +24,20 @@ LOG_MODULE_REGISTER(crypto_engine, LOG_LEVEL_DBG);
 #define MBEDTLS_EXPONENT (65537)
 #endif // USER_CONFIG_USE_ECC_SECP256R1
 
-std::string session_client_key;
+/* Upper bound on DER-encoded private key size (RSA-2048 keys are about 1.2 KB, SECP256R1 keys 121 bytes) */
+#if defined(USER_CONFIG_USE_ECC_SECP256R1)
+#define PRIVATE_KEY_DER_MAX_SIZE (256)
+#else
+#define PRIVATE_KEY_DER_MAX_SIZE (1536)
+#endif // USER_CONFIG_USE_ECC_SECP256R1
+
+#define PEM_BEGIN_MARKER ("-----BEGIN ")
 
 int trng_entropy_func(void* ctx, unsigned char* buf, size_t len);
 
-CryptoEngine::CryptoEngine(const int wdt_channel_id) : wdt_channel_id_(wdt_channel_id)
+CryptoEngine::CryptoEngine(const int wdt_task_id) : wdt_task_id_(wdt_task_id), owner_thread_(k_current_get())
 {
-	wdt_ = watchdog_config::get_device_instance();
+	k_mutex_init(&keypair_lock_);
 
 	/* Initialize device object providing entropy */
 	entropy_device_ = device_get_binding(DT_CHOSEN_ZEPHYR_ENTROPY_LABEL);
@@ -45,6 +54,7 @@ CryptoEngine::CryptoEngine(const int wdt_channel_id) : wdt_channel_id_(wdt_chann
 
 	mbedtls_pk_init(&pk_ctx_);
 	mbedtls_ctr_drbg_init(&ctrdrbg_ctx_);
+	mbedtls_x509_crt_init(&client_crt_);
 
 	/* Seed PRNG on start of CryptoEngine lifecycle */
 	int rc = mbedtls_ctr_drbg_seed(&ctrdrbg_ctx_, trng_entropy_func, (void*)entropy_device_,
@@ -61,6 +71,7 @@ CryptoEngine::~CryptoEngine(void)
 
 	mbedtls_pk_free(&pk_ctx_);
 	mbedtls_ctr_drbg_free(&ctrdrbg_ctx_);
+	mbedtls_x509_crt_free(&client_crt_);
 
 #if defined(USER_CONFIG_USE_ECC_SECP256R1)
 	mbedtls_ecp_keypair_free(&ecp_keypair_);
@@ -73,23 +84,198 @@ CryptoEngine::~CryptoEngine(void)
  *  @brief  	Return a signed client certificate.
  *  @author 	Lee Tze Han
  *  @return 	Returns a csr_sign_resp struct
+ *  @note	A new keypair is used for every call (generated now, or earlier by pregenerate_keypair).
+ *  		Neither the key nor the certificate is stored; the caller is responsible for persisting
+ *  		them and loading them into the TLS layer.
  */
 csr_sign_resp CryptoEngine::get_client_cert(void)
 {
+	k_mutex_lock(&keypair_lock_, K_FOREVER);
 	std::string csr = generate_csr();
+	std::string key = generated_key_;
+	generated_key_.clear();
+	k_mutex_unlock(&keypair_lock_);
+
 	if (csr == "") {
 		LOG_WRN("Failed to generate CSR");
 		return { .valid = false };
 	}
 
-	wdt_feed(wdt_, wdt_channel_id_);
+	check_in_watchdog();
 
 	csr_sign_resp resp = sign_csr(csr);
-	wdt_feed(wdt_, wdt_channel_id_);
+	check_in_watchdog();
+
+	if (resp.valid) {
+		resp.key = key;
+	}
 
 	return resp;
 }
 
+/**
+ *  @brief  	Generate the keypair for the next CSR ahead of time.
+ *  @author 	Lee Tze Han
+ *  @return 	Success status
+ *  @details	Allows keypair generation to overlap with other work, such as waiting for the network or
+ *  		publishing telemetry. May be called from a thread other than the owning thread; the
+ *  		keypair is used by the next call to get_client_cert.
+ */
+bool CryptoEngine::pregenerate_keypair(void)
+{
+	k_mutex_lock(&keypair_lock_, K_FOREVER);
+	if (!keypair_ready_) {
+		keypair_ready_ = generate_keypair();
+	}
+	bool ready = keypair_ready_;
+	k_mutex_unlock(&keypair_lock_);
+
+	return ready;
+}
+
+/**
+ *  @brief  	Check if a keypair generated ahead of time is waiting to be used.
+ *  @author 	Lee Tze Han
+ *  @return 	True if pregenerate_keypair has completed successfully and get_client_cert has not been
+ *  		called since
+ *  @note	Does not block; returns false while a keypair is being generated.
+ */
+bool CryptoEngine::has_pregenerated_keypair(void)
+{
+	if (k_mutex_lock(&keypair_lock_, K_NO_WAIT) != 0) {
+		return false;
+	}
+	bool ready = keypair_ready_;
+	k_mutex_unlock(&keypair_lock_);
+
+	return ready;
+}
+
+/**
+ *  @brief  	Parse and cache the client certificate.
+ *  @author 	Lee Tze Han
+ *  @param	cert	Certificate in PEM or DER format
+ *  @return 	Success status
+ */
+bool CryptoEngine::load_client_cert(const std::string& cert)
+{
+	mbedtls_x509_crt_free(&client_crt_);
+	mbedtls_x509_crt_init(&client_crt_);
+	client_crt_loaded_ = false;
+
+	/* Length of PEM input has to include the null terminator */
+	size_t len = is_pem(cert) ? cert.size() + 1 : cert.size();
+
+	int rc = mbedtls_x509_crt_parse(&client_crt_, (const unsigned char*)cert.c_str(), len);
+	if (rc != 0) {
+		LOG_WRN("mbedtls_x509_crt_parse failed: -0x%04X", -rc);
+		return false;
+	}
+
+	client_crt_loaded_ = true;
+
+	return true;
+}
+
+/**
+ *  @brief  	Get the cached client certificate in DER format.
+ *  @author 	Lee Tze Han
+ *  @return 	DER-encoded certificate, or an empty string if no certificate is loaded
+ */
+std::string CryptoEngine::get_client_cert_der(void) const
+{
+	if (!client_crt_loaded_) {
+		return "";
+	}
+
+	return std::string((const char*)client_crt_.raw.p, client_crt_.raw.len);
+}
+
+/**
+ *  @brief  	Get the expiry time of the cached client certificate.
+ *  @author 	Lee Tze Han
+ *  @return 	Unix epoch timestamp of the certificate's notAfter field, or -1 if no certificate is loaded
+ */
+int64_t CryptoEngine::get_cert_expiry(void) const
+{
+	if (!client_crt_loaded_) {
+		return -1;
+	}
+
+	struct tm valid_to = {
+		.tm_sec = client_crt_.valid_to.sec,
+		.tm_min = client_crt_.valid_to.min,
+		.tm_hour = client_crt_.valid_to.hour,
+		.tm_mday = client_crt_.valid_to.day,
+		.tm_mon = client_crt_.valid_to.mon - 1,
+		.tm_year = client_crt_.valid_to.year - 1900,
+	};
+
+	return timeutil_timegm64(&valid_to);
+}
+
+/**
+ *  @brief  	Convert a private key to DER format.
+ *  @author 	Lee Tze Han
+ *  @param	key	Private key in PEM or DER format
+ *  @return 	DER-encoded private key, or an empty string on failure
+ */
+std::string CryptoEngine::convert_key_to_der(const std::string& key) const
+{
+	mbedtls_pk_context pk;
+	mbedtls_pk_init(&pk);
+
+	/* Length of PEM input has to include the null terminator */
+	size_t len = is_pem(key) ? key.size() + 1 : key.size();
+
+	std::string der;
+	int rc = mbedtls_pk_parse_key(&pk, (const unsigned char*)key.c_str(), len, NULL, 0);
+	if (rc != 0) {
+		LOG_WRN("mbedtls_pk_parse_key failed: -0x%04X", -rc);
+	}
+	else {
+		unsigned char buf[PRIVATE_KEY_DER_MAX_SIZE];
+
+		/* DER is written to the end of the buffer */
+		rc = mbedtls_pk_write_key_der(&pk, buf, sizeof(buf));
+		if (rc < 0) {
+			LOG_WRN("mbedtls_pk_write_key_der failed: -0x%04X", -rc);
+		}
+		else {
+			der.assign((const char*)buf + sizeof(buf) - rc, rc);
+		}
+	}
+
+	mbedtls_pk_free(&pk);
+
+	return der;
+}
+
+/**
+ *  @brief  	Check if a credential is PEM-encoded.
+ *  @author 	Lee Tze Han
+ *  @param	credential	Certificate or key
+ *  @return 	True if PEM, false if (presumably) DER
+ */
+bool CryptoEngine::is_pem(const std::string& credential)
+{
+	return credential.compare(0, strlen(PEM_BEGIN_MARKER), PEM_BEGIN_MARKER) == 0;
+}
+
+/**
+ *  @brief  	Check in with the task watchdog on behalf of the owning thread.
+ *  @author 	Lee Tze Han
+ *  @details	Long operations may also run on other threads (e.g. boot pipeline workers). Those must
+ *  		not check in for the owning thread, as that would hide a stall of the owning thread; their
+ *  		progress is supervised by whoever runs them instead.
+ */
+void CryptoEngine::check_in_watchdog(void) const
+{
+	if (k_current_get() == owner_thread_) {
+		task_watchdog::check_in(wdt_task_id_);
+	}
+}
+
 /**
  *  @brief  	Generate CSR for retrieving client certificate from DECADA.
  *  @author 	Lee Tze Han
@@ -105,8 +291,11 @@ std::string CryptoEngine::generate_csr(void)
 	int rc;
 	std::string csr = "invalid";
 	do {
-		/* Always create new keypair */
-		if (!generate_keypair()) {
+		/* Always use a new keypair, which may have been generated ahead of time */
+		if (keypair_ready_) {
+			keypair_ready_ = false;
+		}
+		else if (!generate_keypair()) {
 			LOG_WRN("Failed to generate keypair");
 			return "";
 		}
@@ -126,8 +315,10 @@ std::string CryptoEngine::generate_csr(void)
 
 		/* Write CSR in PEM format */
 		memset(mbedtls_csr_pem, 0, sizeof(mbedtls_csr_pem));
+		tls_heap_monitor::begin_phase(TLS_HEAP_PHASE_CSR_WRITE);
 		rc = mbedtls_x509write_csr_pem(&mbedtls_csr_request, mbedtls_csr_pem, sizeof(mbedtls_csr_pem),
 					       mbedtls_ctr_drbg_random, &ctrdrbg_ctx_);
+		tls_heap_monitor::end_phase(TLS_HEAP_PHASE_CSR_WRITE);
 		if (rc < 0) {
 			LOG_WRN("mbedtls_x509write_csr_pem failed: -0x%04X", -rc);
 			break;
@@ -155,39 +346,43 @@ bool CryptoEngine::generate_keypair(void)
 	LOG_DBG("Generating ECC Keypair");
 	pk_ctx_.pk_ctx = &ecp_keypair_;
 	pk_ctx_.pk_info = &mbedtls_eckey_info;
+	tls_heap_monitor::begin_phase(TLS_HEAP_PHASE_KEY_GENERATION);
 	rc = mbedtls_ecp_gen_key(MBEDTLS_ECP_DP_SECP256R1, mbedtls_pk_ec(pk_ctx_), mbedtls_ctr_drbg_random,
 				 &ctrdrbg_ctx_);
+	tls_heap_monitor::end_phase(TLS_HEAP_PHASE_KEY_GENERATION);
 	if (rc != 0) {
 		LOG_WRN("mbedtls_ecp_gen_key failed: -0x%04X", -rc);
 		return false;
 	}
 #else
 	LOG_DBG("Generating RSA Keypair");
+	tls_heap_monitor::begin_phase(TLS_HEAP_PHASE_KEY_GENERATION);
 	rc = mbedtls_rsa_gen_key(&rsa_keypair_, mbedtls_ctr_drbg_random, &ctrdrbg_ctx_, MBEDTLS_KEY_SIZE,
 				 MBEDTLS_EXPONENT);
+	tls_heap_monitor::end_phase(TLS_HEAP_PHASE_KEY_GENERATION);
 	if (rc != 0) {
 		LOG_WRN("mbedtls_rsa_gen_key failed: -0x%04X", -rc);
 		return false;
 	}
 
-	/* RSA Keypair generation on embedded devices could take 10s of seconds - crucial to feed the watchdog as soon as we can */
-	wdt_feed(wdt_, wdt_channel_id_);
+	/* RSA Keypair generation on embedded devices could take 10s of seconds - crucial to check in as soon as we can */
+	check_in_watchdog();
 
 	pk_ctx_.pk_ctx = &rsa_keypair_;
 	pk_ctx_.pk_info = &mbedtls_rsa_info;
 #endif // USER_CONFIG_USE_ECC_SECP256R1
 
-	unsigned char buf[4096];
-	rc = mbedtls_pk_write_key_pem(&pk_ctx_, buf, sizeof(buf));
-	if (rc != 0) {
-		LOG_WRN("mbedtls_pk_write_key_pem failed: -0x%04X", -rc);
+	/* DER is written to the end of the buffer */
+	unsigned char buf[PRIVATE_KEY_DER_MAX_SIZE];
+	rc = mbedtls_pk_write_key_der(&pk_ctx_, buf, sizeof(buf));
+	if (rc < 0) {
+		LOG_WRN("mbedtls_pk_write_key_der failed: -0x%04X", -rc);
 		return false;
 	}
 
-	write_client_private_key((char*)buf);
-	session_client_key = std::string((char*)buf);
+	generated_key_.assign((const char*)buf + sizeof(buf) - rc, rc);
 
-	wdt_feed(wdt_, wdt_channel_id_);
+	check_in_watchdog();
 
 	return true;
 }
@@ -17,6 +17,7 @@
 #define _CRYPTO_ENGINE_H_
 
 #include <string>
+#include <zephyr.h>
 #include <drivers/entropy.h>
 #include <mbedtls/ctr_drbg.h>
 #include <mbedtls/x509_crt.h>
@@ -30,23 +31,40 @@ typedef struct {
 	std::string cert;
 	/* Serial number of issued certificate */
 	std::string cert_sn;
+	/* Private key (DER) matching the certificate */
+	std::string key;
 } csr_sign_resp;
 
 class CryptoEngine
 {
 public:
-	explicit CryptoEngine(const int wdt_channel_id);
+	explicit CryptoEngine(const int wdt_task_id);
 	virtual ~CryptoEngine(void);
 
 protected:
 	csr_sign_resp get_client_cert(void);
+	bool pregenerate_keypair(void);
+	bool has_pregenerated_keypair(void);
+
+	/* Client certificate parsed once and cached for the lifetime of CryptoEngine */
+	bool load_client_cert(const std::string& cert);
+	std::string get_client_cert_der(void) const;
+	int64_t get_cert_expiry(void) const;
+
+	std::string convert_key_to_der(const std::string& key) const;
+	static bool is_pem(const std::string& credential);
 
 	mbedtls_pk_context pk_ctx_;
 
-	const struct device* wdt_;
-	const int wdt_channel_id_;
+	void check_in_watchdog(void) const;
+
+	/* Task watchdog id of the owning thread, checked in during long operations */
+	const int wdt_task_id_;
 
 private:
+	/* Thread that constructed CryptoEngine, the only one allowed to check in with wdt_task_id_ */
+	const k_tid_t owner_thread_;
+
 	bool generate_keypair(void);
 	std::string generate_csr(void);
 	std::string make_subject_name(void) const;
@@ -64,6 +82,17 @@ private:
 	mbedtls_ctr_drbg_context ctrdrbg_ctx_;
 
 	const struct device* entropy_device_;
+
+	/* Guards the keypair state below, which may be generated on another thread (see pregenerate_keypair) */
+	struct k_mutex keypair_lock_;
+
+	/* Private key (DER) from the last keypair generation */
+	std::string generated_key_;
+	/* Set if a keypair was generated ahead of time and not yet used for a CSR */
+	bool keypair_ready_ = false;
+
+	mbedtls_x509_crt client_crt_;
+	bool client_crt_loaded_ = false;
 };
 
 #endif // _CRYPTO_ENGINE_H_
\ No newline at end of file
@@ -0,0 +1,44 @@
+#include <init.h>
+#include <mbedtls/threading.h>
+
+/* Zephyr initializes the mbedTLS heap at POST_KERNEL, so the functions must be registered before that */
+#define MBEDTLS_THREADING_INIT_PRIORITY (0)
+
+static void mutex_init(mbedtls_threading_mutex_t* mutex)
+{
+	k_mutex_init(&mutex->mutex);
+}
+
+static void mutex_free(mbedtls_threading_mutex_t* mutex)
+{
+	ARG_UNUSED(mutex);
+}
+
+static int mutex_lock(mbedtls_threading_mutex_t* mutex)
+{
+	return k_mutex_lock(&mutex->mutex, K_FOREVER) == 0 ? 0 : MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+}
+
+static int mutex_unlock(mbedtls_threading_mutex_t* mutex)
+{
+	return k_mutex_unlock(&mutex->mutex) == 0 ? 0 : MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+}
+
+/**
+ *  @brief	Register Zephyr mutexes as the mbedTLS threading implementation
+ *  @author	Lee Tze Han
+ *  @param	dev	Unused
+ *  @return	0
+ *  @details	memory_buffer_alloc locks the mbedTLS heap with these, which allows mbedTLS to be used from
+ *  		more than one thread (e.g. generating a keypair while the MQTT connection is in use).
+ */
+static int init_mbedtls_threading(const struct device* dev)
+{
+	ARG_UNUSED(dev);
+
+	mbedtls_threading_set_alt(mutex_init, mutex_free, mutex_lock, mutex_unlock);
+
+	return 0;
+}
+
+SYS_INIT(init_mbedtls_threading, PRE_KERNEL_1, MBEDTLS_THREADING_INIT_PRIORITY);
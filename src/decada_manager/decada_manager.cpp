@@ -6,102 +6,252 @@ LOG_MODULE_REGISTER(decada_manager, LOG_LEVEL_DBG);
 #include "conversions/conversions.h"
 #include "decada_manager.h"
 #include "device_uuid/device_uuid.h"
+#include "diagnostics/alloc_profiler.h"
+#include "diagnostics/boot_profiler.h"
+#include "networking/dns/dns_lookup.h"
 #include "networking/http/https_request.h"
 #include "persist_store/persist_store.h"
+#include "runtime_config/runtime_config.h"
+#include "service_command.h"
 #include "tls_certs.h"
 #include "user_config.h"
-#include "watchdog_config/watchdog_config.h"
 
 #define CONTENT_TYPE_JSON_UTF8 ("application/json;charset=UTF-8")
 
 /* Root URL for DECADA API */
-const std::string decada_api_url = "https://ag.decada.gov.sg";
+const std::string decada_api_url = USER_CONFIG_DECADA_API_URL;
 /* MQTT Broker hostname */
-const std::string decada_mqtt_hostname = "mqtt.decada.gov.sg";
+const std::string decada_mqtt_hostname = USER_CONFIG_DECADA_MQTT_HOSTNAME;
 /* MQTT Broker port */
-#if defined(USER_CONFIG_USE_ECC_SECP256R1)
+#if defined(USER_CONFIG_DECADA_MQTT_PORT)
+const int decada_mqtt_port = USER_CONFIG_DECADA_MQTT_PORT;
+#elif defined(USER_CONFIG_USE_ECC_SECP256R1)
 const int decada_mqtt_port = 18887;
 #else
 const int decada_mqtt_port = 18885;
 #endif
 
+/* Validity requested for signed client certificates */
+#define CERT_VALID_DAYS (365)
+/* Renew client certificates this long before they expire */
+#define CERT_RENEWAL_MARGIN_S (30 * 24 * 60 * 60)
+/* Period for re-checking expiry, and retry delay after a failed renewal */
+#define CERT_RENEWAL_CHECK_PERIOD_S (24 * 60 * 60)
+#define CERT_RENEWAL_RETRY_S	    (60 * 60)
+/* Period for checking whether the keypair for a renewal has been generated */
+#define CERT_KEYGEN_POLL_S (1)
+/* Delay between attempts to reconnect in place, within the check-in period of the communications thread */
+#define RECONNECT_PERIOD_MS (5 * MSEC_PER_SEC)
+
+/*
+ * Keypairs for renewal are generated below the application threads, as RSA key generation takes tens
+ * of seconds; the stack only needs to fit keypair generation, with CSR signing left to the caller
+ */
+#define CERT_KEYGEN_STACK_SIZE (4 * 1024)
+#define CERT_KEYGEN_PRIORITY   (12)
+
+K_THREAD_STACK_DEFINE(cert_keygen_stack_area, CERT_KEYGEN_STACK_SIZE);
+static struct k_work_q cert_keygen_work_q;
+
 std::string session_client_cert;
+std::string session_client_key;
 
 /**
- *  @brief	Add client certificate and private key to Zephyr's secure socket layer
+ *  @brief	Load client certificate and private key into Zephyr's secure socket layer
  *  @author	Lee Tze Han
- *  @details	This function should only be called once when credentials are available
+ *  @param	cert	Client certificate (DER)
+ *  @param	key	Client private key (DER)
+ *  @details	Existing client credentials are replaced. Credentials are only read by the secure socket
+ *  		layer during a handshake, so established connections are unaffected. DER credentials are
+ *  		passed with their exact length, as they are not null-terminated.
  */
-void add_tls_client_creds(void)
+void set_tls_client_creds(const std::string& cert, const std::string& key)
 {
+	boot_profiler::begin(BOOT_PROFILE_TLS_CREDENTIALS);
+
+	/* Credentials reference the session strings, so they must be removed before the strings change */
+	tls_credential_delete(CLIENT_CERTS_TAG, TLS_CREDENTIAL_SERVER_CERTIFICATE);
+	tls_credential_delete(CLIENT_CERTS_TAG, TLS_CREDENTIAL_PRIVATE_KEY);
+
+	session_client_cert = cert;
+	session_client_key = key;
+
 	/* Set client certificate */
-	int rc = tls_credential_add(CLIENT_CERTS_TAG, TLS_CREDENTIAL_SERVER_CERTIFICATE, session_client_cert.c_str(),
-				    session_client_cert.size() + 1);
+	int rc = tls_credential_add(CLIENT_CERTS_TAG, TLS_CREDENTIAL_SERVER_CERTIFICATE, session_client_cert.data(),
+				    session_client_cert.size());
 	if (rc < 0) {
-		if (rc == -EEXIST) {
-			LOG_WRN("Client certificate already exists - add_tls_client_creds should only be called once");
-		}
-		else {
-			LOG_WRN("Failed to set client certificate: %d", rc);
-		}
+		LOG_WRN("Failed to set client certificate: %d", rc);
 	}
 	else {
 		LOG_INF("Successfully set client certificate");
 	}
 
 	/* Set client private key */
-	rc = tls_credential_add(CLIENT_CERTS_TAG, TLS_CREDENTIAL_PRIVATE_KEY, session_client_key.c_str(),
-				session_client_key.size() + 1);
+	rc = tls_credential_add(CLIENT_CERTS_TAG, TLS_CREDENTIAL_PRIVATE_KEY, session_client_key.data(),
+				session_client_key.size());
 	if (rc < 0) {
-		if (rc == -EEXIST) {
-			LOG_WRN("Client key already exists - add_tls_client_creds should only be called once");
-		}
-		else {
-			LOG_WRN("Failed to set client private key: %d", rc);
-		}
+		LOG_WRN("Failed to set client private key: %d", rc);
 	}
 	else {
 		LOG_INF("Successfully set client private key");
 	}
+
+	boot_profiler::end(BOOT_PROFILE_TLS_CREDENTIALS);
+}
+
+DecadaManager::DecadaManager(const int wdt_task_id) : CryptoEngine(wdt_task_id)
+{
+}
+
+/**
+ *  @brief	Load saved client credentials from persistent storage
+ *  @author	Lee Tze Han
+ *  @return	True if a certificate and private key were loaded
+ *  @details	This only requires persistent storage, so it can run while the network is coming up.
+ *  		Expiry is checked in check_credentials, once the RTC has been synchronized.
+ */
+bool DecadaManager::load_credentials(void)
+{
+	AllocScope alloc_scope(ALLOC_MODULE_DECADA_MANAGER);
+
+	saved_client_key_.clear();
+
+	std::string client_cert = read_client_certificate();
+	if (client_cert == "" || !load_client_cert(client_cert)) {
+		return false;
+	}
+
+	std::string client_key = read_client_private_key();
+
+	/* Credentials saved by earlier firmware versions are in PEM format */
+	if (is_pem(client_cert) || is_pem(client_key)) {
+		LOG_INF("Converting saved credentials to DER");
+
+		client_key = convert_key_to_der(client_key);
+		if (client_key != "") {
+			write_client_private_key(client_key);
+			write_client_certificate(get_client_cert_der());
+		}
+	}
+
+	saved_client_key_ = client_key;
+
+	return saved_client_key_ != "";
 }
 
-DecadaManager::DecadaManager(const int wdt_channel_id) : CryptoEngine(wdt_channel_id)
+/**
+ *  @brief	Generate the keypair for a new client certificate ahead of time if none is saved
+ *  @author	Lee Tze Han
+ *  @return	Success status
+ *  @note	Must be called after load_credentials.
+ */
+bool DecadaManager::prepare_keypair(void)
 {
+	AllocScope alloc_scope(ALLOC_MODULE_DECADA_MANAGER);
+
+	if (saved_client_key_ != "") {
+		return true;
+	}
+
+	LOG_INF("No saved client credentials - generating keypair");
+
+	return pregenerate_keypair();
+}
+
+/**
+ *  @brief	Resolve the DECADA API and MQTT broker hostnames ahead of time
+ *  @author	Lee Tze Han
+ */
+void DecadaManager::prefetch_dns(void)
+{
+	/* Hostname is the authority of the API URL without the port */
+	std::string api_hostname = decada_api_url.substr(decada_api_url.find("://") + 3);
+	api_hostname = api_hostname.substr(0, api_hostname.find_first_of(":/"));
+
+	DnsLookup::prefetch({ api_hostname, decada_mqtt_hostname });
+}
+
+/**
+ *  @brief	Load the saved device secret, provisioning the device with DECADA if there is none
+ *  @author	Lee Tze Han
+ */
+void DecadaManager::provision(void)
+{
+	AllocScope alloc_scope(ALLOC_MODULE_DECADA_MANAGER);
+
+	if (device_secret_ != "") {
+		return;
+	}
+
+	boot_profiler::begin(BOOT_PROFILE_DEVICE_PROVISIONING);
+
+	/* The device secret does not change, so DECADA is only queried if it has not been saved yet */
+	device_secret_ = read_device_secret();
+	if (device_secret_ == "") {
+		request_device_secret();
+	}
+	else {
+		LOG_DBG("Using saved device secret");
+	}
+
+	boot_profiler::end(BOOT_PROFILE_DEVICE_PROVISIONING);
+}
+
+/**
+ *  @brief	Provision device with DECADA and save the device secret
+ *  @author	Lee Tze Han
+ */
+void DecadaManager::request_device_secret(void)
+{
+	AllocScope alloc_scope(ALLOC_MODULE_DECADA_MANAGER);
+
 	/* If device is not yet created, attempt to provision with DECADA */
 	device_secret_ = check_device_creation();
+	write_device_secret(device_secret_);
+	flush_persist_storage();
 }
 
 /**
  *  @brief	Check TLS credentials
  *  @author	Lee Tze Han
  *  @return	Validity of TLS credentials
+ *  @details	Saved credentials are loaded from persistent storage unless load_credentials was called
+ *  		beforehand, which also picks up credentials renewed in the background since the last
+ *  		connection. A new certificate is requested synchronously only if none is saved or the
+ *  		saved certificate has expired.
  */
 bool DecadaManager::check_credentials(void)
 {
-	std::string client_cert = read_client_certificate();
+	AllocScope alloc_scope(ALLOC_MODULE_DECADA_MANAGER);
 
-	/* Already has valid certificate */
-	if (client_cert != "") {
-		LOG_DBG("Using saved client certificate");
+	if (saved_client_key_ == "") {
+		load_credentials();
+	}
 
-		session_client_cert = client_cert;
-		session_client_key = read_client_private_key();
-		add_tls_client_creds();
+	/* Saved credentials are used once; the next connection reloads them */
+	std::string client_key = saved_client_key_;
+	saved_client_key_.clear();
 
-		return true;
+	if (client_key != "") {
+		if (get_cert_expiry() > time_engine_.get_timestamp()) {
+			LOG_DBG("Using saved client certificate");
+
+			set_tls_client_creds(get_client_cert_der(), client_key);
+
+			return true;
+		}
+
+		LOG_WRN("Saved client credentials have expired or are invalid");
 	}
 
-	wdt_feed(wdt_, wdt_channel_id_);
+	check_in_watchdog();
 
 	/* Create a new client certificate (and keypair) */
 	csr_sign_resp resp = get_client_cert();
-	wdt_feed(wdt_, wdt_channel_id_);
+	check_in_watchdog();
 
-	if (resp.valid) {
-		write_client_certificate(resp.cert);
-		write_client_certificate_serial_number(resp.cert_sn);
-		session_client_cert = resp.cert;
-		add_tls_client_creds();
+	if (resp.valid && save_client_cert(resp)) {
+		set_tls_client_creds(get_client_cert_der(), resp.key);
 
 		return true;
 	}
@@ -111,6 +261,165 @@ bool DecadaManager::check_credentials(void)
 	}
 }
 
+/**
+ *  @brief	Persist a newly signed client certificate and its private key in DER format
+ *  @author	Lee Tze Han
+ *  @param	resp	Response from signing CSR
+ *  @return	Success status
+ *  @note	The certificate is also cached as the current client certificate.
+ */
+bool DecadaManager::save_client_cert(const csr_sign_resp& resp)
+{
+	if (!load_client_cert(resp.cert)) {
+		LOG_WRN("Signed client certificate is invalid");
+		return false;
+	}
+
+	write_client_private_key(resp.key);
+	write_client_certificate(get_client_cert_der());
+	write_client_certificate_serial_number(resp.cert_sn);
+
+	/* A new certificate costs a CSR signing request, so do not leave it to the deferred flush */
+	flush_persist_storage();
+
+	return true;
+}
+
+/**
+ *  @brief	Work handler for generating the keypair of a certificate renewal
+ *  @author	Lee Tze Han
+ *  @param	work_item	Work item embedded in a cert_keygen_work struct
+ */
+void cert_keygen_handler(struct k_work* work_item)
+{
+	struct cert_keygen_work* keygen_work = CONTAINER_OF(work_item, struct cert_keygen_work, work);
+
+	keygen_work->manager->generate_renewal_keypair();
+}
+
+/**
+ *  @brief	Run the client certificate renewal check if it is due
+ *  @author	Lee Tze Han
+ *  @note	Must be called from the communications thread. Only the short steps of a renewal (expiry
+ *  		check, CSR signing and the signing request) run here, between samples; the keypair is
+ *  		generated on a low priority workqueue so that telemetry and watchdog check-ins continue.
+ */
+void DecadaManager::poll_cert_renewal(void)
+{
+	if (next_cert_renewal_ms_ < 0 || k_uptime_get() < next_cert_renewal_ms_) {
+		return;
+	}
+
+	renew_client_cert();
+}
+
+/**
+ *  @brief	Generate the keypair for a certificate renewal
+ *  @author	Lee Tze Han
+ *  @note	Runs on the keygen workqueue. The mbedTLS heap is locked (see threading_alt.h) and the keypair
+ *  		is handed over through pregenerate_keypair, so this can overlap with the MQTT connection.
+ */
+void DecadaManager::generate_renewal_keypair(void)
+{
+	AllocScope alloc_scope(ALLOC_MODULE_DECADA_MANAGER);
+
+	pregenerate_keypair();
+	atomic_clear(&cert_keygen_pending_);
+}
+
+/**
+ *  @brief	Schedule the next check for client certificate renewal
+ *  @author	Lee Tze Han
+ *  @param	delay_s		Seconds until the next check
+ */
+void DecadaManager::schedule_cert_renewal(int64_t delay_s)
+{
+	next_cert_renewal_ms_ = k_uptime_get() + delay_s * MSEC_PER_SEC;
+}
+
+/**
+ *  @brief	Start generating the keypair of a certificate renewal on the keygen workqueue
+ *  @author	Lee Tze Han
+ */
+void DecadaManager::start_cert_keygen(void)
+{
+	if (!cert_keygen_work_q_started_) {
+		k_work_q_start(&cert_keygen_work_q, cert_keygen_stack_area,
+			       K_THREAD_STACK_SIZEOF(cert_keygen_stack_area), CERT_KEYGEN_PRIORITY);
+		k_thread_name_set(&cert_keygen_work_q.thread, "cert_keygen_workq");
+
+		cert_keygen_work_.manager = this;
+		k_work_init(&cert_keygen_work_.work, cert_keygen_handler);
+		cert_keygen_work_q_started_ = true;
+	}
+
+	cert_keygen_requested_ = true;
+	atomic_set(&cert_keygen_pending_, 1);
+	k_work_submit_to_queue(&cert_keygen_work_q, &cert_keygen_work_.work);
+}
+
+/**
+ *  @brief	Renew the client certificate if it is close to expiry
+ *  @author	Lee Tze Han
+ *  @details	A renewal is run over several checks: the first starts keypair generation in the
+ *  		background, and the certificate is requested once the keypair is ready. The renewed
+ *  		certificate and key are persisted but not loaded into the secure socket layer; they are
+ *  		picked up by check_credentials at the next connection, so the current connection is not
+ *  		interrupted.
+ */
+void DecadaManager::renew_client_cert(void)
+{
+	AllocScope alloc_scope(ALLOC_MODULE_DECADA_MANAGER);
+
+	if (!cert_keygen_requested_) {
+		/* A certificate that cannot be parsed is replaced immediately */
+		int64_t cert_expiry = get_cert_expiry();
+		if (cert_expiry >= 0) {
+			int64_t time_to_renewal = cert_expiry - CERT_RENEWAL_MARGIN_S - time_engine_.get_timestamp();
+			if (time_to_renewal > 0) {
+				schedule_cert_renewal(MIN(time_to_renewal, CERT_RENEWAL_CHECK_PERIOD_S));
+				return;
+			}
+
+			LOG_INF("Client certificate expires in %d s - renewing",
+				(int32_t)(time_to_renewal + CERT_RENEWAL_MARGIN_S));
+		}
+
+		start_cert_keygen();
+		schedule_cert_renewal(CERT_KEYGEN_POLL_S);
+		return;
+	}
+
+	if (atomic_get(&cert_keygen_pending_)) {
+		schedule_cert_renewal(CERT_KEYGEN_POLL_S);
+		return;
+	}
+	cert_keygen_requested_ = false;
+
+	/* Without a ready keypair, get_client_cert would generate one on this thread */
+	if (!has_pregenerated_keypair()) {
+		LOG_WRN("Failed to generate keypair for client certificate renewal");
+		schedule_cert_renewal(CERT_RENEWAL_RETRY_S);
+		return;
+	}
+
+	csr_sign_resp resp = get_client_cert();
+	if (!resp.valid) {
+		LOG_WRN("Failed to renew client certificate");
+		schedule_cert_renewal(CERT_RENEWAL_RETRY_S);
+		return;
+	}
+
+	if (!save_client_cert(resp)) {
+		schedule_cert_renewal(CERT_RENEWAL_RETRY_S);
+		return;
+	}
+
+	LOG_INF("Client certificate renewed - credentials will be swapped at next connection");
+
+	schedule_cert_renewal(CERT_RENEWAL_CHECK_PERIOD_S);
+}
+
 /**
  *  @brief	Setup MQTT connection to DECADA.
  *  @author	Lee Tze Han
@@ -118,17 +427,85 @@ bool DecadaManager::check_credentials(void)
  */
 bool DecadaManager::connect(void)
 {
+	AllocScope alloc_scope(ALLOC_MODULE_DECADA_MANAGER);
+
+	/* Device must exist in DECADA before a client certificate can be requested */
+	provision();
+
 	/* Ensure TLS credentials are valid */
 	if (!check_credentials()) {
 		LOG_ERR("DecadaManager has no valid TLS credentials");
 	}
 
+	if (!connect_mqtt()) {
+		/* A saved device secret goes stale if the device is re-created in DECADA */
+		if (!auth_rejected()) {
+			LOG_ERR("Failed to establish MQTT connection");
+			return false;
+		}
+
+		LOG_WRN("MQTT authentication failed - provisioning device again");
+		check_in_watchdog();
+		request_device_secret();
+
+		if (!connect_mqtt()) {
+			LOG_ERR("Failed to establish MQTT connection");
+			return false;
+		}
+	}
+
+	/* Expiry of the certificate in use is checked once the connection is up */
+	if (next_cert_renewal_ms_ < 0) {
+		schedule_cert_renewal(0);
+	}
+
+	return true;
+}
+
+/**
+ *  @brief	Re-establish a connection to DECADA that has stopped working, without rebooting
+ *  @author	Lee Tze Han
+ *  @param	topics		Topics to subscribe to again, as the broker starts a clean session
+ *  @param	attempts	Number of times connect is tried, RECONNECT_PERIOD_MS apart
+ *  @return	Success status
+ *  @details	Each attempt resolves the broker again and picks up renewed credentials, so DNS and
+ *  		credential faults are seen on reconnection as they would be after a reboot.
+ */
+bool DecadaManager::reconnect(const std::vector<std::string>& topics, int attempts)
+{
+	drop_connection();
+
+	for (int i = 0; i < attempts; i++) {
+		if (i > 0) {
+			k_msleep(RECONNECT_PERIOD_MS);
+		}
+		check_in_watchdog();
+
+		LOG_WRN("Reconnecting to DECADA (attempt %d/%d)", i + 1, attempts);
+		bool connected = connect();
+		check_in_watchdog();
+
+		if (connected) {
+			return subscribe(topics);
+		}
+	}
+
+	return false;
+}
+
+/**
+ *  @brief	Connect to the DECADA MQTT broker using the current device secret.
+ *  @author	Lee Tze Han
+ *  @return	Success status
+ */
+bool DecadaManager::connect_mqtt(void)
+{
 	std::string timestamp_ms = time_engine_.get_timestamp_ms_str();
 
 	std::string id = device_uuid + "|securemode=2,signmethod=sha256,timestamp=" + timestamp_ms + "|";
 	std::string username = device_uuid + "&" + decada_product_key_;
-	std::string password = hash_sha256("clientId" + device_uuid + "deviceKey" + device_uuid + "productKey" +
-					   decada_product_key_ + "timestamp" + timestamp_ms + device_secret_);
+	std::string password = hash_sha256({ "clientId", device_uuid, "deviceKey", device_uuid, "productKey",
+					     decada_product_key_, "timestamp", timestamp_ms, device_secret_ });
 
 	mqtt_client_conf conf = { .broker_hostname = decada_mqtt_hostname,
 				  .broker_port = decada_mqtt_port,
@@ -136,92 +513,91 @@ bool DecadaManager::connect(void)
 				  .username = username,
 				  .password = password };
 
-	if (!MqttClient::connect(conf)) {
-		LOG_ERR("Failed to establish MQTT connection");
-		return false;
-	}
-
-	return true;
+	return MqttClient::connect(conf);
 }
 
 /**
  *  @brief	Callback for parsing incoming MQTT publish messages.
  *  @author	Lee Tze Han
- *  @param	data	Binary data
+ *  @param	data	Binary data, parsed in place
  *  @param	len	Length of data
  */
 void DecadaManager::subscription_callback(uint8_t* data, int len)
 {
-	/* A valid string is expected from DECADA */
-	std::string message((char*)data, len);
-
-	ArduinoJson::DynamicJsonDocument json(1024);
-	ArduinoJson::deserializeJson(json, message);
+	AllocScope alloc_scope(ALLOC_MODULE_DECADA_MANAGER);
 
-	auto id = json["id"];
-	auto method = json["method"];
-	auto version = json["version"];
-	auto params = json["params"];
-
-	if (id.isNull() || method.isNull() || version.isNull() || params.isNull()) {
-		LOG_WRN("Unexpected JSON shape - received: %s", message.c_str());
+	service_command_doc doc;
+	struct service_command command;
+	/* Runtime configuration parameters are the only ones handled; others are dropped while parsing */
+	if (!parse_service_command((char*)data, len, runtime_config_names, RUNTIME_CONFIG_PARAM_COUNT, doc, command)) {
 		return;
 	}
 
-	LOG_DBG("Received message: id = %s, method = %s", id.as<const char*>(), method.as<const char*>());
+	LOG_DBG("Received message: id = %s, method = %s", log_strdup(command.id), log_strdup(command.method));
+
+	/* Results of the updates, keyed by their output parameters in the DECADA model */
+	ArduinoJson::StaticJsonDocument<JSON_OBJECT_SIZE(RUNTIME_CONFIG_PARAM_COUNT)> results;
 
 	/* Parse parameters */
-	ArduinoJson::JsonObject params_map = params.as<ArduinoJson::JsonObject>();
-	for (auto param_kv : params_map) {
-		std::string parameter = param_kv.key().c_str();
-		std::string value = param_kv.value().as<std::string>();
+	for (auto param_kv : command.params) {
+		/* Non-string values are formatted as JSON on the stack */
+		char formatted[24];
+		const char* value = param_kv.value().as<const char*>();
+		if (value == NULL) {
+			ArduinoJson::serializeJson(param_kv.value(), formatted, sizeof(formatted));
+			value = formatted;
+		}
 
-		LOG_INF("Parameter %s = %s", parameter.c_str(), value.c_str());
+		LOG_INF("Parameter %s = %s", log_strdup(param_kv.key().c_str()), log_strdup(value));
 
-		/* Perform operations with parameters here */
-		/* ... */
+		int param = runtime_config::find(param_kv.key().c_str());
+		if (param < 0) {
+			continue;
+		}
+
+		bool applied = param_kv.value().is<int32_t>() &&
+			       runtime_config::set((runtime_config_param)param, param_kv.value().as<int32_t>());
+		results[runtime_config::get_result_name((runtime_config_param)param)] = applied ? "true" : "false";
 	}
 
 	/* 
-	 * The trace_result_name is the output parameter that DECADA expects to receive.
-	 * This field is defined in the model configured for the device on DECADA.
-	 *
-	 * In this example, the input parameter is configured as "sensor_poll_rate" with
-	 * the output parameter as "poll_rate_updated".
+	 * The output parameters are what DECADA expects to receive, as defined in the model
+	 * configured for the device on DECADA (e.g. "sensor_poll_rate" is answered with
+	 * "poll_rate_updated").
 	 */
-	if (!params_map.getMember("sensor_poll_rate").isNull()) {
-		send_service_response(id, method, "poll_rate_updated");
+	if (results.size() > 0) {
+		send_service_response(command.id, command.method, results.as<ArduinoJson::JsonObjectConst>());
 	}
 }
 
 /**
  *  @brief	Publish a response acknowledging the message from DECADA.
  *  @author	Lee Tze Han
- *  @param	message_id		Message ID to be acknowledged
- *  @param	method			Service method
- *  @param	trace_result_name	Key name for trace result status
+ *  @param	message_id	Message ID to be acknowledged
+ *  @param	method		Service method
+ *  @param	results		Output parameters and their values
  *  @note	This method will be called from a workqueue thread so it has to be ensured that the stack
  *  		is sufficiently large to handle the memory required for TLS. An alternative would be to
  *  		aggregate all outgoing MQTT messages and publish only from one thread.
  */
-void DecadaManager::send_service_response(const std::string& message_id, const std::string& method,
-					  const std::string& trace_result_name)
+void DecadaManager::send_service_response(const char* message_id, const char* method,
+					  ArduinoJson::JsonObjectConst results)
 {
-	ArduinoJson::DynamicJsonDocument json(512);
+	ArduinoJson::StaticJsonDocument<JSON_OBJECT_SIZE(3) + JSON_OBJECT_SIZE(RUNTIME_CONFIG_PARAM_COUNT)> json;
 	json["id"] = message_id;
 	json["code"] = 200;
-	json["data"][trace_result_name] = "true";
+	json["data"] = results;
 
 	std::string json_body;
 	ArduinoJson::serializeJson(json, json_body);
 
 	/* Response topic */
-	std::string topic_suffix = method + "_reply";
+	std::string topic_suffix = std::string(method) + "_reply";
 	std::replace(topic_suffix.begin(), topic_suffix.end(), '.', '/');
 
 	std::string topic = "/sys/" + decada_product_key_ + "/" + device_uuid + "/" + topic_suffix;
 	if (!publish(topic, json_body)) {
-		LOG_WRN("Failed to send response for %s", method.c_str());
+		LOG_WRN("Failed to send response for %s", log_strdup(method));
 	}
 }
 
@@ -232,7 +608,7 @@ void DecadaManager::send_service_response(const std::string& message_id, const s
  *  @return	csr_sign_resp struct containing client certificate and serial number
  *  @note	DECADA requires that the device has already been created on the cloud before
  *  		a request to sign the device's CSR can be made. This is guaranteed as long
- *  		as this method is called after check_device_creation().
+ *  		as this method is called after the device secret has been provisioned.
  */
 csr_sign_resp DecadaManager::sign_csr(const std::string& csr)
 {
@@ -245,7 +621,7 @@ csr_sign_resp DecadaManager::sign_csr(const std::string& csr)
 
 	ArduinoJson::DynamicJsonDocument json(4096);
 	json["csr"] = csr;
-	json["validDay"] = 365;
+	json["validDay"] = CERT_VALID_DAYS;
 	json["timestamp"] = timestamp_ms;
 #if defined(USER_CONFIG_USE_ECC_SECP256R1)
 	json["issueAuthority"] = "ECC";
@@ -254,9 +630,11 @@ csr_sign_resp DecadaManager::sign_csr(const std::string& csr)
 	std::string json_body;
 	ArduinoJson::serializeJson(json, json_body);
 
-	const std::string params = action_query + "deviceKey" + device_uuid + "orgId" + decada_ou_id_ + "productKey" +
-				   decada_product_key_ + json_body;
-	const std::string signature = hash_sha256(access_token + params + timestamp_ms + decada_access_secret_);
+	/* Signature is computed over the access token, sorted query parameters, request body and timestamp */
+	char signature[SHA256_HEX_SIZE];
+	hash_sha256({ access_token, action_query, "deviceKey", device_uuid, "orgId", decada_ou_id_, "productKey",
+		      decada_product_key_, json_body, timestamp_ms, decada_access_secret_ },
+		    signature);
 
 	HttpsRequest request(request_url);
 	request.add_header("Content-Type", CONTENT_TYPE_JSON_UTF8);
@@ -276,7 +654,7 @@ csr_sign_resp DecadaManager::sign_csr(const std::string& csr)
 			return { .valid = true, .cert = cert, .cert_sn = cert_sn };
 		}
 
-		LOG_WRN("Unexpected JSON shape - received: %s", response.c_str());
+		LOG_WRN("Unexpected JSON shape - received: %s", log_strdup(response.c_str()));
 	}
 	else {
 		LOG_WRN("Failed to send CSR signing request");
@@ -295,7 +673,8 @@ std::string DecadaManager::get_access_token(void)
 	const std::string timestamp_ms = time_engine_.get_timestamp_ms_str();
 	const std::string request_url = decada_api_url + "/apim-token-service/v2.0/token/get";
 
-	const std::string signature = hash_sha256(decada_access_key_ + timestamp_ms + decada_access_secret_);
+	char signature[SHA256_HEX_SIZE];
+	hash_sha256({ decada_access_key_, timestamp_ms, decada_access_secret_ }, signature);
 
 	ArduinoJson::DynamicJsonDocument json(512);
 	json["appKey"] = decada_access_key_;
@@ -319,7 +698,7 @@ std::string DecadaManager::get_access_token(void)
 			return access_token;
 		}
 
-		LOG_WRN("Unexpected JSON shape - received: %s", response.c_str());
+		LOG_WRN("Unexpected JSON shape - received: %s", log_strdup(response.c_str()));
 
 		return "";
 	}
@@ -344,9 +723,10 @@ std::string DecadaManager::get_device_secret(void)
 					"/connect-service/v2.1/devices?action=get&orgId=" + decada_ou_id_ +
 					"&productKey=" + decada_product_key_ + "&deviceKey=" + device_uuid;
 
-	const std::string params =
-		action_query + "deviceKey" + device_uuid + "orgId" + decada_ou_id_ + "productKey" + decada_product_key_;
-	const std::string signature = hash_sha256(access_token + params + timestamp_ms + decada_access_secret_);
+	char signature[SHA256_HEX_SIZE];
+	hash_sha256({ access_token, action_query, "deviceKey", device_uuid, "orgId", decada_ou_id_, "productKey",
+		      decada_product_key_, timestamp_ms, decada_access_secret_ },
+		    signature);
 
 	HttpsRequest request(request_url);
 	request.add_header("apim-accesstoken", access_token);
@@ -364,7 +744,7 @@ std::string DecadaManager::get_device_secret(void)
 			return device_secret;
 		}
 
-		LOG_WRN("Unexpected JSON shape - received: %s", response.c_str());
+		LOG_WRN("Unexpected JSON shape - received: %s", log_strdup(response.c_str()));
 
 		return "";
 	}
@@ -398,8 +778,10 @@ std::string DecadaManager::create_device_in_decada(const std::string& name)
 	std::string json_body;
 	ArduinoJson::serializeJson(json, json_body);
 
-	const std::string params = action_query + "orgId" + decada_ou_id_ + json_body;
-	const std::string signature = hash_sha256(access_token + params + timestamp_ms + decada_access_secret_);
+	char signature[SHA256_HEX_SIZE];
+	hash_sha256({ access_token, action_query, "orgId", decada_ou_id_, json_body, timestamp_ms,
+		      decada_access_secret_ },
+		    signature);
 
 	HttpsRequest request(request_url);
 	request.add_header("Content-Type", CONTENT_TYPE_JSON_UTF8);
@@ -418,7 +800,7 @@ std::string DecadaManager::create_device_in_decada(const std::string& name)
 			return device_secret;
 		}
 
-		LOG_WRN("Unexpected JSON shape - received: %s", response.c_str());
+		LOG_WRN("Unexpected JSON shape - received: %s", log_strdup(response.c_str()));
 
 		return "";
 	}
@@ -447,7 +829,7 @@ std::string DecadaManager::check_device_creation(void)
 		}
 
 		/* Try again after 500ms */
-		wdt_feed(wdt_, wdt_channel_id_);
+		check_in_watchdog();
 		k_msleep(500);
 	}
 
@@ -17,33 +17,70 @@
 #define _DECADA_MANAGER_H_
 
 #include <string>
+#include <vector>
+#include <sys/atomic.h>
+#include "ArduinoJson.hpp"
 #include "crypto_engine/crypto_engine.h"
 #include "networking/mqtt/mqtt_client.h"
 #include "time_engine/time_engine.h"
 #include "user_config.h"
 
+class DecadaManager;
+
+struct cert_keygen_work {
+	struct k_work work;
+	DecadaManager* manager;
+};
+
 class DecadaManager : public CryptoEngine, public MqttClient
 {
 public:
-	explicit DecadaManager(const int wdt_channel_id);
+	explicit DecadaManager(const int wdt_task_id);
+
+	/* Steps of connect that can be run ahead of time */
+	bool load_credentials(void);
+	bool prepare_keypair(void);
+	void prefetch_dns(void);
+	void provision(void);
 
 	bool connect(void);
+	bool reconnect(const std::vector<std::string>& topics, int attempts);
+	void poll_cert_renewal(void);
+	void generate_renewal_keypair(void);
 
 private:
 	csr_sign_resp sign_csr(const std::string& csr) override;
 	bool check_credentials(void);
+	bool connect_mqtt(void);
+	bool save_client_cert(const csr_sign_resp& resp);
+
+	/* Background certificate renewal */
+	void schedule_cert_renewal(int64_t delay_s);
+	void renew_client_cert(void);
+	void start_cert_keygen(void);
+
+	/* Uptime (ms) of the next renewal check, or -1 until connected */
+	int64_t next_cert_renewal_ms_ = -1;
+	/* Set while a renewal is waiting for its keypair */
+	bool cert_keygen_requested_ = false;
+	/* Set until the keygen workqueue has finished generating the keypair */
+	atomic_t cert_keygen_pending_ = ATOMIC_INIT(0);
+	bool cert_keygen_work_q_started_ = false;
+	struct cert_keygen_work cert_keygen_work_;
 
 	void subscription_callback(uint8_t* data, int len) override;
-	void send_service_response(const std::string& message_id, const std::string& method,
-				   const std::string& response);
+	void send_service_response(const char* message_id, const char* method, ArduinoJson::JsonObjectConst results);
 
 	/* DECADA Provisioning */
 	std::string get_access_token(void);
 	std::string get_device_secret(void);
 	std::string create_device_in_decada(const std::string& name);
 	std::string check_device_creation(void);
+	void request_device_secret(void);
 
 	std::string device_secret_;
+	/* Saved private key (DER) matching the cached client certificate, if loaded and not yet used */
+	std::string saved_client_key_;
 
 	const std::string decada_ou_id_ = USER_CONFIG_DECADA_OU_ID;
 	const std::string decada_product_key_ = USER_CONFIG_DECADA_PRODUCT_KEY;
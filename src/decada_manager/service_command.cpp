@@ -0,0 +1,51 @@
+#include <logging/log.h>
+LOG_MODULE_REGISTER(service_command, LOG_LEVEL_DBG);
+
+#include "service_command.h"
+
+/**
+ * @brief	Parses a DECADA service command in place
+ * @author	Lee Tze Han
+ * @param	payload		MQTT payload; overwritten as strings are unescaped and terminated
+ * @param	len		Length of payload
+ * @param	param_names	Parameters to keep from the params object
+ * @param	param_count	Number of entries in param_names
+ * @param	doc		Document holding the parsed fields
+ * @param	command		Set to the parsed fields on success
+ * @return	Success status
+ * @details	Nothing is allocated: the document has fixed capacity and holds pointers into payload, so
+ * 		the command is only valid while both are in scope.
+ */
+bool parse_service_command(char* payload, size_t len, const char* const* param_names, size_t param_count,
+			   service_command_doc& doc, service_command& command)
+{
+	/* Only the fields a handler needs are stored in the document */
+	service_command_doc filter;
+	filter["id"] = true;
+	filter["method"] = true;
+	filter["version"] = true;
+	ArduinoJson::JsonObject params_filter = filter.createNestedObject("params");
+	for (size_t i = 0; i < param_count; i++) {
+		params_filter[param_names[i]] = true;
+	}
+
+	/* A non-const input is parsed without copying strings */
+	ArduinoJson::DeserializationError error =
+		ArduinoJson::deserializeJson(doc, payload, len, ArduinoJson::DeserializationOption::Filter(filter));
+	if (error) {
+		LOG_WRN("Failed to parse service command: %s", error.c_str());
+		return false;
+	}
+
+	command.id = doc["id"].as<const char*>();
+	command.method = doc["method"].as<const char*>();
+	command.version = doc["version"].as<const char*>();
+	command.params = doc["params"].as<ArduinoJson::JsonObject>();
+
+	if (command.id == NULL || command.method == NULL || command.version == NULL || command.params.isNull()) {
+		LOG_WRN("Unexpected JSON shape for service command");
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,42 @@
+/*******************************************************************************************************
+ * Copyright (c) 2021 Government Technology Agency of Singapore (GovTech)
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied.
+ *
+ * See the License for the specific language governing permissions and limitations under the License.
+ *******************************************************************************************************/
+#ifndef _SERVICE_COMMAND_H_
+#define _SERVICE_COMMAND_H_
+
+#include "ArduinoJson.hpp"
+
+/* Parameters kept from a command; parameters without a handler are dropped while parsing */
+#define SERVICE_COMMAND_MAX_PARAMS (8)
+
+/*
+ * Fixed-capacity document for the id, method, version and params fields. Parsing is done in place,
+ * so strings in the document point into the payload rather than being copied into it.
+ */
+typedef ArduinoJson::StaticJsonDocument<JSON_OBJECT_SIZE(4) + JSON_OBJECT_SIZE(SERVICE_COMMAND_MAX_PARAMS)>
+	service_command_doc;
+
+/* Fields of a DECADA service command, valid while the payload and document are */
+struct service_command {
+	const char* id;
+	const char* method;
+	const char* version;
+	ArduinoJson::JsonObjectConst params;
+};
+
+bool parse_service_command(char* payload, size_t len, const char* const* param_names, size_t param_count,
+			   service_command_doc& doc, service_command& command);
+
+#endif // _SERVICE_COMMAND_H_
@@ -1,6 +1,7 @@
 #include "device_uuid.h"
 #include <iomanip>
 #include <sstream>
+#include "user_config.h"
 
 /**
  *  @brief  Returns a unique device ID
@@ -9,6 +10,7 @@
  */
 std::string read_device_uuid(void)
 {
+#if defined(CONFIG_UUID_ADDRESS)
 	std::stringstream ss;
 	ss << std::hex;
 
@@ -28,4 +30,8 @@ std::string read_device_uuid(void)
 	ss << *(uint32_t*)(CONFIG_UUID_ADDRESS + 0x08);
 
 	return ss.str();
+#else
+	/* Targets without a factory flashed UID (e.g. native_posix) use a configured UUID instead */
+	return USER_CONFIG_DEVICE_UUID;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,558 @@
+#include <logging/log.h>
+LOG_MODULE_REGISTER(alloc_profiler, LOG_LEVEL_DBG);
+
+#include <new>
+#include <stdlib.h>
+#include "alloc_profiler.h"
+
+#define ALLOC_PROFILER_MAX_THREADS (8)
+#define ALLOC_PROFILER_MAX_SITES   (32)
+/* Live blocks are tracked in an open-addressed table; must be a power of two */
+#define ALLOC_PROFILER_LIVE_SLOTS (512)
+/* Steady-state allocations are logged at most this often per loop */
+#define ALLOC_PROFILER_FLAG_PERIOD_MS (60 * MSEC_PER_SEC)
+
+#if defined(ALLOC_PROFILER)
+static const bool profiler_enabled = true;
+#else
+static const bool profiler_enabled = false;
+#endif
+
+static const char* module_names[ALLOC_MODULE_COUNT] = {
+	"other", "behavior_manager", "communications", "decada_manager", "mqtt", "http", "dns",
+};
+
+static const char* loop_names[ALLOC_LOOP_COUNT] = {
+	"behavior_manager",
+	"communications",
+};
+
+/* Module in scope on each thread that has entered one */
+struct thread_scope {
+	k_tid_t thread;
+	enum alloc_module module;
+};
+
+struct loop_state {
+	k_tid_t thread;
+	bool in_iteration;
+	uint32_t allocs;
+	uint32_t bytes;
+	int64_t last_flag_ms;
+	struct alloc_loop_stats stats;
+};
+
+struct live_block {
+	void* ptr;
+	uint32_t size;
+	enum alloc_module module;
+};
+
+/* All state is guarded by one lock; the profiler is only built in for measurement */
+static struct k_spinlock profiler_lock;
+static struct thread_scope scopes[ALLOC_PROFILER_MAX_THREADS];
+static struct loop_state loops[ALLOC_LOOP_COUNT];
+static struct alloc_module_stats modules[ALLOC_MODULE_COUNT];
+static struct alloc_site_stats sites[ALLOC_PROFILER_MAX_SITES];
+static size_t site_count;
+/* Allocations that could not be given a call site or live block slot */
+static uint32_t untracked_sites;
+static uint32_t untracked_blocks;
+static bool steady_state;
+
+#if defined(ALLOC_PROFILER)
+/* Open-addressed table of blocks not yet freed, keyed by pointer */
+static struct live_block live_blocks[ALLOC_PROFILER_LIVE_SLOTS];
+static size_t live_count;
+
+/**
+ * @brief	Get the slot of a pointer in the live block table
+ * @author	Lee Tze Han
+ * @param	ptr	Allocated block
+ * @return	Index of the first slot to probe
+ */
+static size_t live_slot(const void* ptr)
+{
+	return (((uintptr_t)ptr >> 3) * 2654435761u) & (ALLOC_PROFILER_LIVE_SLOTS - 1);
+}
+
+/**
+ * @brief	Get the module in scope on the current thread
+ * @author	Lee Tze Han
+ * @return	Module, or ALLOC_MODULE_OTHER if the thread has not entered one
+ * @note	Must be called with profiler_lock held
+ */
+static alloc_module current_module(k_tid_t thread)
+{
+	for (auto& scope : scopes) {
+		if (scope.thread == thread) {
+			return scope.module;
+		}
+	}
+
+	return ALLOC_MODULE_OTHER;
+}
+
+/**
+ * @brief	Account for a new block
+ * @author	Lee Tze Han
+ * @param	ptr	Allocated block
+ * @param	size	Requested size in bytes
+ * @param	caller	Return address of the allocation call
+ */
+static void record_alloc(void* ptr, size_t size, void* caller)
+{
+	k_tid_t thread = k_current_get();
+
+	k_spinlock_key_t key = k_spin_lock(&profiler_lock);
+	alloc_module module = current_module(thread);
+
+	struct alloc_module_stats& stats = modules[module];
+	stats.allocs++;
+	stats.bytes += size;
+	stats.live_blocks++;
+	stats.live_bytes += size;
+	stats.peak_live_bytes = MAX(stats.peak_live_bytes, stats.live_bytes);
+
+	bool in_steady_iteration = false;
+	for (auto& loop : loops) {
+		if (loop.in_iteration && loop.thread == thread) {
+			loop.allocs++;
+			loop.bytes += size;
+			in_steady_iteration = steady_state;
+		}
+	}
+
+	struct alloc_site_stats* site = NULL;
+	for (size_t i = 0; i < site_count; i++) {
+		if (sites[i].caller == (uintptr_t)caller && sites[i].module == module) {
+			site = &sites[i];
+			break;
+		}
+	}
+	if (site == NULL && site_count < ALLOC_PROFILER_MAX_SITES) {
+		site = &sites[site_count++];
+		site->caller = (uintptr_t)caller;
+		site->module = module;
+	}
+	if (site != NULL) {
+		site->allocs++;
+		site->bytes += size;
+		site->steady_allocs += in_steady_iteration ? 1 : 0;
+	}
+	else {
+		untracked_sites++;
+	}
+
+	/* Keep the table at most 3/4 full so that probes stay short */
+	if (live_count < ALLOC_PROFILER_LIVE_SLOTS * 3 / 4) {
+		size_t i = live_slot(ptr);
+		while (live_blocks[i].ptr != NULL) {
+			i = (i + 1) & (ALLOC_PROFILER_LIVE_SLOTS - 1);
+		}
+		live_blocks[i] = { ptr, (uint32_t)size, module };
+		live_count++;
+	}
+	else {
+		untracked_blocks++;
+	}
+	k_spin_unlock(&profiler_lock, key);
+}
+
+/**
+ * @brief	Account for a freed block
+ * @author	Lee Tze Han
+ * @param	ptr	Block about to be freed
+ * @details	Blocks not in the live table (allocated inside the C library, or while the table was full)
+ * 		are ignored.
+ */
+static void record_free(void* ptr)
+{
+	k_spinlock_key_t key = k_spin_lock(&profiler_lock);
+
+	size_t i = live_slot(ptr);
+	while (live_blocks[i].ptr != NULL && live_blocks[i].ptr != ptr) {
+		i = (i + 1) & (ALLOC_PROFILER_LIVE_SLOTS - 1);
+	}
+
+	if (live_blocks[i].ptr == NULL) {
+		k_spin_unlock(&profiler_lock, key);
+		return;
+	}
+
+	struct alloc_module_stats& stats = modules[live_blocks[i].module];
+	stats.frees++;
+	stats.live_blocks--;
+	stats.live_bytes -= live_blocks[i].size;
+
+	/* Backward-shift deletion keeps linear probing correct without tombstones */
+	size_t j = i;
+	while (true) {
+		j = (j + 1) & (ALLOC_PROFILER_LIVE_SLOTS - 1);
+		if (live_blocks[j].ptr == NULL) {
+			break;
+		}
+
+		size_t home = live_slot(live_blocks[j].ptr);
+		bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+		if (!stays) {
+			live_blocks[i] = live_blocks[j];
+			i = j;
+		}
+	}
+	live_blocks[i].ptr = NULL;
+	live_count--;
+
+	k_spin_unlock(&profiler_lock, key);
+}
+
+/* Linked with --wrap for each of these; see the header */
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size)
+{
+	void* ptr = __real_malloc(size);
+	if (ptr != NULL) {
+		record_alloc(ptr, size, __builtin_return_address(0));
+	}
+
+	return ptr;
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+	void* ptr = __real_calloc(count, size);
+	if (ptr != NULL) {
+		record_alloc(ptr, count * size, __builtin_return_address(0));
+	}
+
+	return ptr;
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+	void* new_ptr = __real_realloc(ptr, size);
+
+	/* A failed realloc leaves the original block in place */
+	if (new_ptr != NULL || size == 0) {
+		if (ptr != NULL) {
+			record_free(ptr);
+		}
+		if (new_ptr != NULL) {
+			record_alloc(new_ptr, size, __builtin_return_address(0));
+		}
+	}
+
+	return new_ptr;
+}
+
+void __wrap_free(void* ptr)
+{
+	if (ptr != NULL) {
+		record_free(ptr);
+	}
+
+	__real_free(ptr);
+}
+}
+
+/*
+ * operator new is replaced so that call sites point at the code using new rather than into the C++
+ * library, and so that allocations are seen on host builds where the library is linked dynamically.
+ * As with the C++ library built without exceptions, a failed allocation returns NULL.
+ */
+void* operator new(size_t size)
+{
+	void* ptr = __real_malloc(size);
+	if (ptr != NULL) {
+		record_alloc(ptr, size, __builtin_return_address(0));
+	}
+
+	return ptr;
+}
+
+void* operator new[](size_t size)
+{
+	void* ptr = __real_malloc(size);
+	if (ptr != NULL) {
+		record_alloc(ptr, size, __builtin_return_address(0));
+	}
+
+	return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+	__wrap_free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	__wrap_free(ptr);
+}
+
+void operator delete(void* ptr, size_t size) noexcept
+{
+	ARG_UNUSED(size);
+	__wrap_free(ptr);
+}
+
+void operator delete[](void* ptr, size_t size) noexcept
+{
+	ARG_UNUSED(size);
+	__wrap_free(ptr);
+}
+#endif // ALLOC_PROFILER
+
+/**
+ * @brief	Attribute allocations on the calling thread to a module
+ * @author	Lee Tze Han
+ * @param	module	Module entered
+ * @return	Module previously in scope, to be passed to leave
+ * @note	AllocScope pairs this with leave for a block.
+ */
+alloc_module alloc_profiler::enter(alloc_module module)
+{
+	if (!profiler_enabled) {
+		return ALLOC_MODULE_OTHER;
+	}
+
+	k_tid_t thread = k_current_get();
+	alloc_module previous = ALLOC_MODULE_OTHER;
+
+	k_spinlock_key_t key = k_spin_lock(&profiler_lock);
+	struct thread_scope* free_scope = NULL;
+	for (auto& scope : scopes) {
+		if (scope.thread == thread) {
+			previous = scope.module;
+			scope.module = module;
+			k_spin_unlock(&profiler_lock, key);
+			return previous;
+		}
+		if (scope.thread == NULL && free_scope == NULL) {
+			free_scope = &scope;
+		}
+	}
+
+	/* Allocations stay attributed to ALLOC_MODULE_OTHER if too many threads are in scopes */
+	if (free_scope != NULL) {
+		free_scope->thread = thread;
+		free_scope->module = module;
+	}
+	k_spin_unlock(&profiler_lock, key);
+
+	return previous;
+}
+
+/**
+ * @brief	Restore the module in scope before the matching enter
+ * @author	Lee Tze Han
+ * @param	previous	Value returned by enter
+ */
+void alloc_profiler::leave(alloc_module previous)
+{
+	if (!profiler_enabled) {
+		return;
+	}
+
+	k_tid_t thread = k_current_get();
+
+	k_spinlock_key_t key = k_spin_lock(&profiler_lock);
+	for (auto& scope : scopes) {
+		if (scope.thread == thread) {
+			scope.module = previous;
+			/* Release the slot of threads leaving their outermost scope, such as boot workers */
+			if (previous == ALLOC_MODULE_OTHER) {
+				scope.thread = NULL;
+			}
+			break;
+		}
+	}
+	k_spin_unlock(&profiler_lock, key);
+}
+
+/**
+ * @brief	Start counting allocations of an iteration of a thread loop
+ * @author	Lee Tze Han
+ * @param	loop	Loop run by the calling thread
+ */
+void alloc_profiler::iteration_begin(alloc_loop loop)
+{
+	if (!profiler_enabled) {
+		return;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&profiler_lock);
+	loops[loop].thread = k_current_get();
+	loops[loop].in_iteration = true;
+	loops[loop].allocs = 0;
+	loops[loop].bytes = 0;
+	k_spin_unlock(&profiler_lock, key);
+}
+
+/**
+ * @brief	Record the allocations of the iteration in progress
+ * @author	Lee Tze Han
+ * @param	loop	Loop run by the calling thread
+ * @details	In steady state, iterations that allocate are logged, at most once per
+ * 		ALLOC_PROFILER_FLAG_PERIOD_MS for each loop.
+ */
+void alloc_profiler::iteration_end(alloc_loop loop)
+{
+	if (!profiler_enabled) {
+		return;
+	}
+
+	int64_t now = k_uptime_get();
+	bool flag = false;
+
+	k_spinlock_key_t key = k_spin_lock(&profiler_lock);
+	struct loop_state& state = loops[loop];
+	uint32_t allocs = state.allocs;
+	uint32_t bytes = state.bytes;
+
+	state.in_iteration = false;
+	state.stats.iterations++;
+	state.stats.max_allocs = MAX(state.stats.max_allocs, allocs);
+	state.stats.max_bytes = MAX(state.stats.max_bytes, bytes);
+	if (allocs > 0) {
+		state.stats.allocating_iterations++;
+		if (steady_state) {
+			state.stats.steady_allocs += allocs;
+			if (state.last_flag_ms == 0 || now - state.last_flag_ms >= ALLOC_PROFILER_FLAG_PERIOD_MS) {
+				state.last_flag_ms = now;
+				flag = true;
+			}
+		}
+	}
+	k_spin_unlock(&profiler_lock, key);
+
+	if (flag) {
+		LOG_WRN("Steady-state allocation: %s loop iteration allocated %u blocks (%u bytes)", loop_names[loop],
+			allocs, bytes);
+	}
+}
+
+/**
+ * @brief	Flag allocations inside loop iterations from now on
+ * @author	Lee Tze Han
+ * @note	Should be called once start-up work (connection, first reports) is done.
+ */
+void alloc_profiler::set_steady_state(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&profiler_lock);
+	steady_state = true;
+	k_spin_unlock(&profiler_lock, key);
+}
+
+/**
+ * @brief	Get the allocation counters of a module
+ * @author	Lee Tze Han
+ * @param	module	Module to query
+ * @return	Copy of the counters
+ */
+alloc_module_stats alloc_profiler::get_module_stats(alloc_module module)
+{
+	k_spinlock_key_t key = k_spin_lock(&profiler_lock);
+	alloc_module_stats stats = modules[module];
+	k_spin_unlock(&profiler_lock, key);
+
+	return stats;
+}
+
+/**
+ * @brief	Get the per-iteration counters of a loop
+ * @author	Lee Tze Han
+ * @param	loop	Loop to query
+ * @return	Copy of the counters
+ */
+alloc_loop_stats alloc_profiler::get_loop_stats(alloc_loop loop)
+{
+	k_spinlock_key_t key = k_spin_lock(&profiler_lock);
+	alloc_loop_stats stats = loops[loop].stats;
+	k_spin_unlock(&profiler_lock, key);
+
+	return stats;
+}
+
+/**
+ * @brief	Get the number of call sites recorded
+ * @author	Lee Tze Han
+ * @return	Number of sites, at most ALLOC_PROFILER_MAX_SITES
+ */
+size_t alloc_profiler::get_site_count(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&profiler_lock);
+	size_t count = site_count;
+	k_spin_unlock(&profiler_lock, key);
+
+	return count;
+}
+
+/**
+ * @brief	Get the counters of a call site
+ * @author	Lee Tze Han
+ * @param	index	Index of the site, below get_site_count
+ * @param	stats	Filled with a copy of the counters
+ * @return	True if the index is valid
+ */
+bool alloc_profiler::get_site_stats(size_t index, alloc_site_stats& stats)
+{
+	k_spinlock_key_t key = k_spin_lock(&profiler_lock);
+	bool valid = index < site_count;
+	if (valid) {
+		stats = sites[index];
+	}
+	k_spin_unlock(&profiler_lock, key);
+
+	return valid;
+}
+
+/**
+ * @brief	Log allocations per module, loop and call site
+ * @author	Lee Tze Han
+ * @details	Call sites are return addresses; resolve them with addr2line against zephyr.elf.
+ */
+void alloc_profiler::log_report(void)
+{
+	if (!profiler_enabled) {
+		return;
+	}
+
+	for (int i = 0; i < ALLOC_MODULE_COUNT; i++) {
+		alloc_module_stats stats = get_module_stats((alloc_module)i);
+		LOG_INF("%-18s %6u allocs %6u frees %8u bytes, live %d blocks / %d bytes (peak %d)", module_names[i],
+			stats.allocs, stats.frees, (uint32_t)stats.bytes, stats.live_blocks, stats.live_bytes,
+			stats.peak_live_bytes);
+	}
+
+	for (int i = 0; i < ALLOC_LOOP_COUNT; i++) {
+		alloc_loop_stats stats = get_loop_stats((alloc_loop)i);
+		LOG_INF("%-18s %u iterations, %u allocating (max %u blocks / %u bytes), %u steady-state allocs",
+			loop_names[i], stats.iterations, stats.allocating_iterations, stats.max_allocs, stats.max_bytes,
+			stats.steady_allocs);
+	}
+
+	size_t count = get_site_count();
+	for (size_t i = 0; i < count; i++) {
+		alloc_site_stats stats;
+		if (get_site_stats(i, stats)) {
+			LOG_INF("site 0x%08lx %-18s %6u allocs %8u bytes %6u steady", (unsigned long)stats.caller,
+				module_names[stats.module], stats.allocs, stats.bytes, stats.steady_allocs);
+		}
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&profiler_lock);
+	uint32_t sites_missed = untracked_sites;
+	uint32_t blocks_missed = untracked_blocks;
+	k_spin_unlock(&profiler_lock, key);
+
+	if (sites_missed > 0 || blocks_missed > 0) {
+		LOG_WRN("Allocations without a call site slot: %u, without a live block slot: %u", sites_missed,
+			blocks_missed);
+	}
+}
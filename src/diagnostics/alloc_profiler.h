@@ -0,0 +1,105 @@
+/*******************************************************************************************************
+ * Copyright (c) 2021 Government Technology Agency of Singapore (GovTech)
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied.
+ *
+ * See the License for the specific language governing permissions and limitations under the License.
+ *******************************************************************************************************/
+#ifndef _ALLOC_PROFILER_H_
+#define _ALLOC_PROFILER_H_
+
+#include <zephyr.h>
+
+/*
+ * Heap allocation profiler. Built with ALLOC_PROFILER defined and malloc, calloc, realloc and free
+ * wrapped at link time (see the alloc_profile environment in platformio.ini or -DALLOC_PROFILER=ON for
+ * west builds), every allocation is counted against the module in scope on the calling thread, its
+ * call site and the loop iteration in progress. Once set_steady_state is called, allocations inside
+ * loop iterations are flagged, so a zero-allocation steady state can be shown by the report. Without
+ * ALLOC_PROFILER, all functions are no-ops and the report is empty.
+ */
+
+enum alloc_module {
+	/* Threads and scopes not attributed to a module */
+	ALLOC_MODULE_OTHER,
+	ALLOC_MODULE_BEHAVIOR_MANAGER,
+	ALLOC_MODULE_COMMUNICATIONS,
+	ALLOC_MODULE_DECADA_MANAGER,
+	ALLOC_MODULE_MQTT,
+	ALLOC_MODULE_HTTP,
+	ALLOC_MODULE_DNS,
+	ALLOC_MODULE_COUNT
+};
+
+enum alloc_loop {
+	ALLOC_LOOP_BEHAVIOR_MANAGER,
+	ALLOC_LOOP_COMMUNICATIONS,
+	ALLOC_LOOP_COUNT
+};
+
+struct alloc_module_stats {
+	uint32_t allocs;
+	uint32_t frees;
+	uint64_t bytes;
+	/* Blocks allocated in the module and not yet freed */
+	int32_t live_blocks;
+	int32_t live_bytes;
+	int32_t peak_live_bytes;
+};
+
+struct alloc_loop_stats {
+	uint32_t iterations;
+	/* Iterations that allocated at all */
+	uint32_t allocating_iterations;
+	uint32_t max_allocs;
+	uint32_t max_bytes;
+	/* Allocations made in iterations since set_steady_state */
+	uint32_t steady_allocs;
+};
+
+struct alloc_site_stats {
+	/* Return address of the allocation call */
+	uintptr_t caller;
+	enum alloc_module module;
+	uint32_t allocs;
+	uint32_t bytes;
+	uint32_t steady_allocs;
+};
+
+namespace alloc_profiler
+{
+alloc_module enter(alloc_module module);
+void leave(alloc_module previous);
+
+void iteration_begin(alloc_loop loop);
+void iteration_end(alloc_loop loop);
+void set_steady_state(void);
+
+alloc_module_stats get_module_stats(alloc_module module);
+alloc_loop_stats get_loop_stats(alloc_loop loop);
+size_t get_site_count(void);
+bool get_site_stats(size_t index, alloc_site_stats& stats);
+
+void log_report(void);
+} // namespace alloc_profiler
+
+/* Attributes allocations on the calling thread to a module until the end of the enclosing block */
+class AllocScope
+{
+public:
+	explicit AllocScope(alloc_module module) : previous_(alloc_profiler::enter(module)) {}
+	~AllocScope(void) { alloc_profiler::leave(previous_); }
+
+private:
+	alloc_module previous_;
+};
+
+#endif // _ALLOC_PROFILER_H_
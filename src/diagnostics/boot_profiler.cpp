@@ -0,0 +1,174 @@
+#include <logging/log.h>
+LOG_MODULE_REGISTER(boot_profiler, LOG_LEVEL_DBG);
+
+#include "ArduinoJson.hpp"
+#include "boot_profiler.h"
+#include "device_uuid/device_uuid.h"
+
+static const char* stage_names[BOOT_PROFILE_STAGE_COUNT] = {
+	"watchdog_setup",
+	"wifi_association",
+	"tls_credentials",
+	"nvs_init",
+	"sntp_sync",
+	"device_provisioning",
+	"rest_requests",
+	"mqtt_connack",
+	"mqtt_suback",
+};
+
+static boot_profile_record records[BOOT_PROFILE_STAGE_COUNT];
+/* Start of the current entry into each stage, valid while in_stage is set */
+static int64_t entered_ms[BOOT_PROFILE_STAGE_COUNT];
+static bool in_stage[BOOT_PROFILE_STAGE_COUNT];
+static bool stage_seen[BOOT_PROFILE_STAGE_COUNT];
+static int64_t first_publish_ms = -1;
+static struct k_spinlock profile_lock;
+
+/**
+ * @brief	Mark entry into a stage.
+ * @author	Lee Tze Han
+ * @param	stage	Stage being entered
+ * @note	Ignored once the first publish has been made
+ */
+void boot_profiler::begin(boot_profile_stage stage)
+{
+	int64_t now = k_uptime_get();
+
+	k_spinlock_key_t key = k_spin_lock(&profile_lock);
+	if (first_publish_ms < 0) {
+		entered_ms[stage] = now;
+		in_stage[stage] = true;
+		if (!stage_seen[stage]) {
+			records[stage].first_start_ms = now;
+			stage_seen[stage] = true;
+		}
+	}
+	k_spin_unlock(&profile_lock, key);
+}
+
+/**
+ * @brief	Mark exit from a stage.
+ * @author	Lee Tze Han
+ * @param	stage	Stage being exited
+ * @note	Ignored if the stage was not entered (e.g. an unsolicited CONNACK)
+ */
+void boot_profiler::end(boot_profile_stage stage)
+{
+	int64_t now = k_uptime_get();
+
+	k_spinlock_key_t key = k_spin_lock(&profile_lock);
+	if (in_stage[stage]) {
+		records[stage].total_ms += now - entered_ms[stage];
+		records[stage].count++;
+		in_stage[stage] = false;
+	}
+	k_spin_unlock(&profile_lock, key);
+}
+
+/**
+ * @brief	Mark a successful publish, which ends the boot.
+ * @author	Lee Tze Han
+ * @return	True for the first publish only
+ */
+bool boot_profiler::mark_first_publish(void)
+{
+	int64_t now = k_uptime_get();
+	bool first = false;
+
+	k_spinlock_key_t key = k_spin_lock(&profile_lock);
+	if (first_publish_ms < 0) {
+		first_publish_ms = now;
+		first = true;
+	}
+	k_spin_unlock(&profile_lock, key);
+
+	return first;
+}
+
+/**
+ * @brief	Get the times recorded for a stage.
+ * @author	Lee Tze Han
+ * @param	stage	Stage of interest
+ * @return	boot_profile_record struct
+ */
+boot_profile_record boot_profiler::get_record(boot_profile_stage stage)
+{
+	k_spinlock_key_t key = k_spin_lock(&profile_lock);
+	boot_profile_record record = records[stage];
+	k_spin_unlock(&profile_lock, key);
+
+	return record;
+}
+
+/**
+ * @brief	Get the uptime of the first publish.
+ * @author	Lee Tze Han
+ * @return	Uptime in milliseconds, or -1 if nothing has been published yet
+ */
+int64_t boot_profiler::get_first_publish_ms(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&profile_lock);
+	int64_t uptime_ms = first_publish_ms;
+	k_spin_unlock(&profile_lock, key);
+
+	return uptime_ms;
+}
+
+/**
+ * @brief	Get printable name of a stage.
+ * @author	Lee Tze Han
+ * @param	stage	Stage of interest
+ * @return	Null-terminated stage name
+ */
+const char* boot_profiler::get_stage_name(boot_profile_stage stage)
+{
+	return stage_names[stage];
+}
+
+/**
+ * @brief	Log the boot report.
+ * @author	Lee Tze Han
+ */
+void boot_profiler::log_report(void)
+{
+	for (int i = 0; i < BOOT_PROFILE_STAGE_COUNT; i++) {
+		boot_profile_record record = get_record((boot_profile_stage)i);
+		if (record.count == 0) {
+			LOG_INF("%-20s not completed", stage_names[i]);
+			continue;
+		}
+
+		LOG_INF("%-20s starts %6u ms, took %6u ms (%u times)", stage_names[i], (uint32_t)record.first_start_ms,
+			(uint32_t)record.total_ms, record.count);
+	}
+
+	LOG_INF("First publish at %d ms", (int32_t)get_first_publish_ms());
+}
+
+/**
+ * @brief	Format the boot report as a DECADA event.
+ * @author	Lee Tze Han
+ * @return	JSON string with the time taken by each completed stage and the uptime of the first publish
+ */
+std::string boot_profiler::get_report_json(void)
+{
+	ArduinoJson::DynamicJsonDocument json(1024);
+	json["id"] = device_uuid;
+	json["version"] = "1.0";
+	json["method"] = "thing.event.boot_report.post";
+
+	ArduinoJson::JsonObject params = json.createNestedObject("params");
+	for (int i = 0; i < BOOT_PROFILE_STAGE_COUNT; i++) {
+		boot_profile_record record = get_record((boot_profile_stage)i);
+		if (record.count > 0) {
+			params[std::string(stage_names[i]) + "_ms"] = record.total_ms;
+		}
+	}
+	params["first_publish_ms"] = get_first_publish_ms();
+
+	std::string json_body;
+	ArduinoJson::serializeJson(json, json_body);
+
+	return json_body;
+}
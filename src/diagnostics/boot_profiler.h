@@ -0,0 +1,64 @@
+/*******************************************************************************************************
+ * Copyright (c) 2021 Government Technology Agency of Singapore (GovTech)
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied.
+ *
+ * See the License for the specific language governing permissions and limitations under the License.
+ *******************************************************************************************************/
+#ifndef _BOOT_PROFILER_H_
+#define _BOOT_PROFILER_H_
+
+#include <string>
+#include <zephyr.h>
+
+/*
+ * Time spent in each stage between main() and the first publish. Stages entered more than once
+ * (e.g. REST requests) accumulate. Recording stops at the first publish, after which the report
+ * is available.
+ */
+
+enum boot_profile_stage {
+	BOOT_PROFILE_WATCHDOG_SETUP,
+	BOOT_PROFILE_WIFI_ASSOCIATION,
+	BOOT_PROFILE_TLS_CREDENTIALS,
+	BOOT_PROFILE_NVS_INIT,
+	BOOT_PROFILE_SNTP_SYNC,
+	BOOT_PROFILE_DEVICE_PROVISIONING,
+	BOOT_PROFILE_REST_REQUESTS,
+	BOOT_PROFILE_MQTT_CONNACK,
+	BOOT_PROFILE_MQTT_SUBACK,
+	BOOT_PROFILE_STAGE_COUNT
+};
+
+struct boot_profile_record {
+	/* Uptime when the stage was first entered */
+	int64_t first_start_ms;
+	/* Total time spent in the stage */
+	int64_t total_ms;
+	/* Number of times the stage was completed */
+	uint32_t count;
+};
+
+namespace boot_profiler
+{
+void begin(boot_profile_stage stage);
+void end(boot_profile_stage stage);
+bool mark_first_publish(void);
+
+boot_profile_record get_record(boot_profile_stage stage);
+int64_t get_first_publish_ms(void);
+const char* get_stage_name(boot_profile_stage stage);
+
+void log_report(void);
+std::string get_report_json(void);
+} // namespace boot_profiler
+
+#endif // _BOOT_PROFILER_H_
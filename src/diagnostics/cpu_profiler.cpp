@@ -0,0 +1,293 @@
+#include <logging/log.h>
+LOG_MODULE_REGISTER(cpu_profiler, LOG_LEVEL_DBG);
+
+#include "ArduinoJson.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <sys/atomic.h>
+#include "cpu_profiler.h"
+#include "device_uuid/device_uuid.h"
+
+struct cpu_thread_entry {
+	const struct k_thread* thread;
+	char name[CONFIG_THREAD_MAX_NAME_LEN];
+	/* Execution cycles at the previous sample */
+	uint64_t last_cycles;
+	uint32_t slot_cycles[CPU_PROFILER_WINDOW_SLOTS];
+};
+
+static const char* handler_names[CPU_PROFILE_HANDLER_COUNT] = {
+	"mqtt_input",
+	"mqtt_keepalive",
+};
+
+static cpu_thread_entry threads[CPU_PROFILER_MAX_THREADS];
+static int thread_count = 0;
+/* Cycles accounted to all threads in each slot */
+static uint64_t slot_total_cycles[CPU_PROFILER_WINDOW_SLOTS];
+static uint32_t handler_slot_cycles[CPU_PROFILE_HANDLER_COUNT][CPU_PROFILER_WINDOW_SLOTS];
+/* Handler cycles accumulated since the previous sample */
+static atomic_t handler_pending_cycles[CPU_PROFILE_HANDLER_COUNT];
+static int current_slot = 0;
+static int filled_slots = 0;
+K_MUTEX_DEFINE(profile_mutex);
+
+static struct k_delayed_work sample_work;
+static uint32_t sample_period_ms;
+
+/**
+ * @brief	Compute a share in per mille.
+ * @author	Lee Tze Han
+ * @param	part	Cycles of interest
+ * @param	total	Cycles accounted to all threads
+ * @return	Share of total in per mille, or 0 if total is 0
+ */
+static uint32_t to_permille(uint64_t part, uint64_t total)
+{
+	return total > 0 ? (uint32_t)((part * 1000) / total) : 0;
+}
+
+/**
+ * @brief	Record the cycles a thread has executed since the previous sample.
+ * @author	Lee Tze Han
+ * @param	thread		Thread to sample
+ * @param	user_data	Unused
+ * @note	Called with profile_mutex held
+ */
+static void sample_thread(const struct k_thread* thread, void* user_data)
+{
+	ARG_UNUSED(user_data);
+
+	struct k_thread* target = const_cast<struct k_thread*>(thread);
+
+	k_thread_runtime_stats_t stats;
+	if (k_thread_runtime_stats_get(target, &stats) != 0) {
+		return;
+	}
+
+	cpu_thread_entry* entry = NULL;
+	for (int i = 0; i < thread_count; i++) {
+		if (threads[i].thread == thread) {
+			entry = &threads[i];
+			break;
+		}
+	}
+
+	if (!entry) {
+		if (thread_count >= CPU_PROFILER_MAX_THREADS) {
+			return;
+		}
+
+		/* Time before the first sample is not attributed to any period */
+		entry = &threads[thread_count++];
+		entry->thread = thread;
+		entry->last_cycles = stats.execution_cycles;
+
+		const char* thread_name = k_thread_name_get(target);
+		if (thread_name && thread_name[0] != '\0') {
+			strncpy(entry->name, thread_name, sizeof(entry->name) - 1);
+			entry->name[sizeof(entry->name) - 1] = '\0';
+		}
+		else {
+			snprintf(entry->name, sizeof(entry->name), "%p", thread);
+		}
+		return;
+	}
+
+	uint64_t delta = stats.execution_cycles - entry->last_cycles;
+	entry->last_cycles = stats.execution_cycles;
+	entry->slot_cycles[current_slot] = (uint32_t)MIN(delta, (uint64_t)UINT32_MAX);
+	slot_total_cycles[current_slot] += delta;
+}
+
+/**
+ * @brief	Close the current period and schedule the next sample.
+ * @author	Lee Tze Han
+ * @param	work_item	Unused
+ * @note	Runs on the system workqueue
+ */
+static void sample_periodically(struct k_work* work_item)
+{
+	ARG_UNUSED(work_item);
+
+	k_mutex_lock(&profile_mutex, K_FOREVER);
+	current_slot = (current_slot + 1) % CPU_PROFILER_WINDOW_SLOTS;
+	filled_slots = MIN(filled_slots + 1, CPU_PROFILER_WINDOW_SLOTS);
+
+	/* Exited threads are no longer visited, so their share of the reused slot must be cleared */
+	slot_total_cycles[current_slot] = 0;
+	for (int i = 0; i < thread_count; i++) {
+		threads[i].slot_cycles[current_slot] = 0;
+	}
+
+	k_thread_foreach_unlocked(sample_thread, NULL);
+
+	for (int i = 0; i < CPU_PROFILE_HANDLER_COUNT; i++) {
+		handler_slot_cycles[i][current_slot] = atomic_set(&handler_pending_cycles[i], 0);
+	}
+	k_mutex_unlock(&profile_mutex);
+
+	k_delayed_work_submit(&sample_work, K_MSEC(sample_period_ms));
+}
+
+/**
+ * @brief	Start profiling.
+ * @author	Lee Tze Han
+ * @param	period_ms	Length of each period of the sliding window
+ */
+void cpu_profiler::start(uint32_t period_ms)
+{
+	sample_period_ms = period_ms;
+
+	/* Baseline sample; the first period starts now */
+	k_mutex_lock(&profile_mutex, K_FOREVER);
+	k_thread_foreach_unlocked(sample_thread, NULL);
+	k_mutex_unlock(&profile_mutex);
+
+	k_delayed_work_init(&sample_work, sample_periodically);
+	k_delayed_work_submit(&sample_work, K_MSEC(sample_period_ms));
+}
+
+/**
+ * @brief	Mark the start of a profiled handler.
+ * @author	Lee Tze Han
+ * @return	Start time to pass to handler_end
+ */
+uint32_t cpu_profiler::handler_begin(void)
+{
+	return k_cycle_get_32();
+}
+
+/**
+ * @brief	Mark the end of a profiled handler.
+ * @author	Lee Tze Han
+ * @param	handler		Handler being profiled
+ * @param	start_cycles	Value returned by handler_begin
+ */
+void cpu_profiler::handler_end(cpu_profile_handler handler, uint32_t start_cycles)
+{
+	atomic_add(&handler_pending_cycles[handler], k_cycle_get_32() - start_cycles);
+}
+
+/**
+ * @brief	Get number of threads profiled.
+ * @author	Lee Tze Han
+ * @return	Number of threads; indices range from 0 to count - 1
+ */
+int cpu_profiler::get_thread_count(void)
+{
+	k_mutex_lock(&profile_mutex, K_FOREVER);
+	int count = thread_count;
+	k_mutex_unlock(&profile_mutex);
+
+	return count;
+}
+
+/**
+ * @brief	Get the CPU share of a thread.
+ * @author	Lee Tze Han
+ * @param	index	Index of the thread
+ * @return	cpu_usage struct
+ */
+cpu_usage cpu_profiler::get_thread_usage(int index)
+{
+	cpu_usage usage = {};
+
+	k_mutex_lock(&profile_mutex, K_FOREVER);
+	if (index >= 0 && index < thread_count) {
+		const cpu_thread_entry& entry = threads[index];
+		memcpy(usage.name, entry.name, sizeof(usage.name));
+
+		uint64_t window_cycles = 0;
+		uint64_t window_total = 0;
+		for (int i = 0; i < filled_slots; i++) {
+			window_cycles += entry.slot_cycles[i];
+			window_total += slot_total_cycles[i];
+		}
+
+		usage.last_permille = to_permille(entry.slot_cycles[current_slot], slot_total_cycles[current_slot]);
+		usage.window_permille = to_permille(window_cycles, window_total);
+	}
+	k_mutex_unlock(&profile_mutex);
+
+	return usage;
+}
+
+/**
+ * @brief	Get the CPU share of a profiled handler.
+ * @author	Lee Tze Han
+ * @param	handler	Handler of interest
+ * @return	cpu_usage struct
+ */
+cpu_usage cpu_profiler::get_handler_usage(cpu_profile_handler handler)
+{
+	cpu_usage usage = {};
+	strncpy(usage.name, handler_names[handler], sizeof(usage.name) - 1);
+
+	k_mutex_lock(&profile_mutex, K_FOREVER);
+	uint64_t window_cycles = 0;
+	uint64_t window_total = 0;
+	for (int i = 0; i < filled_slots; i++) {
+		window_cycles += handler_slot_cycles[handler][i];
+		window_total += slot_total_cycles[i];
+	}
+
+	usage.last_permille =
+		to_permille(handler_slot_cycles[handler][current_slot], slot_total_cycles[current_slot]);
+	usage.window_permille = to_permille(window_cycles, window_total);
+	k_mutex_unlock(&profile_mutex);
+
+	return usage;
+}
+
+/**
+ * @brief	Log the CPU share of every thread and profiled handler.
+ * @author	Lee Tze Han
+ */
+void cpu_profiler::log_report(void)
+{
+	for (int i = 0; i < get_thread_count(); i++) {
+		cpu_usage usage = get_thread_usage(i);
+		LOG_INF("%-24s %3u.%u%% (window %3u.%u%%)", log_strdup(usage.name), usage.last_permille / 10,
+			usage.last_permille % 10, usage.window_permille / 10, usage.window_permille % 10);
+	}
+
+	for (int i = 0; i < CPU_PROFILE_HANDLER_COUNT; i++) {
+		cpu_usage usage = get_handler_usage((cpu_profile_handler)i);
+		LOG_INF("%-24s %3u.%u%% (window %3u.%u%%)", log_strdup(usage.name), usage.last_permille / 10,
+			usage.last_permille % 10, usage.window_permille / 10, usage.window_permille % 10);
+	}
+}
+
+/**
+ * @brief	Format the CPU shares as a DECADA event.
+ * @author	Lee Tze Han
+ * @return	JSON string with the share of every thread and profiled handler over the sliding window
+ */
+std::string cpu_profiler::get_report_json(void)
+{
+	ArduinoJson::DynamicJsonDocument json(2048);
+	json["id"] = device_uuid;
+	json["version"] = "1.0";
+	json["method"] = "thing.event.cpu_usage.post";
+
+	ArduinoJson::JsonObject params = json.createNestedObject("params");
+	params["window_ms"] = sample_period_ms * CPU_PROFILER_WINDOW_SLOTS;
+
+	ArduinoJson::JsonObject thread_params = params.createNestedObject("threads");
+	for (int i = 0; i < get_thread_count(); i++) {
+		cpu_usage usage = get_thread_usage(i);
+		thread_params[std::string(usage.name)] = usage.window_permille;
+	}
+
+	ArduinoJson::JsonObject handler_params = params.createNestedObject("handlers");
+	for (int i = 0; i < CPU_PROFILE_HANDLER_COUNT; i++) {
+		cpu_usage usage = get_handler_usage((cpu_profile_handler)i);
+		handler_params[handler_names[i]] = usage.window_permille;
+	}
+
+	std::string json_body;
+	ArduinoJson::serializeJson(json, json_body);
+
+	return json_body;
+}
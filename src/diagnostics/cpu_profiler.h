@@ -0,0 +1,61 @@
+/*******************************************************************************************************
+ * Copyright (c) 2021 Government Technology Agency of Singapore (GovTech)
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied.
+ *
+ * See the License for the specific language governing permissions and limitations under the License.
+ *******************************************************************************************************/
+#ifndef _CPU_PROFILER_H_
+#define _CPU_PROFILER_H_
+
+#include <string>
+#include <zephyr.h>
+
+/*
+ * CPU share of every thread (including idle) and of selected work handlers, built on the kernel
+ * thread runtime statistics (CONFIG_THREAD_RUNTIME_STATS). Usage is sampled once per period and
+ * reported both for the last period and over a sliding window of CPU_PROFILER_WINDOW_SLOTS periods.
+ * Shares are in per mille of the CPU time accounted to threads.
+ */
+
+#define CPU_PROFILER_MAX_THREADS  (16)
+#define CPU_PROFILER_WINDOW_SLOTS (6)
+
+enum cpu_profile_handler {
+	CPU_PROFILE_MQTT_INPUT,
+	CPU_PROFILE_MQTT_KEEPALIVE,
+	CPU_PROFILE_HANDLER_COUNT
+};
+
+struct cpu_usage {
+	char name[CONFIG_THREAD_MAX_NAME_LEN];
+	/* Share over the last period */
+	uint32_t last_permille;
+	/* Share over the sliding window */
+	uint32_t window_permille;
+};
+
+namespace cpu_profiler
+{
+void start(uint32_t period_ms);
+
+uint32_t handler_begin(void);
+void handler_end(cpu_profile_handler handler, uint32_t start_cycles);
+
+int get_thread_count(void);
+cpu_usage get_thread_usage(int index);
+cpu_usage get_handler_usage(cpu_profile_handler handler);
+
+void log_report(void);
+std::string get_report_json(void);
+} // namespace cpu_profiler
+
+#endif // _CPU_PROFILER_H_
@@ -0,0 +1,266 @@
+#include <logging/log.h>
+LOG_MODULE_REGISTER(metrics, LOG_LEVEL_DBG);
+
+#include "ArduinoJson.hpp"
+#include <sys/atomic.h>
+#include "device_uuid/device_uuid.h"
+#include "metrics.h"
+#include "persist_store/persist_store.h"
+
+/* Durations longer than this are taken from the uptime, as the cycle counter may have wrapped */
+#define METRIC_CYCLE_TIMER_LIMIT_MS (1 * MSEC_PER_SEC)
+
+static const char* counter_names[METRIC_COUNTER_COUNT] = {
+	"samples_generated", "samples_published", "publish_failures", "mqtt_reconnects", "http_failures",
+};
+
+static const char* gauge_names[METRIC_GAUGE_COUNT] = {
+	"queue_depth",
+};
+
+static const char* histogram_names[METRIC_HISTOGRAM_COUNT] = {
+	"sample_generation", "serialization", "publish_latency", "http_request", "dns_lookup",
+	"trace_build",       "trace_serialize", "trace_queue",    "trace_dispatch", "trace_publish",
+	"trace_end_to_end",
+};
+
+/* Upper bound of each bucket except the last, which holds everything longer */
+static const uint32_t bucket_bounds_us[METRIC_HISTOGRAM_BUCKETS - 1] = { 100, 1000, 10000, 100000, 1000000, 10000000 };
+
+static atomic_t counters[METRIC_COUNTER_COUNT];
+static atomic_t gauges[METRIC_GAUGE_COUNT];
+static atomic_t gauge_peaks[METRIC_GAUGE_COUNT];
+
+/* Histograms hold a 64-bit sum, so they are updated under a lock rather than atomically */
+static metric_histogram_snapshot histograms[METRIC_HISTOGRAM_COUNT];
+static struct k_spinlock histogram_lock;
+
+/**
+ * @brief	Raise the recorded peak of a gauge if needed.
+ * @author	Lee Tze Han
+ * @param	gauge	Gauge of interest
+ * @param	value	Current value of the gauge
+ */
+static void update_peak(metric_gauge gauge, int32_t value)
+{
+	atomic_val_t peak = atomic_get(&gauge_peaks[gauge]);
+	while (value > peak) {
+		if (atomic_cas(&gauge_peaks[gauge], peak, value)) {
+			break;
+		}
+		peak = atomic_get(&gauge_peaks[gauge]);
+	}
+}
+
+/**
+ * @brief	Add to a counter.
+ * @author	Lee Tze Han
+ * @param	counter	Counter of interest
+ * @param	amount	Amount to add (1 by default)
+ */
+void metrics::increment(metric_counter counter, uint32_t amount)
+{
+	atomic_add(&counters[counter], amount);
+}
+
+/**
+ * @brief	Get the value of a counter.
+ * @author	Lee Tze Han
+ * @param	counter	Counter of interest
+ * @return	Total since boot
+ */
+uint32_t metrics::get_counter(metric_counter counter)
+{
+	return atomic_get(&counters[counter]);
+}
+
+/**
+ * @brief	Set the value of a gauge.
+ * @author	Lee Tze Han
+ * @param	gauge	Gauge of interest
+ * @param	value	New value
+ */
+void metrics::gauge_set(metric_gauge gauge, int32_t value)
+{
+	atomic_set(&gauges[gauge], value);
+	update_peak(gauge, value);
+}
+
+/**
+ * @brief	Adjust the value of a gauge.
+ * @author	Lee Tze Han
+ * @param	gauge	Gauge of interest
+ * @param	delta	Amount to add (negative to subtract)
+ */
+void metrics::gauge_add(metric_gauge gauge, int32_t delta)
+{
+	int32_t value = atomic_add(&gauges[gauge], delta) + delta;
+	update_peak(gauge, value);
+}
+
+/**
+ * @brief	Get the current and peak values of a gauge.
+ * @author	Lee Tze Han
+ * @param	gauge	Gauge of interest
+ * @return	metric_gauge_snapshot struct
+ */
+metric_gauge_snapshot metrics::get_gauge(metric_gauge gauge)
+{
+	return { .value = (int32_t)atomic_get(&gauges[gauge]), .peak = (int32_t)atomic_get(&gauge_peaks[gauge]) };
+}
+
+/**
+ * @brief	Start timing an operation.
+ * @author	Lee Tze Han
+ * @return	Timer to pass to observe_since
+ */
+metric_timer metrics::start_timer(void)
+{
+	return { .start_cycles = k_cycle_get_32(), .start_ms = k_uptime_get() };
+}
+
+/**
+ * @brief	Record a duration in a histogram.
+ * @author	Lee Tze Han
+ * @param	histogram	Histogram of interest
+ * @param	duration_us	Duration in microseconds
+ */
+void metrics::observe_us(metric_histogram histogram, uint32_t duration_us)
+{
+	int bucket = 0;
+	while (bucket < METRIC_HISTOGRAM_BUCKETS - 1 && duration_us >= bucket_bounds_us[bucket]) {
+		bucket++;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&histogram_lock);
+	metric_histogram_snapshot& entry = histograms[histogram];
+	entry.buckets[bucket]++;
+	entry.count++;
+	entry.sum_us += duration_us;
+	entry.max_us = MAX(entry.max_us, duration_us);
+	k_spin_unlock(&histogram_lock, key);
+}
+
+/**
+ * @brief	Record the time elapsed since a timer was started.
+ * @author	Lee Tze Han
+ * @param	histogram	Histogram of interest
+ * @param	timer		Timer from start_timer
+ * @details	Short durations are measured with the cycle counter for sub-millisecond resolution
+ */
+void metrics::observe_since(metric_histogram histogram, const metric_timer& timer)
+{
+	int64_t elapsed_ms = k_uptime_get() - timer.start_ms;
+
+	uint32_t duration_us;
+	if (elapsed_ms < METRIC_CYCLE_TIMER_LIMIT_MS) {
+		duration_us = k_cyc_to_us_floor32(k_cycle_get_32() - timer.start_cycles);
+	}
+	else {
+		duration_us = (uint32_t)MIN(elapsed_ms * USEC_PER_MSEC, (int64_t)UINT32_MAX);
+	}
+
+	observe_us(histogram, duration_us);
+}
+
+/**
+ * @brief	Get the contents of a histogram.
+ * @author	Lee Tze Han
+ * @param	histogram	Histogram of interest
+ * @return	metric_histogram_snapshot struct
+ */
+metric_histogram_snapshot metrics::get_histogram(metric_histogram histogram)
+{
+	k_spinlock_key_t key = k_spin_lock(&histogram_lock);
+	metric_histogram_snapshot snapshot = histograms[histogram];
+	k_spin_unlock(&histogram_lock, key);
+
+	return snapshot;
+}
+
+/**
+ * @brief	Log all metrics.
+ * @author	Lee Tze Han
+ */
+void metrics::log_report(void)
+{
+	for (int i = 0; i < METRIC_COUNTER_COUNT; i++) {
+		LOG_INF("%-20s %u", counter_names[i], get_counter((metric_counter)i));
+	}
+
+	for (int i = 0; i < METRIC_GAUGE_COUNT; i++) {
+		metric_gauge_snapshot gauge = get_gauge((metric_gauge)i);
+		LOG_INF("%-20s %d (peak %d)", gauge_names[i], gauge.value, gauge.peak);
+	}
+
+	for (int i = 0; i < METRIC_HISTOGRAM_COUNT; i++) {
+		metric_histogram_snapshot histogram = get_histogram((metric_histogram)i);
+		if (histogram.count == 0) {
+			LOG_INF("%-20s no samples", histogram_names[i]);
+			continue;
+		}
+
+		LOG_INF("%-20s %u samples, mean %u us, max %u us", histogram_names[i], histogram.count,
+			(uint32_t)(histogram.sum_us / histogram.count), histogram.max_us);
+	}
+
+	persist_store_stats store = get_persist_store_stats();
+	LOG_INF("%-20s %u flash writes, %u avoided, %u coalesced, %u GC events, %u cache reads", "persist_store",
+		store.flash_writes, store.writes_avoided, store.writes_coalesced, store.gc_events, store.cache_reads);
+}
+
+/**
+ * @brief	Format all metrics as a DECADA event.
+ * @author	Lee Tze Han
+ * @param	sw_ver	Firmware version, so that reports can be grouped by version
+ * @return	JSON string with counters, gauges, histogram buckets and persist_store statistics
+ */
+std::string metrics::get_report_json(const std::string& sw_ver)
+{
+	ArduinoJson::DynamicJsonDocument json(4096);
+	json["id"] = device_uuid;
+	json["version"] = "1.0";
+	json["method"] = "thing.event.metrics.post";
+
+	ArduinoJson::JsonObject params = json.createNestedObject("params");
+	params["sw_ver"] = sw_ver;
+	params["uptime_ms"] = k_uptime_get();
+
+	for (int i = 0; i < METRIC_COUNTER_COUNT; i++) {
+		params[counter_names[i]] = get_counter((metric_counter)i);
+	}
+
+	for (int i = 0; i < METRIC_GAUGE_COUNT; i++) {
+		metric_gauge_snapshot gauge = get_gauge((metric_gauge)i);
+		params[gauge_names[i]] = gauge.value;
+		params[std::string(gauge_names[i]) + "_peak"] = gauge.peak;
+	}
+
+	for (int i = 0; i < METRIC_HISTOGRAM_COUNT; i++) {
+		metric_histogram_snapshot histogram = get_histogram((metric_histogram)i);
+
+		ArduinoJson::JsonObject entry = params.createNestedObject(histogram_names[i]);
+		entry["count"] = histogram.count;
+		entry["sum_us"] = histogram.sum_us;
+		entry["max_us"] = histogram.max_us;
+
+		ArduinoJson::JsonArray buckets = entry.createNestedArray("buckets");
+		for (int j = 0; j < METRIC_HISTOGRAM_BUCKETS; j++) {
+			buckets.add(histogram.buckets[j]);
+		}
+	}
+
+	/* Flash wear from persist_store, kept by that module */
+	persist_store_stats store = get_persist_store_stats();
+	ArduinoJson::JsonObject store_entry = params.createNestedObject("persist_store");
+	store_entry["flash_writes"] = store.flash_writes;
+	store_entry["writes_avoided"] = store.writes_avoided;
+	store_entry["writes_coalesced"] = store.writes_coalesced;
+	store_entry["gc_events"] = store.gc_events;
+	store_entry["cache_reads"] = store.cache_reads;
+
+	std::string json_body;
+	ArduinoJson::serializeJson(json, json_body);
+
+	return json_body;
+}
@@ -0,0 +1,97 @@
+/*******************************************************************************************************
+ * Copyright (c) 2021 Government Technology Agency of Singapore (GovTech)
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied.
+ *
+ * See the License for the specific language governing permissions and limitations under the License.
+ *******************************************************************************************************/
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <string>
+#include <zephyr.h>
+
+/*
+ * Runtime metrics for observing the sample pipeline in the field. Counters and gauges are atomic;
+ * histograms share fixed decade-wide buckets in microseconds so that reports from different
+ * firmware versions can be compared directly. Values accumulate from boot.
+ */
+
+enum metric_counter {
+	METRIC_SAMPLES_GENERATED,
+	METRIC_SAMPLES_PUBLISHED,
+	METRIC_PUBLISH_FAILURES,
+	METRIC_MQTT_RECONNECTS,
+	METRIC_HTTP_FAILURES,
+	METRIC_COUNTER_COUNT
+};
+
+enum metric_gauge {
+	/* Samples waiting in the mailbox between the behavior and communications threads */
+	METRIC_QUEUE_DEPTH,
+	METRIC_GAUGE_COUNT
+};
+
+enum metric_histogram {
+	METRIC_SAMPLE_GENERATION,
+	METRIC_SERIALIZATION,
+	METRIC_PUBLISH_LATENCY,
+	METRIC_HTTP_REQUEST,
+	METRIC_DNS_LOOKUP,
+	/* Stages of a sample between capture and the MQTT write (see diagnostics/sample_trace.h) */
+	METRIC_TRACE_BUILD,
+	METRIC_TRACE_SERIALIZE,
+	METRIC_TRACE_QUEUE,
+	METRIC_TRACE_DISPATCH,
+	METRIC_TRACE_PUBLISH,
+	METRIC_TRACE_END_TO_END,
+	METRIC_HISTOGRAM_COUNT
+};
+
+/* Buckets hold durations below 100 us, 1 ms, 10 ms, 100 ms, 1 s, 10 s and everything longer */
+#define METRIC_HISTOGRAM_BUCKETS (7)
+
+struct metric_timer {
+	uint32_t start_cycles;
+	int64_t start_ms;
+};
+
+struct metric_gauge_snapshot {
+	int32_t value;
+	int32_t peak;
+};
+
+struct metric_histogram_snapshot {
+	uint32_t buckets[METRIC_HISTOGRAM_BUCKETS];
+	uint32_t count;
+	uint64_t sum_us;
+	uint32_t max_us;
+};
+
+namespace metrics
+{
+void increment(metric_counter counter, uint32_t amount = 1);
+uint32_t get_counter(metric_counter counter);
+
+void gauge_set(metric_gauge gauge, int32_t value);
+void gauge_add(metric_gauge gauge, int32_t delta);
+metric_gauge_snapshot get_gauge(metric_gauge gauge);
+
+metric_timer start_timer(void);
+void observe_us(metric_histogram histogram, uint32_t duration_us);
+void observe_since(metric_histogram histogram, const metric_timer& timer);
+metric_histogram_snapshot get_histogram(metric_histogram histogram);
+
+void log_report(void);
+std::string get_report_json(const std::string& sw_ver);
+} // namespace metrics
+
+#endif // _METRICS_H_
@@ -0,0 +1,90 @@
+#include <logging/log.h>
+LOG_MODULE_REGISTER(sample_trace, LOG_LEVEL_DBG);
+
+#include <string.h>
+#include <sys/atomic.h>
+#include "metrics.h"
+#include "sample_trace.h"
+#include "user_config.h"
+
+/* Histogram of the interval ending at each stage; indexed by sample_trace_stage */
+static const metric_histogram stage_histograms[SAMPLE_TRACE_STAGE_COUNT] = {
+	METRIC_HISTOGRAM_COUNT, /* Capture starts the trace */
+	METRIC_TRACE_BUILD,
+	METRIC_TRACE_SERIALIZE,
+	METRIC_TRACE_QUEUE,
+	METRIC_TRACE_DISPATCH,
+	METRIC_TRACE_PUBLISH,
+};
+
+static atomic_t last_trace_id;
+
+/**
+ * @brief	Convert an interval between two stages to microseconds.
+ * @author	Lee Tze Han
+ * @param	record	Trace record
+ * @param	from	Earlier stage
+ * @param	to	Later stage
+ * @return	Interval in microseconds, or -1 if either stage was not reached
+ */
+static int64_t interval_us(const sample_trace_record& record, sample_trace_stage from, sample_trace_stage to)
+{
+	if (record.ticks[from] == 0 || record.ticks[to] == 0) {
+		return -1;
+	}
+
+	return k_ticks_to_us_floor64(record.ticks[to] - record.ticks[from]);
+}
+
+/**
+ * @brief	Start tracing a sample at capture.
+ * @author	Lee Tze Han
+ * @param	record	Record to initialize
+ */
+void sample_trace::begin(sample_trace_record& record)
+{
+	memset(&record, 0, sizeof(record));
+	record.id = atomic_inc(&last_trace_id) + 1;
+	record.ticks[SAMPLE_TRACE_CAPTURE] = k_uptime_ticks();
+}
+
+/**
+ * @brief	Record that a sample has reached a stage.
+ * @author	Lee Tze Han
+ * @param	record	Record of the sample
+ * @param	stage	Stage reached
+ */
+void sample_trace::mark(sample_trace_record& record, sample_trace_stage stage)
+{
+	record.ticks[stage] = k_uptime_ticks();
+}
+
+/**
+ * @brief	Aggregate the stage latencies of a sample.
+ * @author	Lee Tze Han
+ * @param	record	Record of the sample, after its last stage
+ */
+void sample_trace::finish(const sample_trace_record& record)
+{
+	for (int i = SAMPLE_TRACE_CAPTURE + 1; i < SAMPLE_TRACE_STAGE_COUNT; i++) {
+		int64_t us = interval_us(record, (sample_trace_stage)(i - 1), (sample_trace_stage)i);
+		if (us >= 0) {
+			metrics::observe_us(stage_histograms[i], (uint32_t)MIN(us, (int64_t)UINT32_MAX));
+		}
+	}
+
+	int64_t total_us = interval_us(record, SAMPLE_TRACE_CAPTURE, SAMPLE_TRACE_PUBLISH_COMPLETE);
+	if (total_us >= 0) {
+		metrics::observe_us(METRIC_TRACE_END_TO_END, (uint32_t)MIN(total_us, (int64_t)UINT32_MAX));
+	}
+
+#if defined(USER_CONFIG_SAMPLE_TRACE_STREAM) || defined(USER_CONFIG_SOAK_SAMPLE_RATE_HZ)
+	LOG_INF("{\"trace\":%u,\"build_us\":%d,\"serialize_us\":%d,\"queue_us\":%d,\"dispatch_us\":%d,"
+		"\"publish_us\":%d,\"total_us\":%d}",
+		record.id, (int)interval_us(record, SAMPLE_TRACE_CAPTURE, SAMPLE_TRACE_SERIALIZE),
+		(int)interval_us(record, SAMPLE_TRACE_SERIALIZE, SAMPLE_TRACE_ENQUEUE),
+		(int)interval_us(record, SAMPLE_TRACE_ENQUEUE, SAMPLE_TRACE_DEQUEUE),
+		(int)interval_us(record, SAMPLE_TRACE_DEQUEUE, SAMPLE_TRACE_PUBLISH_START),
+		(int)interval_us(record, SAMPLE_TRACE_PUBLISH_START, SAMPLE_TRACE_PUBLISH_COMPLETE), (int)total_us);
+#endif
+}
@@ -0,0 +1,51 @@
+/*******************************************************************************************************
+ * Copyright (c) 2021 Government Technology Agency of Singapore (GovTech)
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied.
+ *
+ * See the License for the specific language governing permissions and limitations under the License.
+ *******************************************************************************************************/
+#ifndef _SAMPLE_TRACE_H_
+#define _SAMPLE_TRACE_H_
+
+#include <zephyr.h>
+
+/*
+ * End-to-end tracing of sensor samples. Each sample carries a record with a trace id and monotonic
+ * timestamps of every stage from capture to the MQTT write; finished records are aggregated into the
+ * trace_* histograms of diagnostics/metrics and, if USER_CONFIG_SAMPLE_TRACE_STREAM (or soak testing)
+ * is enabled, logged one line per sample.
+ */
+
+enum sample_trace_stage {
+	SAMPLE_TRACE_CAPTURE,
+	SAMPLE_TRACE_SERIALIZE,
+	SAMPLE_TRACE_ENQUEUE,
+	SAMPLE_TRACE_DEQUEUE,
+	SAMPLE_TRACE_PUBLISH_START,
+	SAMPLE_TRACE_PUBLISH_COMPLETE,
+	SAMPLE_TRACE_STAGE_COUNT
+};
+
+struct sample_trace_record {
+	uint32_t id;
+	/* Uptime in ticks when each stage was reached, or 0 if it was not */
+	int64_t ticks[SAMPLE_TRACE_STAGE_COUNT];
+};
+
+namespace sample_trace
+{
+void begin(sample_trace_record& record);
+void mark(sample_trace_record& record, sample_trace_stage stage);
+void finish(const sample_trace_record& record);
+} // namespace sample_trace
+
+#endif // _SAMPLE_TRACE_H_
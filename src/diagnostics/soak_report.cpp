@@ -0,0 +1,23 @@
+#include <logging/log.h>
+LOG_MODULE_REGISTER(soak_report, LOG_LEVEL_DBG);
+
+#include <malloc.h>
+#include "metrics.h"
+#include "soak_report.h"
+
+/**
+ * @brief	Log counters, queue depth and heap usage as a single SOAK line.
+ * @author	Lee Tze Han
+ * @note	Heap usage is read from the C library allocator (mallinfo), which also serves operator new
+ */
+void soak_report::log(void)
+{
+	struct mallinfo heap = mallinfo();
+	metric_gauge_snapshot queue = metrics::get_gauge(METRIC_QUEUE_DEPTH);
+
+	LOG_INF("SOAK {\"uptime_ms\":%u,\"generated\":%u,\"published\":%u,\"publish_failures\":%u,"
+		"\"mqtt_reconnects\":%u,\"queue_depth\":%d,\"queue_peak\":%d,\"heap_used\":%u}",
+		(uint32_t)k_uptime_get(), metrics::get_counter(METRIC_SAMPLES_GENERATED),
+		metrics::get_counter(METRIC_SAMPLES_PUBLISHED), metrics::get_counter(METRIC_PUBLISH_FAILURES),
+		metrics::get_counter(METRIC_MQTT_RECONNECTS), queue.value, queue.peak, (uint32_t)heap.uordblks);
+}
@@ -0,0 +1,31 @@
+/*******************************************************************************************************
+ * Copyright (c) 2021 Government Technology Agency of Singapore (GovTech)
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied.
+ *
+ * See the License for the specific language governing permissions and limitations under the License.
+ *******************************************************************************************************/
+#ifndef _SOAK_REPORT_H_
+#define _SOAK_REPORT_H_
+
+#include <zephyr.h>
+
+/*
+ * Periodic single-line summary for long-running soak tests (see tools/soak). Lines are logged as
+ * "SOAK {json}" so that the host can follow throughput, queue and heap trends over hours.
+ */
+
+namespace soak_report
+{
+void log(void);
+} // namespace soak_report
+
+#endif // _SOAK_REPORT_H_
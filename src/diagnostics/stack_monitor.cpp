@@ -0,0 +1,193 @@
+#include <logging/log.h>
+LOG_MODULE_REGISTER(stack_monitor, LOG_LEVEL_DBG);
+
+#include "ArduinoJson.hpp"
+#include <stdio.h>
+#include <string.h>
+#include "device_uuid/device_uuid.h"
+#include "stack_monitor.h"
+
+/* Usage above this share of the stack is flagged in the log report */
+#define STACK_MONITOR_WARN_PCT (90)
+
+static stack_usage_record records[STACK_MONITOR_MAX_THREADS];
+static int record_count = 0;
+K_MUTEX_DEFINE(records_mutex);
+
+static struct k_delayed_work sample_work;
+static uint32_t sample_period_ms;
+
+/**
+ * @brief	Record the stack usage of a thread.
+ * @author	Lee Tze Han
+ * @param	thread		Thread to sample
+ * @param	user_data	Unused
+ * @note	Scans the unused part of the stack, so cost grows with the stack size
+ */
+static void sample_thread(const struct k_thread* thread, void* user_data)
+{
+	ARG_UNUSED(user_data);
+
+	struct k_thread* target = const_cast<struct k_thread*>(thread);
+
+	size_t unused;
+	if (k_thread_stack_space_get(target, &unused) != 0) {
+		return;
+	}
+
+	size_t size = thread->stack_info.size;
+	size_t used = size - unused;
+
+	char name[CONFIG_THREAD_MAX_NAME_LEN];
+	const char* thread_name = k_thread_name_get(target);
+	if (thread_name && thread_name[0] != '\0') {
+		strncpy(name, thread_name, sizeof(name) - 1);
+		name[sizeof(name) - 1] = '\0';
+	}
+	else {
+		snprintf(name, sizeof(name), "%p", thread);
+	}
+
+	k_mutex_lock(&records_mutex, K_FOREVER);
+	stack_usage_record* record = NULL;
+	for (int i = 0; i < record_count; i++) {
+		/* Several threads may share a name (e.g. boot workers); keep the worst of them */
+		if (strcmp(records[i].name, name) == 0) {
+			record = &records[i];
+			break;
+		}
+	}
+
+	if (!record && record_count < STACK_MONITOR_MAX_THREADS) {
+		record = &records[record_count++];
+		memcpy(record->name, name, sizeof(record->name));
+		record->peak_used = 0;
+	}
+
+	if (record) {
+		record->size = size;
+		record->peak_used = MAX(record->peak_used, used);
+	}
+	k_mutex_unlock(&records_mutex);
+}
+
+/**
+ * @brief	Sample all threads and schedule the next sample.
+ * @author	Lee Tze Han
+ * @param	work_item	Unused
+ */
+static void sample_periodically(struct k_work* work_item)
+{
+	ARG_UNUSED(work_item);
+
+	stack_monitor::sample();
+
+	k_delayed_work_submit(&sample_work, K_MSEC(sample_period_ms));
+}
+
+/**
+ * @brief	Start sampling stack usage periodically.
+ * @author	Lee Tze Han
+ * @param	period_ms	Time between samples
+ * @note	Samples are taken on the system workqueue
+ */
+void stack_monitor::start(uint32_t period_ms)
+{
+	sample_period_ms = period_ms;
+
+	k_delayed_work_init(&sample_work, sample_periodically);
+	k_delayed_work_submit(&sample_work, K_NO_WAIT);
+}
+
+/**
+ * @brief	Sample stack usage of all threads now.
+ * @author	Lee Tze Han
+ * @details	Threads are visited without holding the scheduler lock, so stacks can be scanned with
+ * 		interrupts enabled
+ */
+void stack_monitor::sample(void)
+{
+	k_thread_foreach_unlocked(sample_thread, NULL);
+}
+
+/**
+ * @brief	Get number of threads recorded.
+ * @author	Lee Tze Han
+ * @return	Number of records; indices range from 0 to count - 1
+ */
+int stack_monitor::get_record_count(void)
+{
+	k_mutex_lock(&records_mutex, K_FOREVER);
+	int count = record_count;
+	k_mutex_unlock(&records_mutex);
+
+	return count;
+}
+
+/**
+ * @brief	Get the stack usage of a thread.
+ * @author	Lee Tze Han
+ * @param	index	Index of the record
+ * @return	stack_usage_record struct
+ */
+stack_usage_record stack_monitor::get_record(int index)
+{
+	stack_usage_record record = {};
+
+	k_mutex_lock(&records_mutex, K_FOREVER);
+	if (index >= 0 && index < record_count) {
+		record = records[index];
+	}
+	k_mutex_unlock(&records_mutex);
+
+	return record;
+}
+
+/**
+ * @brief	Log the peak stack usage of every thread.
+ * @author	Lee Tze Han
+ */
+void stack_monitor::log_report(void)
+{
+	for (int i = 0; i < get_record_count(); i++) {
+		stack_usage_record record = get_record(i);
+		unsigned int pct = record.size > 0 ? (record.peak_used * 100) / record.size : 0;
+
+		if (pct >= STACK_MONITOR_WARN_PCT) {
+			LOG_WRN("%-24s %5u / %5u bytes (%u%%)", log_strdup(record.name), (unsigned int)record.peak_used,
+				(unsigned int)record.size, pct);
+		}
+		else {
+			LOG_INF("%-24s %5u / %5u bytes (%u%%)", log_strdup(record.name), (unsigned int)record.peak_used,
+				(unsigned int)record.size, pct);
+		}
+	}
+}
+
+/**
+ * @brief	Format the peak stack usage as a DECADA event.
+ * @author	Lee Tze Han
+ * @return	JSON string with the stack size and peak usage of every thread
+ */
+std::string stack_monitor::get_report_json(void)
+{
+	ArduinoJson::DynamicJsonDocument json(2048);
+	json["id"] = device_uuid;
+	json["version"] = "1.0";
+	json["method"] = "thing.event.stack_usage.post";
+
+	ArduinoJson::JsonObject params = json.createNestedObject("params");
+	for (int i = 0; i < get_record_count(); i++) {
+		stack_usage_record record = get_record(i);
+
+		/* Names are copied as the records may change after this function returns */
+		ArduinoJson::JsonObject entry = params.createNestedObject(std::string(record.name));
+		entry["size"] = record.size;
+		entry["peak_used"] = record.peak_used;
+	}
+
+	std::string json_body;
+	ArduinoJson::serializeJson(json, json_body);
+
+	return json_body;
+}
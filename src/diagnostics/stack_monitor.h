@@ -0,0 +1,51 @@
+/*******************************************************************************************************
+ * Copyright (c) 2021 Government Technology Agency of Singapore (GovTech)
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied.
+ *
+ * See the License for the specific language governing permissions and limitations under the License.
+ *******************************************************************************************************/
+#ifndef _STACK_MONITOR_H_
+#define _STACK_MONITOR_H_
+
+#include <string>
+#include <zephyr.h>
+
+/*
+ * Peak stack usage of every thread (application threads, system workqueue running the MQTT loop,
+ * boot workers, idle...), sampled periodically and kept by thread name so that threads which have
+ * exited are still reported. Requires CONFIG_THREAD_STACK_INFO, CONFIG_INIT_STACKS and
+ * CONFIG_THREAD_MONITOR.
+ */
+
+#define STACK_MONITOR_MAX_THREADS (16)
+
+struct stack_usage_record {
+	char name[CONFIG_THREAD_MAX_NAME_LEN];
+	/* Stack size in bytes */
+	size_t size;
+	/* Highest number of bytes found in use */
+	size_t peak_used;
+};
+
+namespace stack_monitor
+{
+void start(uint32_t period_ms);
+void sample(void);
+
+int get_record_count(void);
+stack_usage_record get_record(int index);
+
+void log_report(void);
+std::string get_report_json(void);
+} // namespace stack_monitor
+
+#endif // _STACK_MONITOR_H_
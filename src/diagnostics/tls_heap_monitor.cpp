@@ -0,0 +1,137 @@
+#include <logging/log.h>
+LOG_MODULE_REGISTER(tls_heap_monitor, LOG_LEVEL_DBG);
+
+#include <mbedtls/memory_buffer_alloc.h>
+#include "tls_heap_monitor.h"
+
+#if defined(CONFIG_MBEDTLS_ENABLE_HEAP) && defined(MBEDTLS_MEMORY_DEBUG)
+#define TLS_HEAP_STATS_AVAILABLE 1
+#else
+#define TLS_HEAP_STATS_AVAILABLE 0
+#endif
+
+static const char* phase_names[TLS_HEAP_PHASE_COUNT] = {
+	"HTTPS handshake",
+	"MQTT handshake",
+	"Key generation",
+	"CSR write",
+};
+
+static tls_heap_stats phase_stats[TLS_HEAP_PHASE_COUNT];
+static struct k_spinlock stats_lock;
+
+/**
+ * @brief	Mark the start of a phase.
+ * @author	Lee Tze Han
+ * @param	phase	Phase being started
+ * @note	The peak is tracked by mbedTLS globally, so overlapping phases in other threads
+ * 		are attributed to whichever phase ends first.
+ */
+void tls_heap_monitor::begin_phase(tls_heap_phase phase)
+{
+	ARG_UNUSED(phase);
+
+#if TLS_HEAP_STATS_AVAILABLE
+	mbedtls_memory_buffer_alloc_max_reset();
+#endif
+}
+
+/**
+ * @brief	Mark the end of a phase and record its statistics.
+ * @author	Lee Tze Han
+ * @param	phase	Phase being ended
+ */
+void tls_heap_monitor::end_phase(tls_heap_phase phase)
+{
+	tls_heap_stats stats = get_current_stats();
+
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+	tls_heap_stats& recorded = phase_stats[phase];
+	recorded.current = stats.current;
+	recorded.blocks = stats.blocks;
+	recorded.peak = MAX(recorded.peak, stats.peak);
+	recorded.samples++;
+	k_spin_unlock(&stats_lock, key);
+
+	LOG_INF("%s: peak %u/%u B, current %u B in %u blocks", phase_names[phase], stats.peak, get_capacity(),
+		stats.current, stats.blocks);
+}
+
+/**
+ * @brief	Sample current usage of the mbedTLS heap.
+ * @author	Lee Tze Han
+ * @return	tls_heap_stats struct with peak since the last phase started
+ */
+tls_heap_stats tls_heap_monitor::get_current_stats(void)
+{
+	tls_heap_stats stats = {};
+
+#if TLS_HEAP_STATS_AVAILABLE
+	size_t max_blocks;
+	mbedtls_memory_buffer_alloc_cur_get(&stats.current, &stats.blocks);
+	mbedtls_memory_buffer_alloc_max_get(&stats.peak, &max_blocks);
+#endif
+
+	return stats;
+}
+
+/**
+ * @brief	Get statistics recorded for a phase.
+ * @author	Lee Tze Han
+ * @param	phase	Phase of interest
+ * @return	tls_heap_stats struct with peak over all recordings and other values from the last recording
+ */
+tls_heap_stats tls_heap_monitor::get_phase_stats(tls_heap_phase phase)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+	tls_heap_stats stats = phase_stats[phase];
+	k_spin_unlock(&stats_lock, key);
+
+	return stats;
+}
+
+/**
+ * @brief	Get size of the mbedTLS heap.
+ * @author	Lee Tze Han
+ * @return	Heap size in bytes
+ */
+size_t tls_heap_monitor::get_capacity(void)
+{
+#if defined(CONFIG_MBEDTLS_ENABLE_HEAP)
+	return CONFIG_MBEDTLS_HEAP_SIZE;
+#else
+	return 0;
+#endif
+}
+
+/**
+ * @brief	Get printable name of a phase.
+ * @author	Lee Tze Han
+ * @param	phase	Phase of interest
+ * @return	Null-terminated phase name
+ */
+const char* tls_heap_monitor::get_phase_name(tls_heap_phase phase)
+{
+	return phase_names[phase];
+}
+
+/**
+ * @brief	Log statistics of all phases recorded so far.
+ * @author	Lee Tze Han
+ */
+void tls_heap_monitor::log_report(void)
+{
+	size_t overall_peak = 0;
+
+	for (int i = 0; i < TLS_HEAP_PHASE_COUNT; i++) {
+		tls_heap_stats stats = get_phase_stats((tls_heap_phase)i);
+		if (stats.samples == 0) {
+			continue;
+		}
+
+		LOG_INF("%s: peak %u B over %u samples", phase_names[i], stats.peak, stats.samples);
+		overall_peak = MAX(overall_peak, stats.peak);
+	}
+
+	LOG_INF("mbedTLS heap peak %u/%u B", overall_peak, get_capacity());
+}
@@ -0,0 +1,64 @@
+/*******************************************************************************************************
+ * Copyright (c) 2021 Government Technology Agency of Singapore (GovTech)
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied.
+ *
+ * See the License for the specific language governing permissions and limitations under the License.
+ *******************************************************************************************************/
+#ifndef _TLS_HEAP_MONITOR_H_
+#define _TLS_HEAP_MONITOR_H_
+
+#include <zephyr.h>
+
+/*
+ * Usage statistics of the mbedTLS heap (CONFIG_MBEDTLS_HEAP_SIZE), recorded separately
+ * for each phase of TLS and key handling. Requires MBEDTLS_MEMORY_DEBUG; all values
+ * read as zero otherwise. Statistics are only read from the allocator's counters, so the
+ * heap is never allocated from here. Key generation for certificate renewal runs on its
+ * own thread, so its phase may overlap a handshake and share its peak.
+ */
+
+enum tls_heap_phase {
+	TLS_HEAP_PHASE_HTTPS_HANDSHAKE,
+	TLS_HEAP_PHASE_MQTT_HANDSHAKE,
+	TLS_HEAP_PHASE_KEY_GENERATION,
+	TLS_HEAP_PHASE_CSR_WRITE,
+	TLS_HEAP_PHASE_COUNT
+};
+
+struct tls_heap_stats {
+	/* Bytes allocated when sampled */
+	size_t current;
+	/* Highest number of bytes allocated */
+	size_t peak;
+	/*
+	 * Number of blocks allocated when sampled. memory_buffer_alloc does not expose its free list, so
+	 * this is the only fragmentation figure: free memory is split into at most blocks + 1 regions.
+	 */
+	size_t blocks;
+	/* Number of times the phase was recorded */
+	uint32_t samples;
+};
+
+namespace tls_heap_monitor
+{
+void begin_phase(tls_heap_phase phase);
+void end_phase(tls_heap_phase phase);
+
+tls_heap_stats get_current_stats(void);
+tls_heap_stats get_phase_stats(tls_heap_phase phase);
+size_t get_capacity(void);
+const char* get_phase_name(tls_heap_phase phase);
+
+void log_report(void);
+} // namespace tls_heap_monitor
+
+#endif // _TLS_HEAP_MONITOR_H_
@@ -0,0 +1,36 @@
+#include "log_ratelimit.h"
+
+/**
+ * @brief	Check if a rate-limited message may be logged
+ * @author	Lee Tze Han
+ * @param	limit		Limit shared by the statements of a module
+ * @param	suppressed	Set to the number of messages dropped since the last one allowed
+ * @return	True if the message should be logged
+ * @details	Up to burst messages are allowed in each period_ms window, starting from the first message.
+ */
+bool log_ratelimit::allow(struct log_ratelimit_state* limit, uint32_t* suppressed)
+{
+	int64_t now = k_uptime_get();
+	bool allowed = false;
+
+	*suppressed = 0;
+
+	k_spinlock_key_t key = k_spin_lock(&limit->lock);
+	if (limit->count == 0 || now - limit->window_start_ms >= limit->period_ms) {
+		limit->window_start_ms = now;
+		limit->count = 0;
+	}
+
+	if (limit->count < limit->burst) {
+		limit->count++;
+		*suppressed = limit->suppressed;
+		limit->suppressed = 0;
+		allowed = true;
+	}
+	else {
+		limit->suppressed++;
+	}
+	k_spin_unlock(&limit->lock, key);
+
+	return allowed;
+}
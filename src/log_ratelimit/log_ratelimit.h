@@ -0,0 +1,66 @@
+/*******************************************************************************************************
+ * Copyright (c) 2021 Government Technology Agency of Singapore (GovTech)
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied.
+ *
+ * See the License for the specific language governing permissions and limitations under the License.
+ *******************************************************************************************************/
+#ifndef _LOG_RATELIMIT_H_
+#define _LOG_RATELIMIT_H_
+
+#include <logging/log.h>
+#include <zephyr.h>
+#include "user_config.h"
+
+/*
+ * Per-module rate limiting for log statements on hot paths. A module registers one limit after
+ * LOG_MODULE_REGISTER; all of its LOG_*_RATELIMIT statements share it, allowing up to
+ * USER_CONFIG_LOG_RATELIMIT_BURST messages every USER_CONFIG_LOG_RATELIMIT_PERIOD_MS. The number of
+ * messages dropped is logged with the next message let through. Statements above the module or
+ * CONFIG_LOG_MAX_LEVEL level are compiled out, as with the plain LOG_* macros.
+ */
+
+struct log_ratelimit_state {
+	/* Messages allowed in each window of period_ms */
+	uint32_t burst;
+	uint32_t period_ms;
+	struct k_spinlock lock;
+	int64_t window_start_ms;
+	uint32_t count;
+	uint32_t suppressed;
+};
+
+namespace log_ratelimit
+{
+bool allow(struct log_ratelimit_state* limit, uint32_t* suppressed);
+} // namespace log_ratelimit
+
+#define LOG_RATELIMIT_REGISTER()                                                                                       \
+	static struct log_ratelimit_state log_ratelimit_module = { USER_CONFIG_LOG_RATELIMIT_BURST,                    \
+								   USER_CONFIG_LOG_RATELIMIT_PERIOD_MS }
+
+#define Z_LOG_RATELIMIT(_level, _log, ...)                                                                             \
+	do {                                                                                                           \
+		uint32_t _suppressed;                                                                                  \
+		if (Z_LOG_CONST_LEVEL_CHECK(_level) && log_ratelimit::allow(&log_ratelimit_module, &_suppressed)) {    \
+			if (_suppressed > 0) {                                                                         \
+				_log("%u messages suppressed", _suppressed);                                           \
+			}                                                                                              \
+			_log(__VA_ARGS__);                                                                             \
+		}                                                                                                      \
+	} while (0)
+
+#define LOG_ERR_RATELIMIT(...) Z_LOG_RATELIMIT(LOG_LEVEL_ERR, LOG_ERR, __VA_ARGS__)
+#define LOG_WRN_RATELIMIT(...) Z_LOG_RATELIMIT(LOG_LEVEL_WRN, LOG_WRN, __VA_ARGS__)
+#define LOG_INF_RATELIMIT(...) Z_LOG_RATELIMIT(LOG_LEVEL_INF, LOG_INF, __VA_ARGS__)
+#define LOG_DBG_RATELIMIT(...) Z_LOG_RATELIMIT(LOG_LEVEL_DBG, LOG_DBG, __VA_ARGS__)
+
+#endif // _LOG_RATELIMIT_H_
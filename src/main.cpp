@@ -6,22 +6,49 @@ LOG_MODULE_REGISTER(main, LOG_LEVEL_DBG);
 #include <devicetree.h>
 #include <drivers/gpio.h>
 #include "device_uuid/device_uuid.h"
+#include "diagnostics/boot_profiler.h"
+#include "diagnostics/cpu_profiler.h"
+#include "diagnostics/stack_monitor.h"
 #include "threads/threads.h"
+#include "watchdog_config/task_watchdog.h"
 #include "watchdog_config/watchdog_config.h"
 
 #define PIN_THREADS (IS_ENABLED(CONFIG_SMP) && IS_ENABLED(CONFIG_SCHED_CPU_MASK) && (CONFIG_MP_NUM_CPUS > 1))
 #define STACK_SIZE  4096
 #define PRIORITY    7
 
+/* Release builds rely on zephyr/release.conf to compile out debug statements */
+#if defined(RELEASE) && (CONFIG_LOG_MAX_LEVEL > LOG_LEVEL_INF)
+#warning "Debug logging is enabled in a release build - configure with -DRELEASE=ON to apply release.conf"
+#endif
+
+/* Longest time each thread may go without checking in; both check in at least every THREAD_CHECK_IN_PERIOD_MS */
+#define COMMUNICATIONS_WDT_DEADLINE_MS   (30 * MSEC_PER_SEC)
+#define BEHAVIOR_MANAGER_WDT_DEADLINE_MS (30 * MSEC_PER_SEC)
+/*
+ * Longest time to the first check-in. The communications thread checks in while its boot stages are
+ * within their timeouts; the behavior manager first checks in after the DECADA connection is up.
+ */
+#define COMMUNICATIONS_WDT_BOOT_DEADLINE_MS   (COMMUNICATIONS_WDT_DEADLINE_MS)
+#define BEHAVIOR_MANAGER_WDT_BOOT_DEADLINE_MS (5 * 60 * MSEC_PER_SEC)
+
 /* decada-embedded-example-zephyr Software Version */
 const std::string sdk_sw_verion = "R1.0.0";
 
 /* Initialize global device UUID */
 const std::string device_uuid = read_device_uuid();
 
+/* Peak usage is reported by stack_monitor; size stacks from field reports rather than guesses */
+#define COMMUNICATIONS_STACK_SIZE   (STACK_SIZE * 8)
+#define BEHAVIOR_MANAGER_STACK_SIZE (STACK_SIZE)
+#define STACK_SAMPLE_PERIOD_MS      (10 * MSEC_PER_SEC)
+
+/* CPU shares are reported per period and over a sliding window of CPU_PROFILER_WINDOW_SLOTS periods */
+#define CPU_PROFILE_PERIOD_MS (10 * MSEC_PER_SEC)
+
 /* Thread Configurations */
-K_THREAD_STACK_DEFINE(communications_thread_stack_area, STACK_SIZE * 8);
-K_THREAD_STACK_DEFINE(behavior_manager_thread_stack_area, STACK_SIZE);
+K_THREAD_STACK_DEFINE(communications_thread_stack_area, COMMUNICATIONS_STACK_SIZE);
+K_THREAD_STACK_DEFINE(behavior_manager_thread_stack_area, BEHAVIOR_MANAGER_STACK_SIZE);
 static struct k_thread communications_thread_data;
 static struct k_thread behavior_manager_thread_data;
 struct k_mbox data_mailbox;
@@ -31,7 +58,7 @@ void behavior_manager_thread(void* watchdog_id, void* dummy1, void* dummy2)
 	ARG_UNUSED(dummy1);
 	ARG_UNUSED(dummy2);
 
-	execute_behavior_manager_thread(*(int*)watchdog_id);
+	execute_behavior_manager_thread(POINTER_TO_INT(watchdog_id));
 }
 
 void communications_thread(void* watchdog_id, void* dummy1, void* dummy2)
@@ -39,22 +66,31 @@ void communications_thread(void* watchdog_id, void* dummy1, void* dummy2)
 	ARG_UNUSED(dummy1);
 	ARG_UNUSED(dummy2);
 
-	execute_communications_thread(*(int*)watchdog_id);
+	execute_communications_thread(POINTER_TO_INT(watchdog_id));
 }
 
 void main(void)
 {
 	/* Initialization of Watchdog components for single-channel mcu */
+	boot_profiler::begin(BOOT_PROFILE_WATCHDOG_SETUP);
 	wdt_timeout_cfg wdt_config = wdt_timeout_cfg();
 	watchdog_config::set_watchdog_config(wdt_config);
 	int wdt_channel_id = watchdog_config::add_watchdog(wdt_config);
 	watchdog_config::start_watchdog();
+
+	/* Threads check in with the task watchdog, which feeds the hardware channel on their behalf */
+	task_watchdog::start(wdt_channel_id);
+	int communications_wdt_id = task_watchdog::register_task("communications", COMMUNICATIONS_WDT_DEADLINE_MS,
+								 COMMUNICATIONS_WDT_BOOT_DEADLINE_MS);
+	int behavior_manager_wdt_id = task_watchdog::register_task("behavior_manager", BEHAVIOR_MANAGER_WDT_DEADLINE_MS,
+								   BEHAVIOR_MANAGER_WDT_BOOT_DEADLINE_MS);
+	boot_profiler::end(BOOT_PROFILE_WATCHDOG_SETUP);
 	k_mbox_init(&data_mailbox);
 
 	/* Spawn communications_thread */
 	k_thread_create(&communications_thread_data, communications_thread_stack_area,
 			K_THREAD_STACK_SIZEOF(communications_thread_stack_area), communications_thread,
-			(int*)wdt_channel_id, NULL, NULL, PRIORITY, 0, K_NO_WAIT);
+			INT_TO_POINTER(communications_wdt_id), NULL, NULL, PRIORITY, 0, K_NO_WAIT);
 	k_thread_name_set(&communications_thread_data, "communications_thread");
 #if PIN_THREADS
 	k_thread_cpu_mask_clear(&communications_thread_data);
@@ -64,7 +100,7 @@ void main(void)
 	/* Spawn behavior_manager_thread */
 	k_thread_create(&behavior_manager_thread_data, behavior_manager_thread_stack_area,
 			K_THREAD_STACK_SIZEOF(behavior_manager_thread_stack_area), behavior_manager_thread,
-			(int*)wdt_channel_id, NULL, NULL, PRIORITY, 0, K_NO_WAIT);
+			INT_TO_POINTER(behavior_manager_wdt_id), NULL, NULL, PRIORITY, 0, K_NO_WAIT);
 	k_thread_name_set(&behavior_manager_thread_data, "behavior_manager_thread");
 #if PIN_THREADS
 	k_thread_cpu_mask_clear(&behavior_manager_thread_data);
@@ -75,5 +111,8 @@ void main(void)
 	k_thread_start(&communications_thread_data);
 	k_thread_start(&behavior_manager_thread_data);
 
+	stack_monitor::start(STACK_SAMPLE_PERIOD_MS);
+	cpu_profiler::start(CPU_PROFILE_PERIOD_MS);
+
 	k_sleep(K_FOREVER);
 }
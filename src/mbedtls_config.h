@@ -29,4 +29,26 @@
 #define MBEDTLS_X509_CSR_WRITE_C
 #define MBEDTLS_PEM_WRITE_C
 
-#define MBEDTLS_DEBUG_C
\ No newline at end of file
+// Size incoming and outgoing record buffers independently (see user_config.h)
+#define MBEDTLS_SSL_IN_CONTENT_LEN USER_CONFIG_TLS_IN_CONTENT_LEN
+#define MBEDTLS_SSL_OUT_CONTENT_LEN USER_CONFIG_TLS_OUT_CONTENT_LEN
+
+// Enable the max_fragment_length extension; TLS sockets request CONFIG_MBEDTLS_SSL_MAX_CONTENT_LEN, capped at 4096
+#define MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
+
+// mbedtls_ssl_conf_max_frag_len rejects lengths larger than either record buffer, which fails every TLS socket
+#define TLS_REQUESTED_FRAGMENT_LEN \
+	((CONFIG_MBEDTLS_SSL_MAX_CONTENT_LEN) < 4096 ? (CONFIG_MBEDTLS_SSL_MAX_CONTENT_LEN) : 4096)
+#if (USER_CONFIG_TLS_IN_CONTENT_LEN) < TLS_REQUESTED_FRAGMENT_LEN || \
+	(USER_CONFIG_TLS_OUT_CONTENT_LEN) < TLS_REQUESTED_FRAGMENT_LEN
+#error "TLS record buffers in user_config.h must hold the max_fragment_length requested by Zephyr's TLS sockets"
+#endif
+
+#define MBEDTLS_DEBUG_C
+
+// Track current and peak usage of the mbedTLS heap (see diagnostics/tls_heap_monitor.h)
+#define MBEDTLS_MEMORY_DEBUG
+
+// Lock the mbedTLS heap with Zephyr mutexes so keypairs can be generated on another thread (see threading_alt.h)
+#define MBEDTLS_THREADING_C
+#define MBEDTLS_THREADING_ALT
@@ -1,24 +1,151 @@
 #include <logging/log.h>
 LOG_MODULE_REGISTER(dns_lookup, LOG_LEVEL_DBG);
 
+#include <memory>
 #include <net/socket.h>
+#include "diagnostics/alloc_profiler.h"
 #include "dns_lookup.h"
+#include "networking/fault/net_fault.h"
 
 #define DNS_TIMEOUT	 (4 * MSEC_PER_SEC)
 #define DNS_MAX_ATTEMPTS (3)
 
+/* Prefetched addresses; the resolver does not report record TTLs, so entries expire after a fixed period */
+#define DNS_PREFETCH_SLOTS  (4)
+#define DNS_PREFETCH_TTL_MS (5 * 60 * MSEC_PER_SEC)
+
+struct dns_prefetch_entry {
+	std::string domain_name;
+	struct dns_addrinfo addrinfo;
+	int64_t expiry_ms;
+};
+
+static struct dns_prefetch_entry dns_prefetched[DNS_PREFETCH_SLOTS];
+K_MUTEX_DEFINE(dns_prefetch_mutex);
+
 void dns_result_cb(enum dns_resolve_status status, struct dns_addrinfo* info, void* user_data);
 
+/**
+ * @brief	Take a prefetched address for a hostname
+ * @author	Lee Tze Han
+ * @param	domain_name	Hostname to look up
+ * @param	addrinfo	Filled with the prefetched address if found
+ * @return	True if an unexpired prefetched address was found
+ * @note	Entries are used once, so later lookups (e.g. on reconnection) query the resolver again
+ */
+static bool take_prefetched(const std::string& domain_name, struct dns_addrinfo* addrinfo)
+{
+	bool found = false;
+
+	k_mutex_lock(&dns_prefetch_mutex, K_FOREVER);
+	for (auto& entry : dns_prefetched) {
+		if (entry.domain_name != domain_name) {
+			continue;
+		}
+
+		if (entry.expiry_ms > k_uptime_get()) {
+			*addrinfo = entry.addrinfo;
+			found = true;
+		}
+		entry.domain_name.clear();
+		break;
+	}
+	k_mutex_unlock(&dns_prefetch_mutex);
+
+	return found;
+}
+
+/**
+ * @brief	Store a prefetched address, replacing the oldest entry if all slots are taken
+ * @author	Lee Tze Han
+ * @param	domain_name	Resolved hostname
+ * @param	addrinfo	Resolved address
+ */
+static void store_prefetched(const std::string& domain_name, const struct dns_addrinfo& addrinfo)
+{
+	k_mutex_lock(&dns_prefetch_mutex, K_FOREVER);
+	struct dns_prefetch_entry* slot = &dns_prefetched[0];
+	for (auto& entry : dns_prefetched) {
+		if (entry.domain_name == domain_name || entry.domain_name.empty()) {
+			slot = &entry;
+			break;
+		}
+		if (entry.expiry_ms < slot->expiry_ms) {
+			slot = &entry;
+		}
+	}
+
+	slot->domain_name = domain_name;
+	slot->addrinfo = addrinfo;
+	slot->expiry_ms = k_uptime_get() + DNS_PREFETCH_TTL_MS;
+	k_mutex_unlock(&dns_prefetch_mutex);
+}
+
 DnsLookup::DnsLookup(const std::string& domain_name) : query_(domain_name)
 {
+	AllocScope alloc_scope(ALLOC_MODULE_DNS);
+
 	/* Setup signal and events */
 	k_poll_signal_init(&resolved_signal_);
 	resolved_events_[0] = K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &resolved_signal_);
 
+	if (take_prefetched(query_, &resolved_addrinfo_)) {
+		LOG_DBG("Using prefetched address for %s", log_strdup(query_.c_str()));
+		k_poll_signal_raise(&resolved_signal_, 0);
+		return;
+	}
+
 	/* IPv4 query */
+	query_timer_ = metrics::start_timer();
 	dns_ipv4_lookup();
 }
 
+DnsLookup::~DnsLookup(void)
+{
+	/* An outstanding query would otherwise invoke the callback on a destroyed object */
+	cancelled_ = true;
+	if (query_active_) {
+		dns_cancel_addr_info(dns_id_);
+	}
+}
+
+/**
+ * @brief	Resolve hostnames ahead of their first use
+ * @author	Lee Tze Han
+ * @param	domain_names	Hostnames to resolve
+ * @details	Queries run concurrently. Resolved addresses are picked up by the next DnsLookup for the
+ * 		same hostname, so connections made shortly afterwards do not wait on the resolver.
+ */
+void DnsLookup::prefetch(const std::vector<std::string>& domain_names)
+{
+	AllocScope alloc_scope(ALLOC_MODULE_DNS);
+
+	std::vector<std::unique_ptr<DnsLookup>> lookups;
+	for (const auto& domain_name : domain_names) {
+		lookups.emplace_back(new DnsLookup(domain_name));
+	}
+
+	for (const auto& lookup : lookups) {
+		if (lookup->wait_resolved(K_MSEC(DNS_TIMEOUT * DNS_MAX_ATTEMPTS))) {
+			store_prefetched(lookup->query_, lookup->resolved_addrinfo_);
+		}
+		else {
+			LOG_WRN("Failed to prefetch address for %s", log_strdup(lookup->query_.c_str()));
+		}
+	}
+}
+
+/**
+ * @brief	Wait for the query to complete
+ * @author	Lee Tze Han
+ * @param	timeout	Maximum time to wait for the query
+ * @return	True if the hostname was resolved within the timeout
+ */
+bool DnsLookup::wait_resolved(k_timeout_t timeout)
+{
+	return k_poll(resolved_events_, 1, timeout) == 0;
+}
+
 /**
  * @brief	Get the resolved socket infomration
  * @author	Lee Tze Han
@@ -35,10 +162,17 @@ struct sockaddr_in DnsLookup::get_sockaddr_in(void)
 /**
  * @brief	Get the resolved IP address string
  * @author	Lee Tze Han
- * @return	IP address string
+ * @return	IP address string, or an empty string if the hostname could not be resolved
+ * @note	Waits for at most as long as all query attempts can take, so that callers can retry later
+ * 		instead of blocking on a resolver that is unreachable
  */
 std::string DnsLookup::get_ipaddr(void)
 {
+	if (!wait_resolved(K_MSEC(DNS_TIMEOUT * DNS_MAX_ATTEMPTS))) {
+		LOG_WRN("Failed to resolve %s", log_strdup(query_.c_str()));
+		return "";
+	}
+
 	char ipaddr[INET_ADDRSTRLEN];
 	struct sockaddr_in addr = get_sockaddr_in();
 	inet_ntop(AF_INET, &addr.sin_addr, ipaddr, INET_ADDRSTRLEN);
@@ -65,6 +199,26 @@ struct k_poll_signal* DnsLookup::get_signal(void)
 void DnsLookup::set_resolved(struct dns_addrinfo info)
 {
 	resolved_addrinfo_ = info;
+	metrics::observe_since(METRIC_DNS_LOOKUP, query_timer_);
+}
+
+/**
+ * @brief	Mark the outstanding query as no longer in progress
+ * @author	Lee Tze Han
+ */
+void DnsLookup::set_query_done(void)
+{
+	query_active_ = false;
+}
+
+/**
+ * @brief	Check if the lookup has been abandoned by its owner
+ * @author	Lee Tze Han
+ * @return	True if no further queries should be issued
+ */
+bool DnsLookup::is_cancelled(void) const
+{
+	return cancelled_;
 }
 
 /**
@@ -82,20 +236,29 @@ void dns_result_cb(enum dns_resolve_status status, struct dns_addrinfo* info, vo
 
 	switch (status) {
 	case DNS_EAI_CANCELED:
+		dns_lookup->set_query_done();
+		if (dns_lookup->is_cancelled()) {
+			/* Cancelled by destructor - dns_lookup must not be used further */
+			return;
+		}
+
 		LOG_INF("DNS query was canceled");
 		/* Probably timed out */
 		dns_lookup->dns_ipv4_lookup();
 		return;
 
 	case DNS_EAI_FAIL:
+		dns_lookup->set_query_done();
 		LOG_INF("DNS resolve failed");
 		return;
 
 	case DNS_EAI_NODATA:
+		dns_lookup->set_query_done();
 		LOG_INF("Cannot resolve address");
 		return;
 
 	case DNS_EAI_ALLDONE:
+		dns_lookup->set_query_done();
 		LOG_INF("DNS resolving finished");
 		return;
 
@@ -111,6 +274,7 @@ void dns_result_cb(enum dns_resolve_status status, struct dns_addrinfo* info, vo
 		return;
 
 	default:
+		dns_lookup->set_query_done();
 		LOG_INF("DNS resolving error (%d)", status);
 		return;
 	}
@@ -129,8 +293,13 @@ void DnsLookup::dns_ipv4_lookup(void)
 		return;
 	}
 
-	int rc = dns_get_addr_info(query_.c_str(), DNS_QUERY_TYPE_A, NULL, dns_result_cb, (void*)this, DNS_TIMEOUT);
+	int rc = net_fault::apply(NET_FAULT_SITE_DNS_RESOLVE);
+	if (rc == NET_FAULT_PASS) {
+		rc = dns_get_addr_info(query_.c_str(), DNS_QUERY_TYPE_A, &dns_id_, dns_result_cb, (void*)this,
+				       DNS_TIMEOUT);
+	}
 	attempt_++;
+	query_active_ = (rc >= 0);
 
 	if (rc < 0) {
 		LOG_WRN("Failed to start DNS query: %d", rc);
@@ -142,6 +311,7 @@ void DnsLookup::dns_ipv4_lookup(void)
 		return;
 	}
 	else {
-		LOG_INF("Resolving hostname %s... (Attempt %d/%d)", query_.c_str(), attempt_, DNS_MAX_ATTEMPTS);
+		LOG_INF("Resolving hostname %s... (Attempt %d/%d)", log_strdup(query_.c_str()), attempt_,
+			DNS_MAX_ATTEMPTS);
 	}
 }
\ No newline at end of file
@@ -17,29 +17,42 @@
 #define _DNS_LOOKUP_H_
 
 #include <string>
+#include <vector>
 #include <zephyr.h>
 #include <net/dns_resolve.h>
+#include "diagnostics/metrics.h"
 
 class DnsLookup
 {
 public:
 	explicit DnsLookup(const std::string& domain_name);
+	~DnsLookup(void);
+
+	static void prefetch(const std::vector<std::string>& domain_names);
 
 	void dns_ipv4_lookup(void);
 
+	bool wait_resolved(k_timeout_t timeout);
 	struct sockaddr_in get_sockaddr_in(void);
 	std::string get_ipaddr(void);
 	struct k_poll_signal* get_signal(void);
 
 	void set_resolved(struct dns_addrinfo addrinfo);
+	void set_query_done(void);
+	bool is_cancelled(void) const;
 
 private:
 	struct k_poll_signal resolved_signal_;
 	struct k_poll_event resolved_events_[1];
 
 	int attempt_ = 0;
+	uint16_t dns_id_ = 0;
+	bool query_active_ = false;
+	bool cancelled_ = false;
 	std::string query_;
 	struct dns_addrinfo resolved_addrinfo_;
+	/* Started when the resolver is first queried; prefetched addresses are not timed */
+	metric_timer query_timer_;
 };
 
 #endif // _DNS_LOOKUP_H_
\ No newline at end of file
@@ -0,0 +1,350 @@
+#include <logging/log.h>
+LOG_MODULE_REGISTER(net_fault, LOG_LEVEL_DBG);
+
+#include <net/net_if.h>
+#include <random/rand32.h>
+#include <sys/atomic.h>
+#include "diagnostics/metrics.h"
+#include "net_fault.h"
+#include "user_config.h"
+
+/* Period at which stalled operations check whether the step has ended */
+#define NET_FAULT_STALL_POLL_MS (100)
+/*
+ * Longest time an operation is held by a stall before failing with -ETIMEDOUT, as a socket send
+ * timeout would; kept well within the task watchdog deadline of the calling thread
+ */
+#define NET_FAULT_STALL_TIMEOUT_MS (10 * MSEC_PER_SEC)
+/* Period at which the end of a step is followed up until the next successful publish */
+#define NET_FAULT_RECOVERY_POLL_MS (100)
+
+struct fault_profile {
+	const struct net_fault_step* steps;
+	size_t step_count;
+	/* Repetition period of the steps, or 0 to play them once */
+	uint32_t period_ms;
+};
+
+static const struct net_fault_step link_flap_steps[] = {
+	{ 60 * MSEC_PER_SEC, 15 * MSEC_PER_SEC, NET_FAULT_LINK_DOWN, NET_FAULT_ALL, 0 },
+};
+
+static const struct net_fault_step broker_stall_steps[] = {
+	{ 60 * MSEC_PER_SEC, 8 * MSEC_PER_SEC, NET_FAULT_STALL, NET_FAULT_MQTT, 0 },
+};
+
+static const struct net_fault_step lossy_link_steps[] = {
+	{ 60 * MSEC_PER_SEC, 120 * MSEC_PER_SEC, NET_FAULT_DROP, NET_FAULT_MQTT | NET_FAULT_HTTP, 100 },
+};
+
+static const struct net_fault_step dns_outage_steps[] = {
+	{ 60 * MSEC_PER_SEC, 20 * MSEC_PER_SEC, NET_FAULT_LINK_DOWN, NET_FAULT_ALL, 0 },
+	{ 80 * MSEC_PER_SEC, 60 * MSEC_PER_SEC, NET_FAULT_FAIL, NET_FAULT_DNS, 0 },
+};
+
+static const struct net_fault_step slow_network_steps[] = {
+	{ 60 * MSEC_PER_SEC, 120 * MSEC_PER_SEC, NET_FAULT_LATENCY, NET_FAULT_ALL, 2 * MSEC_PER_SEC },
+};
+
+/* Indexed by net_fault_profile */
+static const struct fault_profile profiles[NET_FAULT_PROFILE_COUNT] = {
+	{ NULL, 0, 0 },
+	{ link_flap_steps, ARRAY_SIZE(link_flap_steps), 5 * 60 * MSEC_PER_SEC },
+	{ broker_stall_steps, ARRAY_SIZE(broker_stall_steps), 10 * 60 * MSEC_PER_SEC },
+	{ lossy_link_steps, ARRAY_SIZE(lossy_link_steps), 10 * 60 * MSEC_PER_SEC },
+	{ dns_outage_steps, ARRAY_SIZE(dns_outage_steps), 10 * 60 * MSEC_PER_SEC },
+	{ slow_network_steps, ARRAY_SIZE(slow_network_steps), 10 * 60 * MSEC_PER_SEC },
+};
+
+#if defined(USER_CONFIG_NET_FAULT_PROFILE)
+static const struct fault_profile* const profile = &profiles[USER_CONFIG_NET_FAULT_PROFILE];
+#else
+static const struct fault_profile* const profile = &profiles[NET_FAULT_PROFILE_NONE];
+#endif
+
+/* Indexed by net_fault_type */
+static const char* const type_names[NET_FAULT_TYPE_COUNT] = { "latency", "drop", "stall", "fail", "link_down" };
+
+/* Indexed by net_fault_site */
+static const uint32_t site_targets[NET_FAULT_SITE_COUNT] = {
+	NET_FAULT_DNS, NET_FAULT_HTTP, NET_FAULT_HTTP, NET_FAULT_MQTT, NET_FAULT_MQTT, NET_FAULT_MQTT, NET_FAULT_MQTT,
+};
+
+/* Step currently in effect, read by apply on any thread */
+static atomic_t fault_active;
+static struct net_fault_step active_step;
+static uint32_t active_seq;
+static struct k_spinlock active_lock;
+
+/* Publishes reported as successful but never sent, which the sample counters cannot see */
+static atomic_t dropped_publishes;
+
+/* Counters at the start of a step, followed up until the next successful publish after it ends */
+struct fault_window {
+	size_t step_id;
+	struct net_fault_step step;
+	int64_t end_ms;
+	uint32_t generated;
+	uint32_t published;
+	uint32_t dropped;
+	uint32_t reconnects;
+	int32_t queue_depth;
+	uint32_t published_at_end;
+	bool pending;
+};
+
+/* Schedule state is only used from the system workqueue */
+static size_t step_id;
+static bool step_running;
+static int64_t cycle_start_ms;
+static struct fault_window window;
+static struct k_delayed_work schedule_work;
+static struct k_delayed_work recovery_work;
+
+/**
+ * @brief	Log the outcome of a fault step
+ * @author	Lee Tze Han
+ * @param	recovery_ms	Time from the end of the step to the next successful publish, or -1 if none
+ * 				happened before the next step started
+ * @details	Samples are counted as lost if they were generated since the start of the step but were
+ * 		neither published nor still queued.
+ */
+static void report_window(int64_t recovery_ms)
+{
+	uint32_t generated = metrics::get_counter(METRIC_SAMPLES_GENERATED) - window.generated;
+	uint32_t published = metrics::get_counter(METRIC_SAMPLES_PUBLISHED) - window.published;
+	uint32_t dropped = (uint32_t)atomic_get(&dropped_publishes) - window.dropped;
+	int32_t queued = metrics::get_gauge(METRIC_QUEUE_DEPTH).value - window.queue_depth;
+
+	LOG_INF("NET_FAULT {\"step\":%u,\"type\":\"%s\",\"targets\":%u,\"duration_ms\":%u,\"recovery_ms\":%d,"
+		"\"generated\":%u,\"published\":%u,\"lost\":%d,\"reconnects\":%u}",
+		(unsigned int)window.step_id, type_names[window.step.type], window.step.targets,
+		window.step.duration_ms, (int)recovery_ms, generated, published - dropped,
+		(int)(generated - published + dropped) - queued,
+		metrics::get_counter(METRIC_MQTT_RECONNECTS) - window.reconnects);
+
+	window.pending = false;
+}
+
+/**
+ * @brief	Put a step into effect
+ * @author	Lee Tze Han
+ * @param	id	Index of the step in the profile
+ */
+static void begin_step(size_t id)
+{
+	const struct net_fault_step& step = profile->steps[id];
+
+	if (window.pending) {
+		k_delayed_work_cancel(&recovery_work);
+		report_window(-1);
+	}
+
+	window.step_id = id;
+	window.step = step;
+	window.generated = metrics::get_counter(METRIC_SAMPLES_GENERATED);
+	window.published = metrics::get_counter(METRIC_SAMPLES_PUBLISHED);
+	window.dropped = atomic_get(&dropped_publishes);
+	window.reconnects = metrics::get_counter(METRIC_MQTT_RECONNECTS);
+	window.queue_depth = metrics::get_gauge(METRIC_QUEUE_DEPTH).value;
+
+	LOG_WRN("Injecting %s fault (targets 0x%x, param %u) for %u ms", type_names[step.type], step.targets,
+		step.param, step.duration_ms);
+
+	k_spinlock_key_t key = k_spin_lock(&active_lock);
+	active_step = step;
+	active_seq++;
+	k_spin_unlock(&active_lock, key);
+	atomic_set(&fault_active, 1);
+
+	if (step.type == NET_FAULT_LINK_DOWN) {
+		net_if_down(net_if_get_default());
+	}
+}
+
+/**
+ * @brief	Lift the step in effect and start following up on recovery
+ * @author	Lee Tze Han
+ */
+static void end_step(void)
+{
+	atomic_set(&fault_active, 0);
+	k_spinlock_key_t key = k_spin_lock(&active_lock);
+	active_seq++;
+	k_spin_unlock(&active_lock, key);
+
+	if (window.step.type == NET_FAULT_LINK_DOWN) {
+		net_if_up(net_if_get_default());
+	}
+
+	LOG_WRN("Lifted %s fault", type_names[window.step.type]);
+
+	window.end_ms = k_uptime_get();
+	window.published_at_end = metrics::get_counter(METRIC_SAMPLES_PUBLISHED);
+	window.pending = true;
+	k_delayed_work_submit(&recovery_work, K_MSEC(NET_FAULT_RECOVERY_POLL_MS));
+}
+
+/**
+ * @brief	Advance through the steps of the profile
+ * @author	Lee Tze Han
+ * @param	work_item	Unused
+ * @details	Runs at the start and end of every step.
+ */
+static void run_schedule(struct k_work* work_item)
+{
+	ARG_UNUSED(work_item);
+
+	if (step_running) {
+		end_step();
+		step_running = false;
+
+		if (++step_id == profile->step_count) {
+			if (profile->period_ms == 0) {
+				LOG_INF("Network fault profile finished");
+				return;
+			}
+
+			step_id = 0;
+			cycle_start_ms += profile->period_ms;
+		}
+	}
+
+	const struct net_fault_step& step = profile->steps[step_id];
+	int64_t wait_ms = cycle_start_ms + step.start_ms - k_uptime_get();
+	if (wait_ms > 0) {
+		k_delayed_work_submit(&schedule_work, K_MSEC(wait_ms));
+		return;
+	}
+
+	begin_step(step_id);
+	step_running = true;
+	k_delayed_work_submit(&schedule_work, K_MSEC(step.duration_ms));
+}
+
+/**
+ * @brief	Check for the first successful publish after a step ended
+ * @author	Lee Tze Han
+ * @param	work_item	Unused
+ */
+static void follow_recovery(struct k_work* work_item)
+{
+	ARG_UNUSED(work_item);
+
+	if (!window.pending) {
+		return;
+	}
+
+	if (metrics::get_counter(METRIC_SAMPLES_PUBLISHED) > window.published_at_end) {
+		report_window(k_uptime_get() - window.end_ms);
+		return;
+	}
+
+	k_delayed_work_submit(&recovery_work, K_MSEC(NET_FAULT_RECOVERY_POLL_MS));
+}
+
+namespace net_fault
+{
+/**
+ * @brief	Start playing back the fault profile selected with USER_CONFIG_NET_FAULT_PROFILE
+ * @author	Lee Tze Han
+ * @details	Step times are relative to this call, which should be made once the device is connected.
+ * 		Does nothing if no profile is selected.
+ */
+void start(void)
+{
+	if (profile->step_count == 0) {
+		return;
+	}
+
+	LOG_WRN("Network fault injection enabled (%u steps, period %u ms)", (unsigned int)profile->step_count,
+		profile->period_ms);
+
+	cycle_start_ms = k_uptime_get();
+	k_delayed_work_init(&schedule_work, run_schedule);
+	k_delayed_work_init(&recovery_work, follow_recovery);
+	k_delayed_work_submit(&schedule_work, K_NO_WAIT);
+}
+
+/**
+ * @brief	Apply the fault in effect to an operation about to be handed to the network stack
+ * @author	Lee Tze Han
+ * @param	site	Operation being performed
+ * @return	NET_FAULT_PASS to carry out the operation, NET_FAULT_DROPPED to skip it as if it had
+ * 		succeeded, or a negative errno to fail it
+ * @details	Latency and stalls block the caller, except on the system workqueue, which also runs the
+ * 		fault schedule; there, stalled operations are skipped and latency is ignored. Periodic MQTT
+ * 		operations are skipped instead of failed. Dropped connects, resolves and requests fail with
+ * 		-ETIMEDOUT.
+ */
+int apply(net_fault_site site)
+{
+	if (!atomic_get(&fault_active)) {
+		return NET_FAULT_PASS;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&active_lock);
+	struct net_fault_step step = active_step;
+	uint32_t seq = active_seq;
+	k_spin_unlock(&active_lock, key);
+
+	if (step.type == NET_FAULT_LINK_DOWN || !(step.targets & site_targets[site])) {
+		return NET_FAULT_PASS;
+	}
+
+	bool periodic = site >= NET_FAULT_SITE_MQTT_INPUT;
+	bool blocking = !periodic && k_current_get() != &k_sys_work_q.thread;
+	int rc = NET_FAULT_PASS;
+
+	switch (step.type) {
+	case NET_FAULT_LATENCY:
+		if (blocking) {
+			k_msleep(step.param);
+		}
+		break;
+
+	case NET_FAULT_DROP:
+		if (sys_rand32_get() % 1000 < step.param) {
+			rc = (periodic || site == NET_FAULT_SITE_MQTT_PUBLISH) ? NET_FAULT_DROPPED : -ETIMEDOUT;
+		}
+		break;
+
+	case NET_FAULT_STALL:
+		if (!blocking) {
+			rc = NET_FAULT_DROPPED;
+			break;
+		}
+
+		/* Hold the operation until the step is lifted, or fail it as a timed out send */
+		for (int64_t timeout_ms = k_uptime_get() + NET_FAULT_STALL_TIMEOUT_MS;;) {
+			if (k_uptime_get() >= timeout_ms) {
+				rc = -ETIMEDOUT;
+				break;
+			}
+
+			k_msleep(NET_FAULT_STALL_POLL_MS);
+
+			key = k_spin_lock(&active_lock);
+			bool lifted = active_seq != seq;
+			k_spin_unlock(&active_lock, key);
+			if (lifted) {
+				break;
+			}
+		}
+		break;
+
+	case NET_FAULT_FAIL:
+		rc = periodic ? NET_FAULT_DROPPED : -ENETUNREACH;
+		break;
+
+	default:
+		break;
+	}
+
+	if (rc == NET_FAULT_DROPPED && site == NET_FAULT_SITE_MQTT_PUBLISH) {
+		atomic_inc(&dropped_publishes);
+	}
+
+	return rc;
+}
+} // namespace net_fault
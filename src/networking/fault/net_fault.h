@@ -0,0 +1,101 @@
+/*******************************************************************************************************
+ * Copyright (c) 2021 Government Technology Agency of Singapore (GovTech)
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied.
+ *
+ * See the License for the specific language governing permissions and limitations under the License.
+ *******************************************************************************************************/
+#ifndef _NET_FAULT_H_
+#define _NET_FAULT_H_
+
+#include <zephyr.h>
+
+/*
+ * Network fault injection for reconnect and recovery testing. A fault profile selected with
+ * USER_CONFIG_NET_FAULT_PROFILE is played back on a schedule once net_fault::start is called; the
+ * networking modules call net_fault::apply right before handing an operation to the network stack.
+ * After each step, the time until the next successful publish and the number of samples lost are
+ * logged as "NET_FAULT {json}" lines. Without a profile, apply always returns NET_FAULT_PASS.
+ */
+
+/* Points at which operations of the networking modules can be faulted */
+enum net_fault_site {
+	NET_FAULT_SITE_DNS_RESOLVE,
+	NET_FAULT_SITE_HTTP_CONNECT,
+	NET_FAULT_SITE_HTTP_SEND,
+	NET_FAULT_SITE_MQTT_CONNECT,
+	NET_FAULT_SITE_MQTT_PUBLISH,
+	/* Periodic operations on the system workqueue are skipped rather than blocked */
+	NET_FAULT_SITE_MQTT_INPUT,
+	NET_FAULT_SITE_MQTT_KEEPALIVE,
+	NET_FAULT_SITE_COUNT
+};
+
+/* Targets of a fault step */
+#define NET_FAULT_DNS  BIT(0)
+#define NET_FAULT_HTTP BIT(1)
+#define NET_FAULT_MQTT BIT(2)
+#define NET_FAULT_ALL  (NET_FAULT_DNS | NET_FAULT_HTTP | NET_FAULT_MQTT)
+
+enum net_fault_type {
+	/* Delay each operation by param milliseconds */
+	NET_FAULT_LATENCY,
+	/* Lose param permille of operations; lost publishes still report success, as with QoS 0 */
+	NET_FAULT_DROP,
+	/* Block operations until the step ends, failing them with -ETIMEDOUT after 10 s */
+	NET_FAULT_STALL,
+	/* Fail operations immediately */
+	NET_FAULT_FAIL,
+	/* Take the default network interface down for the step; targets are ignored */
+	NET_FAULT_LINK_DOWN,
+	NET_FAULT_TYPE_COUNT
+};
+
+struct net_fault_step {
+	/* Offset from the start of the profile, or of each repetition */
+	uint32_t start_ms;
+	uint32_t duration_ms;
+	enum net_fault_type type;
+	uint32_t targets;
+	uint32_t param;
+};
+
+/*
+ * With a profile selected, the communications thread reconnects in place after a failed publish (see
+ * USER_CONFIG_NET_FAULT_RECONNECT_ATTEMPTS) instead of rebooting, so every step is followed up to the
+ * next successful publish.
+ */
+enum net_fault_profile {
+	NET_FAULT_PROFILE_NONE,
+	/* WiFi drops: link down for 15 s every 5 min */
+	NET_FAULT_PROFILE_LINK_FLAP,
+	/* Broker stops responding for 8 s, within the stall timeout, so publishes are held */
+	NET_FAULT_PROFILE_BROKER_STALL,
+	/* 10% of MQTT and HTTP operations lost for 2 min; lost publishes report success */
+	NET_FAULT_PROFILE_LOSSY_LINK,
+	/* Link drop followed by 1 min of failing DNS, so that reconnection cannot resolve the broker */
+	NET_FAULT_PROFILE_DNS_OUTAGE,
+	/* 2 s added to every operation for 2 min */
+	NET_FAULT_PROFILE_SLOW_NETWORK,
+	NET_FAULT_PROFILE_COUNT
+};
+
+/* Results of net_fault::apply other than a negative errno */
+#define NET_FAULT_PASS	  (0)
+#define NET_FAULT_DROPPED (1)
+
+namespace net_fault
+{
+void start(void);
+int apply(net_fault_site site);
+} // namespace net_fault
+
+#endif // _NET_FAULT_H_
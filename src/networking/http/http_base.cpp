@@ -1,8 +1,14 @@
 #include <logging/log.h>
 LOG_MODULE_REGISTER(http_base, LOG_LEVEL_DBG);
 
+#include "diagnostics/alloc_profiler.h"
+#include "diagnostics/boot_profiler.h"
+#include "diagnostics/metrics.h"
+#include "diagnostics/tls_heap_monitor.h"
 #include "http_base.h"
+#include "http_url.h"
 #include "networking/dns/dns_lookup.h"
+#include "networking/fault/net_fault.h"
 
 #define HTTP_REQUEST_PROTOCOL ("HTTP/1.1")
 #define HTTP_TIMEOUT	      (5 * MSEC_PER_SEC)
@@ -11,6 +17,8 @@ void response_cb(struct http_response* recv_resp, enum http_final_call final_dat
 
 HttpBase::HttpBase(const std::string& url, int port) : port_(port)
 {
+	AllocScope alloc_scope(ALLOC_MODULE_HTTP);
+
 	parse_url(url);
 
 	/* Resolve hostname */
@@ -24,9 +32,6 @@ HttpBase::~HttpBase(void)
 	if (sock_ >= 0) {
 		close(sock_);
 	}
-
-	/* Free allocated memory */
-	delete[] header_ptrs_;
 }
 
 /**
@@ -52,6 +57,8 @@ void HttpBase::add_header(const std::string& header_name, const std::string& hea
  */
 bool HttpBase::send_request(http_method method, std::string payload)
 {
+	AllocScope alloc_scope(ALLOC_MODULE_HTTP);
+
 	struct http_request req;
 	memset(&req, 0, sizeof(req));
 
@@ -65,15 +72,14 @@ bool HttpBase::send_request(http_method method, std::string payload)
 
 	/* Set headers if present */
 	if (headers_.size() > 0) {
-		header_ptrs_ = new const char*[headers_.size() + 1];
-
-		size_t i;
-		for (i = 0; i < headers_.size(); i++) {
-			header_ptrs_[i] = headers_[i].c_str();
+		/* Rebuilt on every request, since headers_ may have grown */
+		header_ptrs_.clear();
+		for (const auto& header : headers_) {
+			header_ptrs_.push_back(header.c_str());
 		}
 		/* List needs to be NULL-terminated */
-		header_ptrs_[i] = NULL;
-		req.optional_headers = header_ptrs_;
+		header_ptrs_.push_back(NULL);
+		req.optional_headers = header_ptrs_.data();
 	}
 
 	/* Set message body if present */
@@ -83,7 +89,11 @@ bool HttpBase::send_request(http_method method, std::string payload)
 	}
 
 	/* Socket setup and connection */
+	boot_profiler::begin(BOOT_PROFILE_REST_REQUESTS);
+	metric_timer request_timer = metrics::start_timer();
 	if (!connect_socket()) {
+		boot_profiler::end(BOOT_PROFILE_REST_REQUESTS);
+		metrics::increment(METRIC_HTTP_FAILURES);
 		return false;
 	}
 
@@ -91,8 +101,14 @@ bool HttpBase::send_request(http_method method, std::string payload)
 	 * Pass calling HttpRequest context through user_data 
 	 * Note: This call blocks until a response is received
 	 */
-	int rc = http_client_req(sock_, &req, HTTP_TIMEOUT, &resp_);
+	int rc = net_fault::apply(NET_FAULT_SITE_HTTP_SEND);
+	if (rc == NET_FAULT_PASS) {
+		rc = http_client_req(sock_, &req, HTTP_TIMEOUT, &resp_);
+	}
+	boot_profiler::end(BOOT_PROFILE_REST_REQUESTS);
+	metrics::observe_since(METRIC_HTTP_REQUEST, request_timer);
 	if (rc < 0) {
+		metrics::increment(METRIC_HTTP_FAILURES);
 		LOG_WRN("Failed to send HTTP request: %d", rc);
 		return false;
 	}
@@ -117,35 +133,19 @@ std::string HttpBase::get_response_body(void) const
  */
 void HttpBase::parse_url(const std::string& url)
 {
-	/* Find end of scheme */
-	int scheme_len = url.find("//") + 3;
-
-	int idx = url.find_first_of('/', scheme_len);
-	if (idx != -1) {
-		/* Split URL into hostname and endpoint */
-		hostname_ = url.substr(scheme_len - 1, idx - scheme_len + 1);
-		endpoint_ = url.substr(idx);
-	}
-	else {
-		hostname_ = url.substr(scheme_len - 1);
-		endpoint_ = "/";
-	}
-
-	/* Hostname may contain port */
-	idx = hostname_.find_first_of(':');
-	if (idx != -1) {
+	http_url parsed = parse_http_url(url, port_);
+	if (parsed.port != port_) {
 		/* Use port number from URL instead */
-		int port = stol(hostname_.substr(idx + 1));
-		LOG_INF("Using port %d parsed from URL", port);
-
-		port_ = port;
-		hostname_ = hostname_.substr(0, idx);
+		LOG_INF("Using port %d parsed from URL", parsed.port);
 	}
 
+	hostname_ = parsed.hostname;
+	endpoint_ = parsed.endpoint;
+	port_ = parsed.port;
 	host_ = hostname_ + ":" + std::to_string(port_);
 
-	LOG_DBG("Parsed hostname: '%s'", hostname_.c_str());
-	LOG_DBG("Parsed endpoint: '%s'", endpoint_.c_str());
+	LOG_DBG("Parsed hostname: '%s'", log_strdup(hostname_.c_str()));
+	LOG_DBG("Parsed endpoint: '%s'", log_strdup(endpoint_.c_str()));
 }
 
 /**
@@ -159,15 +159,28 @@ bool HttpBase::connect_socket(void)
 	sockaddr_in addr;
 	memset(&addr, 0, sizeof(addr));
 
+	/* Hostname could not be resolved; already logged by DnsLookup */
+	if (ipaddr_.empty()) {
+		return false;
+	}
+
 	if (!setup_socket(&addr)) {
 		LOG_WRN("Failed to setup socket");
 		return false;
 	};
 
-	/* Connection using socket */
-	int rc = connect(sock_, (struct sockaddr*)&addr, sizeof(sockaddr_in));
+	int rc = net_fault::apply(NET_FAULT_SITE_HTTP_CONNECT);
+	if (rc < 0) {
+		LOG_WRN("Injected fault connecting to %s: %d", log_strdup(ipaddr_.c_str()), rc);
+		return false;
+	}
+
+	/* Connection using socket (TLS handshake is performed here for HTTPS; plain HTTP does not use the mbedTLS heap) */
+	tls_heap_monitor::begin_phase(TLS_HEAP_PHASE_HTTPS_HANDSHAKE);
+	rc = connect(sock_, (struct sockaddr*)&addr, sizeof(sockaddr_in));
+	tls_heap_monitor::end_phase(TLS_HEAP_PHASE_HTTPS_HANDSHAKE);
 	if (rc < 0) {
-		LOG_WRN("Failed to connect to %s: %d", ipaddr_.c_str(), -errno);
+		LOG_WRN("Failed to connect to %s: %d", log_strdup(ipaddr_.c_str()), -errno);
 		return false;
 	}
 
@@ -47,7 +47,8 @@ private:
 	uint8_t recv_buf_[512];
 	HttpResponse resp_;
 	std::vector<std::string> headers_;
-	const char** header_ptrs_;
+	/* NULL-terminated list of pointers into headers_, as expected by http_client_req */
+	std::vector<const char*> header_ptrs_;
 
 	std::string endpoint_;
 };
@@ -0,0 +1,35 @@
+#include "http_url.h"
+
+/**
+ * @brief	Parses URL into hostname, port and API endpoint
+ * @author	Lee Tze Han
+ * @param       url     	URL string to be parsed
+ * @param       default_port	Port used if the URL does not specify one
+ * @return	http_url struct
+ */
+http_url parse_http_url(const std::string& url, int default_port)
+{
+	http_url parsed = { .hostname = "", .endpoint = "/", .port = default_port };
+
+	/* Find end of scheme */
+	int scheme_len = url.find("//") + 3;
+
+	int idx = url.find_first_of('/', scheme_len);
+	if (idx != -1) {
+		/* Split URL into hostname and endpoint */
+		parsed.hostname = url.substr(scheme_len - 1, idx - scheme_len + 1);
+		parsed.endpoint = url.substr(idx);
+	}
+	else {
+		parsed.hostname = url.substr(scheme_len - 1);
+	}
+
+	/* Hostname may contain port */
+	idx = parsed.hostname.find_first_of(':');
+	if (idx != -1) {
+		parsed.port = stol(parsed.hostname.substr(idx + 1));
+		parsed.hostname.resize(idx);
+	}
+
+	return parsed;
+}
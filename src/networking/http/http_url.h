@@ -0,0 +1,30 @@
+/*******************************************************************************************************
+ * Copyright (c) 2021 Government Technology Agency of Singapore (GovTech)
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied.
+ *
+ * See the License for the specific language governing permissions and limitations under the License.
+ *******************************************************************************************************/
+#ifndef _HTTP_URL_H_
+#define _HTTP_URL_H_
+
+#include <string>
+
+/* Components of a URL of the form scheme://hostname[:port][/endpoint] */
+struct http_url {
+	std::string hostname;
+	std::string endpoint;
+	int port;
+};
+
+http_url parse_http_url(const std::string& url, int default_port);
+
+#endif // _HTTP_URL_H_
@@ -4,6 +4,7 @@ LOG_MODULE_REGISTER(https_request, LOG_LEVEL_DBG);
 #include <net/tls_credentials.h>
 #include "https_request.h"
 #include "tls_certs.h"
+#include "user_config.h"
 
 #define HTTPS_SCHEME ("https://")
 
@@ -53,5 +54,14 @@ bool HttpsRequest::setup_socket(sockaddr_in* addr)
 		return false;
 	}
 
+#if defined(USER_CONFIG_TLS_SKIP_PEER_VERIFY)
+	int peer_verify = TLS_PEER_VERIFY_NONE;
+	rc = setsockopt(sock_, SOL_TLS, TLS_PEER_VERIFY, &peer_verify, sizeof(peer_verify));
+	if (rc < 0) {
+		LOG_WRN("Failed to set socket option TLS_PEER_VERIFY: %d", -errno);
+		return false;
+	}
+#endif
+
 	return true;
 }
\ No newline at end of file
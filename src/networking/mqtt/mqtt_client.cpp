@@ -3,11 +3,20 @@ LOG_MODULE_REGISTER(mqtt_client, LOG_LEVEL_DBG);
 
 #include <vector>
 #include "device_uuid/device_uuid.h"
+#include "diagnostics/alloc_profiler.h"
+#include "diagnostics/boot_profiler.h"
+#include "diagnostics/cpu_profiler.h"
+#include "diagnostics/metrics.h"
+#include "diagnostics/tls_heap_monitor.h"
+#include "log_ratelimit/log_ratelimit.h"
 #include "mqtt_client.h"
 #include "networking/dns/dns_lookup.h"
+#include "networking/fault/net_fault.h"
 #include "tls_certs.h"
 #include "user_config.h"
 
+LOG_RATELIMIT_REGISTER();
+
 #define MQTT_CONN_RETRIES (3)
 #define MQTT_TIMEOUT	  (5 * MSEC_PER_SEC)
 #define MQTT_LOOP_PERIOD  K_MSEC(1 * MSEC_PER_SEC)
@@ -23,9 +32,13 @@ sec_tag_t ca_tag_list[] = { CA_CERTS_TAG, CLIENT_CERTS_TAG };
  */
 static MqttClient* client_ptr;
 
+/* Any connection attempt after the first since boot is counted as a reconnect */
+static bool first_connect_attempt = true;
+
 /* Forward callbacks to instance */
 void mqtt_event_handler(struct mqtt_client* client_ctx, const struct mqtt_evt* event)
 {
+	AllocScope alloc_scope(ALLOC_MODULE_MQTT);
 	client_ptr->handle_event(client_ctx, event);
 }
 
@@ -48,16 +61,34 @@ MqttClient::MqttClient(void)
  */
 bool MqttClient::connect(mqtt_client_conf config)
 {
+	AllocScope alloc_scope(ALLOC_MODULE_MQTT);
+
 	client_conf_ = config;
 	username_ = { .utf8 = (uint8_t*)client_conf_.username.c_str(), .size = client_conf_.username.size() };
 	password_ = { .utf8 = (uint8_t*)client_conf_.password.c_str(), .size = client_conf_.password.size() };
 
 	/* Initialize and try to connect */
 	for (int i = 0; i < MQTT_CONN_RETRIES; i++) {
-		resolve_broker();
+		if (!first_connect_attempt) {
+			metrics::increment(METRIC_MQTT_RECONNECTS);
+		}
+		first_connect_attempt = false;
+
+		/* Resolving again straight away will not help; the caller retries later */
+		if (!resolve_broker()) {
+			return false;
+		}
+
 		client_setup();
+		connack_result_ = MQTT_CONNECTION_ACCEPTED;
 
-		int rc = mqtt_connect(&client_ctx_);
+		boot_profiler::begin(BOOT_PROFILE_MQTT_CONNACK);
+		tls_heap_monitor::begin_phase(TLS_HEAP_PHASE_MQTT_HANDSHAKE);
+		int rc = net_fault::apply(NET_FAULT_SITE_MQTT_CONNECT);
+		if (rc == NET_FAULT_PASS) {
+			rc = mqtt_connect(&client_ctx_);
+		}
+		tls_heap_monitor::end_phase(TLS_HEAP_PHASE_MQTT_HANDSHAKE);
 		if (rc == 0) {
 			/* Configure pollfd */
 			struct pollfd fds[1];
@@ -72,6 +103,12 @@ bool MqttClient::connect(mqtt_client_conf config)
 				start_loop();
 				return true;
 			}
+			else if (auth_rejected()) {
+				/* Retrying with the same credentials will not help */
+				LOG_WRN("MQTT broker rejected client credentials");
+				mqtt_abort(&client_ctx_);
+				return false;
+			}
 			else {
 				LOG_WRN("MQTT broker connection timed out");
 			}
@@ -105,6 +142,24 @@ bool MqttClient::disconnect(void)
 	return true;
 }
 
+/**
+ * @brief	Tear down the connection to the MQTT broker without notifying it
+ * @author	Lee Tze Han
+ * @details	Used before connecting again when the connection has stopped working, e.g. after a failed
+ * 		publish; the broker may not have noticed, so no DISCONNECT is sent.
+ */
+void MqttClient::drop_connection(void)
+{
+	stop_loop();
+
+	k_mutex_lock(&tx_mutex_, K_FOREVER);
+	mqtt_abort(&client_ctx_);
+	k_mutex_unlock(&tx_mutex_);
+
+	/* connect checks this flag for the CONNACK of the next attempt */
+	connected_ = false;
+}
+
 /**
  * @brief	Configure address for MQTT broker
  * @author	Lee Tze Han
@@ -115,6 +170,8 @@ bool MqttClient::disconnect(void)
  */
 bool MqttClient::publish(std::string topic, std::string payload)
 {
+	AllocScope alloc_scope(ALLOC_MODULE_MQTT);
+
 	struct mqtt_publish_param param;
 
 	param.message.topic.qos = MQTT_QOS_0_AT_MOST_ONCE;
@@ -125,23 +182,31 @@ bool MqttClient::publish(std::string topic, std::string payload)
 	param.dup_flag = 0;
 	param.retain_flag = 0;
 
-	/*
-	 * As the workqueue thread may also call this method from processing mqtt_input,
-	 * the MQTT client context has to be properly guarded.
-	 */
-	k_mutex_lock(&tx_mutex_, K_FOREVER);
+	int rc = net_fault::apply(NET_FAULT_SITE_MQTT_PUBLISH);
+	if (rc == NET_FAULT_DROPPED) {
+		/* Lost in transit; QoS 0 gives the sender no indication */
+		return true;
+	}
 
-	int rc = mqtt_publish(&client_ctx_, &param);
+	if (rc == NET_FAULT_PASS) {
+		/*
+		 * As the workqueue thread may also call this method from processing mqtt_input,
+		 * the MQTT client context has to be properly guarded.
+		 */
+		k_mutex_lock(&tx_mutex_, K_FOREVER);
 
-	k_mutex_unlock(&tx_mutex_);
+		rc = mqtt_publish(&client_ctx_, &param);
+
+		k_mutex_unlock(&tx_mutex_);
+	}
 
 	if (rc < 0) {
-		LOG_WRN("MQTT Publish failed: %d", rc);
+		LOG_WRN_RATELIMIT("MQTT Publish failed: %d", rc);
 		return false;
 	}
 
 	/* Not expecting PUBACK for QoS 0 */
-	LOG_DBG("Successfully published to %s", topic.c_str());
+	LOG_DBG_RATELIMIT("Successfully published to %s", log_strdup(topic.c_str()));
 
 	return true;
 }
@@ -172,6 +237,7 @@ bool MqttClient::subscribe(const std::vector<std::string>& topics, enum mqtt_qos
 							 .list_count = (uint16_t)topic_list.size(),
 							 .message_id = 1 };
 
+	boot_profiler::begin(BOOT_PROFILE_MQTT_SUBACK);
 	int rc = mqtt_subscribe(&client_ctx_, &sub_list);
 	if (rc < 0) {
 		LOG_WRN("MQTT Subscribe failed: %d", rc);
@@ -179,24 +245,40 @@ bool MqttClient::subscribe(const std::vector<std::string>& topics, enum mqtt_qos
 	}
 
 	for (std::string topic : topics) {
-		LOG_DBG("Subscribing to %s...", topic.c_str());
+		LOG_DBG("Subscribing to %s...", log_strdup(topic.c_str()));
 	}
 
 	return true;
 }
 
+/**
+ * @brief	Check if the last connection attempt was refused due to the client credentials
+ * @author	Lee Tze Han
+ * @return	True if the broker responded with a bad username/password or not authorized CONNACK
+ */
+bool MqttClient::auth_rejected(void) const
+{
+	return connack_result_ == MQTT_BAD_USER_NAME_OR_PASSWORD || connack_result_ == MQTT_NOT_AUTHORIZED;
+}
+
 /**
  * @brief	Configure address for MQTT broker
  * @author	Lee Tze Han
+ * @return	False if the broker hostname could not be resolved
  */
-void MqttClient::resolve_broker(void)
+bool MqttClient::resolve_broker(void)
 {
 	DnsLookup dns_lookup(client_conf_.broker_hostname);
 	std::string ipaddr = dns_lookup.get_ipaddr();
+	if (ipaddr.empty()) {
+		return false;
+	}
 
 	broker_addr_.sin_family = AF_INET;
 	broker_addr_.sin_port = htons(client_conf_.broker_port);
 	inet_pton(AF_INET, ipaddr.c_str(), &broker_addr_.sin_addr);
+
+	return true;
 }
 
 /**
@@ -216,7 +298,11 @@ void MqttClient::client_setup(void)
 	/* TLS Configuration */
 	struct mqtt_sec_config* tls_config = &client_ctx_.transport.tls.config;
 
+#if defined(USER_CONFIG_TLS_SKIP_PEER_VERIFY)
+	tls_config->peer_verify = TLS_PEER_VERIFY_NONE;
+#else
 	tls_config->peer_verify = TLS_PEER_VERIFY_REQUIRED;
+#endif
 	tls_config->cipher_list = NULL;
 	tls_config->sec_tag_list = ca_tag_list;
 	tls_config->sec_tag_count = ARRAY_SIZE(ca_tag_list);
@@ -242,7 +328,11 @@ void loop_mqtt_input(struct k_work* work_item)
 {
 	struct mqtt_work* mqtt_work = CONTAINER_OF(work_item, struct mqtt_work, work);
 
-	mqtt_input(mqtt_work->client_ctx);
+	if (net_fault::apply(NET_FAULT_SITE_MQTT_INPUT) == NET_FAULT_PASS) {
+		uint32_t start_cycles = cpu_profiler::handler_begin();
+		mqtt_input(mqtt_work->client_ctx);
+		cpu_profiler::handler_end(CPU_PROFILE_MQTT_INPUT, start_cycles);
+	}
 
 	k_delayed_work_submit(&mqtt_work->work, MQTT_LOOP_PERIOD);
 }
@@ -256,7 +346,11 @@ void loop_mqtt_live(struct k_work* work_item)
 {
 	struct mqtt_work* mqtt_work = CONTAINER_OF(work_item, struct mqtt_work, work);
 
-	mqtt_live(mqtt_work->client_ctx);
+	if (net_fault::apply(NET_FAULT_SITE_MQTT_KEEPALIVE) == NET_FAULT_PASS) {
+		uint32_t start_cycles = cpu_profiler::handler_begin();
+		mqtt_live(mqtt_work->client_ctx);
+		cpu_profiler::handler_end(CPU_PROFILE_MQTT_KEEPALIVE, start_cycles);
+	}
 
 	k_delayed_work_submit(&mqtt_work->work, MQTT_LOOP_PERIOD);
 }
@@ -314,12 +408,14 @@ void MqttClient::handle_event(struct mqtt_client* client_ctx, const struct mqtt_
 {
 	switch (event->type) {
 	case MQTT_EVT_CONNACK:
+		connack_result_ = event->param.connack.return_code;
 		if (event->result != 0) {
 			LOG_WRN("MQTT connection failed: %d", event->result);
 			break;
 		}
 
 		connected_ = true;
+		boot_profiler::end(BOOT_PROFILE_MQTT_CONNACK);
 		LOG_INF("MQTT client connected");
 
 		break;
@@ -337,7 +433,7 @@ void MqttClient::handle_event(struct mqtt_client* client_ctx, const struct mqtt_
 		break;
 
 	case MQTT_EVT_SUBACK:
-
+		boot_profiler::end(BOOT_PROFILE_MQTT_SUBACK);
 		LOG_DBG("Successfully subscribed");
 		break;
 
@@ -356,21 +452,34 @@ void MqttClient::handle_event(struct mqtt_client* client_ctx, const struct mqtt_
  * @author	Lee Tze Han
  * @param	client_ctx	mqtt_client context (same as MqttClient::client_ctx_)
  * @param	event		MQTT event details
- * @details	Custom functionality can be introduced by overriding the subscription_callback function
+ * @details	Custom functionality can be introduced by overriding the subscription_callback function.
+ * 		The payload is read into a fixed buffer, which the callback may parse in place.
  */
 void MqttClient::handle_incoming_publish(struct mqtt_client* client_ctx, const struct mqtt_evt* event)
 {
 	int len = event->param.publish.message.payload.len;
-	uint8_t* data = new uint8_t[len];
 
-	int rc = mqtt_read_publish_payload(client_ctx, data, len);
+	/* Oversized payloads still have to be read off the socket before the next packet */
+	if (len > (int)sizeof(payload_buffer_)) {
+		LOG_WRN_RATELIMIT("Dropping %d byte payload - increase MQTT_PAYLOAD_BUFFER_SIZE", len);
+		while (len > 0) {
+			int rc = mqtt_read_publish_payload(client_ctx, payload_buffer_,
+							   MIN(len, (int)sizeof(payload_buffer_)));
+			if (rc <= 0) {
+				break;
+			}
+			len -= rc;
+		}
+		return;
+	}
+
+	int rc = mqtt_read_publish_payload(client_ctx, payload_buffer_, len);
 	if (rc < 0) {
-		LOG_WRN("Failed to read payload");
+		LOG_WRN_RATELIMIT("Failed to read payload");
 		return;
 	}
 
-	subscription_callback(data, len);
-	delete[] data;
+	subscription_callback(payload_buffer_, len);
 
 	/* QoS 0 requires no PUBACK here */
 }
\ No newline at end of file
@@ -6,6 +6,9 @@
 #include <net/mqtt.h>
 #include <net/socket.h>
 
+/* Largest incoming publish payload; messages are handled one at a time on the system workqueue */
+#define MQTT_PAYLOAD_BUFFER_SIZE (1024)
+
 struct mqtt_client_conf {
 	/* Broker host */
 	std::string broker_hostname;
@@ -29,16 +32,19 @@ public:
 
 	bool connect(mqtt_client_conf config);
 	bool disconnect(void);
+	void drop_connection(void);
 	bool publish(std::string topic, std::string payload);
 	bool subscribe(const std::vector<std::string>& topics, enum mqtt_qos qos = MQTT_QOS_0_AT_MOST_ONCE);
+	bool auth_rejected(void) const;
 
 	void handle_event(struct mqtt_client* client_ctx, const struct mqtt_evt* event);
 
 private:
-	void resolve_broker(void);
+	bool resolve_broker(void);
 	void client_setup(void);
 
 	bool connected_ = false;
+	enum mqtt_conn_return_code connack_result_ = MQTT_CONNECTION_ACCEPTED;
 
 	/* Periodically run MQTT functions */
 	void start_loop(void);
@@ -62,6 +68,7 @@ private:
 	/* Buffers for MQTT client */
 	uint8_t rx_buffer_[256];
 	uint8_t tx_buffer_[256];
+	uint8_t payload_buffer_[MQTT_PAYLOAD_BUFFER_SIZE];
 	struct k_mutex tx_mutex_;
 };
 
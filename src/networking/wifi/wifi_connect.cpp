@@ -77,6 +77,7 @@ void wifi_mgmt_event_handler(struct net_mgmt_event_callback* cb,
 void wifi_mgmt_event_init(void)
 {
 	/* Bitmask of events registered in handler */
+#if defined(CONFIG_WIFI)
 	uint32_t registered_wifi_mgmt_events = NET_EVENT_WIFI_CONNECT_RESULT |
 					       NET_EVENT_WIFI_DISCONNECT_RESULT;
 
@@ -84,15 +85,18 @@ void wifi_mgmt_event_init(void)
 				     registered_wifi_mgmt_events);
 
 	net_mgmt_add_event_callback(&wifi_mgmt_cb);
+#endif
 }
 
 /**
  * @brief	Connect to WiFi network asynchronously
  * @author	Lee Tze Han
  * @note	Credentials for connecting to network are specified in src/user_config.h
+ * 		On targets without WiFi, wifi_signal is raised immediately
  */
 void wifi_connect(void)
 {
+#if defined(CONFIG_WIFI)
 	char wifi_ssid[] = USER_CONFIG_WIFI_SSID;
 	char wifi_pass[] = USER_CONFIG_WIFI_PASS;
 
@@ -116,4 +120,9 @@ void wifi_connect(void)
 	else {
 		LOG_INF("Connecting to WiFi...");
 	}
+#else
+	/* Without WiFi (e.g. Ethernet on native_posix), the interface is brought up by the net config library */
+	LOG_INF("No WiFi support - using default network interface");
+	k_poll_signal_raise(&wifi_signal, 0);
+#endif
 }
\ No newline at end of file
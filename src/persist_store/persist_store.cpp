@@ -5,7 +5,6 @@ LOG_MODULE_REGISTER(persist_store, LOG_LEVEL_DBG);
 #include <drivers/flash.h>
 #include <fs/nvs.h>
 #include <storage/flash_map.h>
-#include "conversions/conversions.h"
 #include "persist_store.h"
 
 static struct nvs_fs fs;
@@ -13,21 +12,30 @@ static struct nvs_fs fs;
 #define STORAGE_NODE DT_NODE_BY_FIXED_PARTITION_LABEL(storage)
 #define FLASH_NODE   DT_MTD_FROM_FIXED_PARTITION(STORAGE_NODE)
 
-typedef const int KeyName;
+/* Delay after the last write before modified values are written to flash */
+#define PERSIST_FLUSH_DELAY_MS (2 * MSEC_PER_SEC)
 
-/* List of id key used in NVS */
-namespace PersistKey
-{
-KeyName SW_VER = 1;
-KeyName SSL_CLIENT_CERTIFICATE = 2;
-KeyName SSL_CLIENT_CERTIFICATE_SERIAL_NUMBER = 3;
-KeyName SSL_PRIVATE_KEY = 4;
-} // namespace PersistKey
+/* NVS addresses hold the sector number in the upper half (c.f. ADDR_SECT_SHIFT in nvs_priv.h) */
+#define NVS_ADDR_SECT_SHIFT (16)
+
+struct cache_entry {
+	std::string value;
+	/* Set if a value is stored under the key */
+	bool present;
+	/* Set if value has not been written to flash yet */
+	bool dirty;
+};
+
+static struct cache_entry cache[PERSIST_KEY_MAX_ID - PERSIST_KEY_MIN_ID + 1];
+static bool cache_loaded = false;
+static persist_store_stats stats;
+K_MUTEX_DEFINE(cache_mutex);
+/* Serializes flushes from the workqueue and flush_persist_storage */
+K_MUTEX_DEFINE(flush_mutex);
 
-// Forward declarations of helper functions
-void write_key(KeyName key, const std::string& val);
-void write_key(KeyName key, const int val); // override for int
-std::string read_key(KeyName key);
+static void load_cache(void);
+static void flush_work_handler(struct k_work* work_item);
+static struct k_delayed_work flush_work;
 
 ////////////////////////////////////////////////////////////////////
 //
@@ -72,6 +80,9 @@ void init_persist_storage(void)
 		return;
 	}
 
+	k_delayed_work_init(&flush_work, flush_work_handler);
+	load_cache();
+
 	LOG_INF("Persistent Storage initialized");
 
 	return;
@@ -98,7 +109,7 @@ void write_sw_ver(const std::string sw_ver)
 /**
  *  @brief      Writes client certificate to flash memory.
  *  @author     Lau Lee Hong
- *  @param      cert    SSL client cert received from server
+ *  @param      cert    SSL client cert in DER format
  */
 void write_client_certificate(const std::string cert)
 {
@@ -120,9 +131,9 @@ void write_client_certificate_serial_number(const std::string cert_sn)
 }
 
 /**
- *  @brief      Writes client private key (in PEM format) to flash memory.
+ *  @brief      Writes client private key (in DER format) to flash memory.
  *  @author     Lau Lee Hong
- *  @param      private_key     Client private key in PEM format
+ *  @param      private_key     Client private key in DER format
  */
 void write_client_private_key(const std::string private_key)
 {
@@ -131,6 +142,18 @@ void write_client_private_key(const std::string private_key)
 	return;
 }
 
+/**
+ *  @brief      Writes DECADA device secret to flash memory.
+ *  @author     Lau Lee Hong
+ *  @param      device_secret   Device secret issued by DECADA on device creation
+ */
+void write_device_secret(const std::string device_secret)
+{
+	write_key(PersistKey::DECADA_DEVICE_SECRET, device_secret);
+
+	return;
+}
+
 ////////////////////////////////////////////////////////////////////
 //
 //   Public functions for reading from persistent storage
@@ -144,7 +167,8 @@ void write_client_private_key(const std::string private_key)
  */
 std::string read_sw_ver(void)
 {
-	std::string sw_ver = read_key(PersistKey::SW_VER);
+	std::string sw_ver;
+	read_key(PersistKey::SW_VER, sw_ver);
 
 	return sw_ver;
 }
@@ -152,11 +176,12 @@ std::string read_sw_ver(void)
 /**
  *  @brief      Reads the client certificate from flash memory.
  *  @author     Lau Lee Hong
- *  @return     Client certificate in PEM format
+ *  @return     Client certificate in DER format (PEM if saved by earlier firmware)
  */
 std::string read_client_certificate(void)
 {
-	std::string client_cert = read_key(PersistKey::SSL_CLIENT_CERTIFICATE);
+	std::string client_cert;
+	read_key(PersistKey::SSL_CLIENT_CERTIFICATE, client_cert);
 
 	return client_cert;
 }
@@ -168,87 +193,383 @@ std::string read_client_certificate(void)
  */
 std::string read_client_certificate_serial_number(void)
 {
-	std::string sn = read_key(PersistKey::SSL_CLIENT_CERTIFICATE_SERIAL_NUMBER);
+	std::string sn;
+	read_key(PersistKey::SSL_CLIENT_CERTIFICATE_SERIAL_NUMBER, sn);
 
 	return sn;
 }
 
 /**
- *  @brief      Reads the client private key (PEM) from flash memory.
+ *  @brief      Reads the client private key from flash memory.
  *  @author     Lau Lee Hong
- *  @return     Client private key in PEM format
+ *  @return     Client private key in DER format (PEM if saved by earlier firmware)
  */
 std::string read_client_private_key(void)
 {
-	std::string priv_key = read_key(PersistKey::SSL_PRIVATE_KEY);
+	std::string priv_key;
+	read_key(PersistKey::SSL_PRIVATE_KEY, priv_key);
 
 	return priv_key;
 }
 
+/**
+ *  @brief      Reads the DECADA device secret from flash memory.
+ *  @author     Lau Lee Hong
+ *  @return     Device secret, or an empty string if the device has not been provisioned
+ */
+std::string read_device_secret(void)
+{
+	std::string device_secret;
+	read_key(PersistKey::DECADA_DEVICE_SECRET, device_secret);
+
+	return device_secret;
+}
+
 ////////////////////////////////////////////////////////////////////
 //
-//   Helper functions for interfacing with global NVS API
+//   Cache of stored values
 //
 ////////////////////////////////////////////////////////////////////
 
 /**
- *  @brief      Writes a key-value pair to flash memory.
+ *  @brief      Get size of the value stored in flash under a key.
  *  @author     Lau Lee Hong
- *  @param      key     Id value in NVS
- *  @param      val     String value to be stored under key
+ *  @param      key     NVS id
+ *  @return     Size in bytes, or a negative error code (-ENOENT if nothing is stored under key)
  */
-void write_key(KeyName key, const std::string& val)
+static ssize_t nvs_value_size(KeyName key)
 {
-	LOG_DBG("Writing key %d with value %s", key, val.c_str());
+	/* NVS reports the full size of the stored value regardless of the number of bytes read */
+	uint8_t probe;
 
-	const char* val_cstr = val.c_str();
+	return nvs_read(&fs, key, &probe, sizeof(probe));
+}
 
-	int rc = nvs_write(&fs, key, val_cstr, strlen(val_cstr));
-	if (rc < 0) {
-		LOG_WRN("Failed to set key (returned %d)", rc);
+/**
+ *  @brief      Load all PersistKey entries from flash into the cache.
+ *  @author     Lau Lee Hong
+ */
+static void load_cache(void)
+{
+	k_mutex_lock(&cache_mutex, K_FOREVER);
+
+	for (int key = PERSIST_KEY_MIN_ID; key <= PERSIST_KEY_MAX_ID; key++) {
+		struct cache_entry& entry = cache[key - PERSIST_KEY_MIN_ID];
+		entry.dirty = false;
+		entry.present = false;
+		entry.value.clear();
+
+		ssize_t size = nvs_value_size(key);
+		if (size < 0) {
+			continue;
+		}
+
+		entry.value.resize(size);
+		if (size == 0 || nvs_read(&fs, key, &entry.value[0], size) == size) {
+			entry.present = true;
+		}
+		else {
+			LOG_WRN("Failed to load key %d", key);
+			entry.value.clear();
+		}
 	}
 
-	LOG_DBG("Write OK");
+	cache_loaded = true;
 
-	return;
+	k_mutex_unlock(&cache_mutex);
 }
 
 /**
- *  @brief      Integer overload for WriteKey.
+ *  @brief      Get the cache entry for a key.
  *  @author     Lau Lee Hong
- *  @param      key     Id value in NVS
- *  @param      val     Integer value to be stored under key
+ *  @param      key     NVS id
+ *  @return     Pointer to entry, or NULL if the cache is not loaded or key is not a PersistKey
+ *  @note       Must be called with cache_mutex held
  */
-void write_key(KeyName key, const int val)
+static struct cache_entry* find_cache_entry(KeyName key)
 {
-	write_key(key, int_to_string(val));
+	if (!cache_loaded || key < PERSIST_KEY_MIN_ID || key > PERSIST_KEY_MAX_ID) {
+		return NULL;
+	}
 
-	return;
+	return &cache[key - PERSIST_KEY_MIN_ID];
 }
 
 /**
- *  @brief      Get value of key-value pair from flash memory.
+ *  @brief      Write a value to flash, counting garbage collection by NVS.
  *  @author     Lau Lee Hong
  *  @param      key     NVS id
- *  @return     val     C++ string stored under key
+ *  @param      data    Value to be stored under key
+ *  @param      len     Size of value in bytes
+ *  @return     Success status
  */
-std::string read_key(KeyName key)
+static bool nvs_write_key(KeyName key, const void* data, size_t len)
 {
-	LOG_DBG("Reading key %d", key);
+	/* NVS garbage collects the next sector whenever the current one fills up */
+	uint32_t sector = fs.ate_wra >> NVS_ADDR_SECT_SHIFT;
 
-	/* buffer is one char larger to accomodate null terminator */
-	const int readout_buffer_size = 2048;
-	char* buffer[readout_buffer_size + 1];
-	memset(buffer, 0, readout_buffer_size + 1);
+	ssize_t rc = nvs_write(&fs, key, data, len);
+	if (rc < 0) {
+		LOG_WRN("Failed to write key %d (returned %d)", key, (int)rc);
+		return false;
+	}
 
-	int rc = nvs_read(&fs, key, &buffer, readout_buffer_size);
+	k_mutex_lock(&cache_mutex, K_FOREVER);
+	/* NVS returns 0 without writing if flash already holds the same value */
 	if (rc > 0) {
-		LOG_DBG("Id: %d, Data: %s", key, (const char*)buffer);
+		stats.flash_writes++;
+	}
+	if ((fs.ate_wra >> NVS_ADDR_SECT_SHIFT) != sector) {
+		stats.gc_events++;
+	}
+	k_mutex_unlock(&cache_mutex);
+
+	LOG_DBG("Wrote key %d (%u bytes)", key, len);
+
+	return true;
+}
+
+/**
+ *  @brief      Write all modified cache entries to flash.
+ *  @author     Lau Lee Hong
+ */
+void flush_persist_storage(void)
+{
+	k_mutex_lock(&flush_mutex, K_FOREVER);
+
+	for (int key = PERSIST_KEY_MIN_ID; key <= PERSIST_KEY_MAX_ID; key++) {
+		k_mutex_lock(&cache_mutex, K_FOREVER);
+		struct cache_entry& entry = cache[key - PERSIST_KEY_MIN_ID];
+		if (!entry.dirty) {
+			k_mutex_unlock(&cache_mutex);
+			continue;
+		}
+
+		/* Written from a copy so that the cache stays available to readers during the flash write */
+		std::string value = entry.value;
+		entry.dirty = false;
+		k_mutex_unlock(&cache_mutex);
+
+		if (!nvs_write_key(key, value.data(), value.size())) {
+			k_mutex_lock(&cache_mutex, K_FOREVER);
+			entry.dirty = true;
+			k_mutex_unlock(&cache_mutex);
+		}
+	}
+
+	k_mutex_unlock(&flush_mutex);
+}
+
+/**
+ *  @brief      Work handler for deferred flushes.
+ *  @author     Lau Lee Hong
+ *  @param      work_item       Unused
+ */
+static void flush_work_handler(struct k_work* work_item)
+{
+	ARG_UNUSED(work_item);
+
+	flush_persist_storage();
+}
+
+/**
+ *  @brief      Get counters for persistent storage activity.
+ *  @author     Lau Lee Hong
+ *  @return     persist_store_stats struct
+ */
+persist_store_stats get_persist_store_stats(void)
+{
+	k_mutex_lock(&cache_mutex, K_FOREVER);
+	persist_store_stats current = stats;
+	k_mutex_unlock(&cache_mutex);
+
+	return current;
+}
+
+////////////////////////////////////////////////////////////////////
+//
+//   Typed functions for interfacing with global NVS API
+//
+////////////////////////////////////////////////////////////////////
+
+/**
+ *  @brief      Get size of the value stored under a key.
+ *  @author     Lau Lee Hong
+ *  @param      key     NVS id
+ *  @return     Size in bytes, or a negative error code (-ENOENT if nothing is stored under key)
+ */
+ssize_t get_key_size(KeyName key)
+{
+	k_mutex_lock(&cache_mutex, K_FOREVER);
+	struct cache_entry* entry = find_cache_entry(key);
+	if (entry) {
+		ssize_t size = entry->present ? (ssize_t)entry->value.size() : -ENOENT;
+		k_mutex_unlock(&cache_mutex);
+		return size;
+	}
+	k_mutex_unlock(&cache_mutex);
+
+	ssize_t rc = nvs_value_size(key);
+	if (rc < 0 && rc != -ENOENT) {
+		LOG_WRN("Failed to read size of key %d (returned %d)", key, (int)rc);
+	}
+
+	return rc;
+}
+
+/**
+ *  @brief      Read the value stored under a key into caller-owned storage.
+ *  @author     Lau Lee Hong
+ *  @param      key     NVS id
+ *  @param      data    Buffer receiving the value
+ *  @param      len     Size of buffer
+ *  @return     Size of the stored value, or a negative error code (-ENOSPC if buffer is too small)
+ *  @note       PersistKey entries are served from the cache once persistent storage is initialized
+ */
+ssize_t read_key(KeyName key, void* data, size_t len)
+{
+	ssize_t rc;
+
+	k_mutex_lock(&cache_mutex, K_FOREVER);
+	struct cache_entry* entry = find_cache_entry(key);
+	if (entry) {
+		rc = entry->present ? (ssize_t)entry->value.size() : -ENOENT;
+		if (rc > 0) {
+			memcpy(data, entry->value.data(), MIN((size_t)rc, len));
+		}
+		stats.cache_reads++;
+		k_mutex_unlock(&cache_mutex);
 	}
 	else {
-		LOG_WRN("Failed to read key (returned %d)", rc);
-		return std::string();
+		k_mutex_unlock(&cache_mutex);
+		rc = nvs_read(&fs, key, data, len);
+	}
+
+	if (rc < 0) {
+		if (rc != -ENOENT) {
+			LOG_WRN("Failed to read key %d (returned %d)", key, (int)rc);
+		}
+		return rc;
+	}
+
+	if ((size_t)rc > len) {
+		LOG_WRN("Key %d holds %d bytes, buffer has %u", key, (int)rc, len);
+		return -ENOSPC;
+	}
+
+	LOG_DBG("Read key %d (%d bytes)", key, (int)rc);
+
+	return rc;
+}
+
+/**
+ *  @brief      Read the value stored under a key into an exactly-sized string.
+ *  @author     Lau Lee Hong
+ *  @param      key     NVS id
+ *  @param      val     String receiving the value (may contain binary data); cleared on failure
+ *  @return     Success status
+ */
+bool read_key(KeyName key, std::string& val)
+{
+	val.clear();
+
+	ssize_t size = get_key_size(key);
+	if (size <= 0) {
+		return false;
+	}
+
+	val.resize(size);
+	if (read_key(key, &val[0], val.size()) != size) {
+		val.clear();
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ *  @brief      Read an integer stored under a key.
+ *  @author     Lau Lee Hong
+ *  @param      key     NVS id
+ *  @param      val     Receives the value; unchanged on failure
+ *  @return     Success status
+ */
+bool read_key(KeyName key, int32_t& val)
+{
+	int32_t stored;
+	if (read_key(key, &stored, sizeof(stored)) != (ssize_t)sizeof(stored)) {
+		return false;
+	}
+
+	val = stored;
+
+	return true;
+}
+
+/**
+ *  @brief      Writes a key-value pair to persistent storage.
+ *  @author     Lau Lee Hong
+ *  @param      key     NVS id
+ *  @param      data    Value to be stored under key
+ *  @param      len     Size of value in bytes
+ *  @return     Success status
+ *  @details    PersistKey entries are updated in the cache and written to flash after PERSIST_FLUSH_DELAY_MS,
+ *              so that a burst of writes results in a single flash write per key. Writes of an unchanged
+ *              value are skipped. Use flush_persist_storage for values that must not be lost to a reset.
+ *  @note       Values are never logged, as some (e.g. private keys) are secret
+ */
+bool write_key(KeyName key, const void* data, size_t len)
+{
+	k_mutex_lock(&cache_mutex, K_FOREVER);
+	struct cache_entry* entry = find_cache_entry(key);
+	if (!entry) {
+		k_mutex_unlock(&cache_mutex);
+		return nvs_write_key(key, data, len);
 	}
 
-	return std::string((const char*)buffer);
-}
\ No newline at end of file
+	if (entry->present && entry->value.size() == len && memcmp(entry->value.data(), data, len) == 0) {
+		stats.writes_avoided++;
+		k_mutex_unlock(&cache_mutex);
+		LOG_DBG("Key %d unchanged - write skipped", key);
+		return true;
+	}
+
+	if (entry->dirty) {
+		/* Previous value was never written to flash */
+		stats.writes_coalesced++;
+	}
+
+	entry->value.assign((const char*)data, len);
+	entry->present = true;
+	entry->dirty = true;
+	k_mutex_unlock(&cache_mutex);
+
+	/* Resubmitting restarts the delay, so flushes happen once writes have settled */
+	k_delayed_work_submit(&flush_work, K_MSEC(PERSIST_FLUSH_DELAY_MS));
+
+	return true;
+}
+
+/**
+ *  @brief      String overload for write_key.
+ *  @author     Lau Lee Hong
+ *  @param      key     NVS id
+ *  @param      val     String value to be stored under key (may contain binary data)
+ *  @return     Success status
+ */
+bool write_key(KeyName key, const std::string& val)
+{
+	return write_key(key, val.data(), val.size());
+}
+
+/**
+ *  @brief      Integer overload for write_key.
+ *  @author     Lau Lee Hong
+ *  @param      key     NVS id
+ *  @param      val     Integer value to be stored under key
+ *  @return     Success status
+ */
+bool write_key(KeyName key, int32_t val)
+{
+	return write_key(key, &val, sizeof(val));
+}
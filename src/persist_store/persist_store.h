@@ -19,16 +19,60 @@
 #include <string>
 #include <zephyr.h>
 
+typedef const int KeyName;
+
+/* List of id key used in NVS */
+namespace PersistKey
+{
+KeyName SW_VER = 1;
+KeyName SSL_CLIENT_CERTIFICATE = 2;
+KeyName SSL_CLIENT_CERTIFICATE_SERIAL_NUMBER = 3;
+KeyName SSL_PRIVATE_KEY = 4;
+KeyName DECADA_DEVICE_SECRET = 5;
+KeyName RUNTIME_CONFIG = 6;
+} // namespace PersistKey
+
+/* Range of PersistKey ids held in the RAM cache; update when adding keys */
+#define PERSIST_KEY_MIN_ID (1)
+#define PERSIST_KEY_MAX_ID (6)
+
+/* Flash wear statistics since boot, reported with the runtime metrics (see diagnostics/metrics.h) */
+struct persist_store_stats {
+	/* Values written to flash */
+	uint32_t flash_writes;
+	/* Writes skipped as the value was unchanged */
+	uint32_t writes_avoided;
+	/* Writes superseded by a later write before being flushed */
+	uint32_t writes_coalesced;
+	/* Writes that caused NVS to garbage collect a sector */
+	uint32_t gc_events;
+	/* Reads served from the cache */
+	uint32_t cache_reads;
+};
+
 void init_persist_storage(void);
+void flush_persist_storage(void);
+persist_store_stats get_persist_store_stats(void);
+
+/* Typed access by key; values are never logged */
+ssize_t get_key_size(KeyName key);
+ssize_t read_key(KeyName key, void* data, size_t len);
+bool read_key(KeyName key, std::string& val);
+bool read_key(KeyName key, int32_t& val);
+bool write_key(KeyName key, const void* data, size_t len);
+bool write_key(KeyName key, const std::string& val);
+bool write_key(KeyName key, int32_t val);
 
 void write_sw_ver(const std::string sw_ver);
 void write_client_certificate(const std::string cert);
 void write_client_certificate_serial_number(const std::string cert_sn);
 void write_client_private_key(const std::string private_key);
+void write_device_secret(const std::string device_secret);
 
 std::string read_sw_ver(void);
 std::string read_client_certificate(void);
 std::string read_client_certificate_serial_number(void);
 std::string read_client_private_key(void);
+std::string read_device_secret(void);
 
 #endif // _PERSIST_STORE_H_
\ No newline at end of file
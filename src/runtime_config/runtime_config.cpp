@@ -0,0 +1,215 @@
+#include <logging/log.h>
+LOG_MODULE_REGISTER(runtime_config, LOG_LEVEL_DBG);
+
+#include <string.h>
+#include <sys/atomic.h>
+#include "persist_store/persist_store.h"
+#include "runtime_config.h"
+#include "user_config.h"
+
+#if defined(USER_CONFIG_SOAK_SAMPLE_RATE_HZ)
+/* Soak tests sample at a fixed rate and publish without pausing */
+#define DEFAULT_POLL_RATE_MS	    MAX(1, MSEC_PER_SEC / (USER_CONFIG_SOAK_SAMPLE_RATE_HZ))
+#define DEFAULT_PUBLISH_INTERVAL_MS (0)
+#else
+#define DEFAULT_POLL_RATE_MS	    (USER_CONFIG_SENSOR_POLL_RATE_MS)
+#define DEFAULT_PUBLISH_INTERVAL_MS (USER_CONFIG_PUBLISH_INTERVAL_MS)
+#endif
+
+struct runtime_config_param_def {
+	/* Output parameter reporting the result in the service response */
+	const char* result_name;
+	int32_t min;
+	int32_t max;
+};
+
+const char* const runtime_config_names[RUNTIME_CONFIG_PARAM_COUNT] = {
+	"sensor_poll_rate",
+	"publish_batch_size",
+	"publish_interval",
+	"sensor_deadband",
+};
+
+/* Upper bounds keep both threads checking in well within their watchdog deadlines */
+static const struct runtime_config_param_def param_defs[RUNTIME_CONFIG_PARAM_COUNT] = {
+	{ "poll_rate_updated", 100, 60 * 60 * MSEC_PER_SEC },
+	{ "batch_size_updated", 1, 32 },
+	{ "publish_interval_updated", 0, 10 * MSEC_PER_SEC },
+	{ "deadband_updated", 0, INT32_MAX },
+};
+
+static atomic_t values[RUNTIME_CONFIG_PARAM_COUNT] = {
+	ATOMIC_INIT(DEFAULT_POLL_RATE_MS),
+	ATOMIC_INIT(USER_CONFIG_PUBLISH_BATCH_SIZE),
+	ATOMIC_INIT(DEFAULT_PUBLISH_INTERVAL_MS),
+	ATOMIC_INIT(USER_CONFIG_SENSOR_DEADBAND),
+};
+
+/* Odd while an update is being written; the snapshot version is derived from it */
+static atomic_t sequence = ATOMIC_INIT(0);
+/* Serializes updates */
+K_MUTEX_DEFINE(update_mutex);
+
+/**
+ * @brief	Write a value for readers to pick up
+ * @author	Lee Tze Han
+ * @param	param	Parameter to update
+ * @param	value	New value, already validated
+ * @note	Must be called with update_mutex held
+ */
+static void publish_value(runtime_config_param param, int32_t value)
+{
+	atomic_inc(&sequence);
+	atomic_set(&values[param], value);
+	atomic_inc(&sequence);
+}
+
+/**
+ * @brief	Check a value against the range of a parameter
+ * @author	Lee Tze Han
+ * @param	param	Parameter to check against
+ * @param	value	Value to check
+ * @return	True if the value is in range
+ */
+static bool is_valid(runtime_config_param param, int32_t value)
+{
+	return value >= param_defs[param].min && value <= param_defs[param].max;
+}
+
+/**
+ * @brief	Save the current values to persistent storage
+ * @author	Lee Tze Han
+ * @note	Must be called with update_mutex held
+ */
+static void save_values(void)
+{
+#if defined(USER_CONFIG_RUNTIME_CONFIG_PERSIST)
+	int32_t saved[RUNTIME_CONFIG_PARAM_COUNT];
+	for (int i = 0; i < RUNTIME_CONFIG_PARAM_COUNT; i++) {
+		saved[i] = atomic_get(&values[i]);
+	}
+
+	if (!write_key(PersistKey::RUNTIME_CONFIG, saved, sizeof(saved))) {
+		LOG_WRN("Failed to save runtime configuration");
+	}
+#endif
+}
+
+/**
+ * @brief	Restore values saved by earlier updates
+ * @author	Lee Tze Han
+ * @details	Values are stored in runtime_config_param order, so parameters added by later firmware
+ * 		keep their defaults. Out-of-range values are ignored.
+ * @note	Persistent storage must be initialized first
+ */
+void runtime_config::load(void)
+{
+#if defined(USER_CONFIG_RUNTIME_CONFIG_PERSIST) && !defined(USER_CONFIG_SOAK_SAMPLE_RATE_HZ)
+	int32_t saved[RUNTIME_CONFIG_PARAM_COUNT];
+	ssize_t len = read_key(PersistKey::RUNTIME_CONFIG, saved, sizeof(saved));
+	if (len <= 0) {
+		return;
+	}
+
+	k_mutex_lock(&update_mutex, K_FOREVER);
+	for (int i = 0; i < MIN(len / (ssize_t)sizeof(int32_t), RUNTIME_CONFIG_PARAM_COUNT); i++) {
+		if (is_valid((runtime_config_param)i, saved[i])) {
+			publish_value((runtime_config_param)i, saved[i]);
+			LOG_INF("Restored %s = %d", runtime_config_names[i], saved[i]);
+		}
+		else {
+			LOG_WRN("Ignoring saved %s = %d (out of range)", runtime_config_names[i], saved[i]);
+		}
+	}
+	k_mutex_unlock(&update_mutex);
+#endif
+}
+
+/**
+ * @brief	Update a parameter
+ * @author	Lee Tze Han
+ * @param	param	Parameter to update
+ * @param	value	New value
+ * @return	True if the value is in range and was applied
+ * @details	The value is saved to persistent storage if USER_CONFIG_RUNTIME_CONFIG_PERSIST is defined.
+ */
+bool runtime_config::set(runtime_config_param param, int32_t value)
+{
+	if (!is_valid(param, value)) {
+		LOG_WRN("Rejected %s = %d (range %d - %d)", runtime_config_names[param], value, param_defs[param].min,
+			param_defs[param].max);
+		return false;
+	}
+
+	k_mutex_lock(&update_mutex, K_FOREVER);
+	bool changed = atomic_get(&values[param]) != value;
+	if (changed) {
+		publish_value(param, value);
+		save_values();
+	}
+	k_mutex_unlock(&update_mutex);
+
+	LOG_INF("Runtime config %s = %d%s", runtime_config_names[param], value, changed ? "" : " (unchanged)");
+
+	return true;
+}
+
+/**
+ * @brief	Look up a parameter by name
+ * @author	Lee Tze Han
+ * @param	name	Name used in service commands
+ * @return	runtime_config_param, or -1 if there is no parameter with the name
+ */
+int runtime_config::find(const char* name)
+{
+	for (int i = 0; i < RUNTIME_CONFIG_PARAM_COUNT; i++) {
+		if (strcmp(runtime_config_names[i], name) == 0) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * @brief	Get the output parameter reporting the result of an update
+ * @author	Lee Tze Han
+ * @param	param	Parameter updated
+ * @return	Name of the output parameter in the DECADA model
+ */
+const char* runtime_config::get_result_name(runtime_config_param param)
+{
+	return param_defs[param].result_name;
+}
+
+/**
+ * @brief	Bring a snapshot up to date
+ * @author	Lee Tze Han
+ * @param	snapshot	Snapshot owned by the calling thread
+ * @return	True if the snapshot was updated
+ * @details	Wait-free: the snapshot is left as it is if an update is in progress or completes while
+ * 		copying, and picked up by a later call.
+ */
+bool runtime_config::refresh(runtime_config_snapshot& snapshot)
+{
+	atomic_val_t seq = atomic_get(&sequence);
+	uint32_t version = seq / 2 + 1;
+
+	if (snapshot.version == version || (seq & 1)) {
+		return false;
+	}
+
+	int32_t copy[RUNTIME_CONFIG_PARAM_COUNT];
+	for (int i = 0; i < RUNTIME_CONFIG_PARAM_COUNT; i++) {
+		copy[i] = atomic_get(&values[i]);
+	}
+
+	if (atomic_get(&sequence) != seq) {
+		return false;
+	}
+
+	memcpy(snapshot.values, copy, sizeof(copy));
+	snapshot.version = version;
+
+	return true;
+}
@@ -0,0 +1,58 @@
+/*******************************************************************************************************
+ * Copyright (c) 2021 Government Technology Agency of Singapore (GovTech)
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied.
+ *
+ * See the License for the specific language governing permissions and limitations under the License.
+ *******************************************************************************************************/
+#ifndef _RUNTIME_CONFIG_H_
+#define _RUNTIME_CONFIG_H_
+
+#include <zephyr.h>
+
+/*
+ * Parameters tuned at runtime through DECADA service commands, with defaults in user_config.h.
+ * Updates are rare and serialized. Hot threads keep their own snapshot and call refresh once per
+ * iteration: when nothing has changed this is a single atomic load, and it never blocks or retries.
+ * If an update lands while a snapshot is being copied, the previous snapshot is kept until the next
+ * call.
+ */
+enum runtime_config_param {
+	/* Period between samples of the behavior manager (ms) */
+	RUNTIME_CONFIG_POLL_RATE_MS,
+	/* Samples published by the communications thread before each pause */
+	RUNTIME_CONFIG_PUBLISH_BATCH_SIZE,
+	/* Pause of the communications thread after each batch (ms) */
+	RUNTIME_CONFIG_PUBLISH_INTERVAL_MS,
+	/* Samples closer than this to the last sample sent are not published; 0 sends every sample */
+	RUNTIME_CONFIG_SENSOR_DEADBAND,
+	RUNTIME_CONFIG_PARAM_COUNT
+};
+
+struct runtime_config_snapshot {
+	/* Incremented by every update; 0 for a snapshot that has not been refreshed yet */
+	uint32_t version;
+	int32_t values[RUNTIME_CONFIG_PARAM_COUNT];
+};
+
+/* Parameter names in service commands, indexed by runtime_config_param */
+extern const char* const runtime_config_names[RUNTIME_CONFIG_PARAM_COUNT];
+
+namespace runtime_config
+{
+void load(void);
+bool set(runtime_config_param param, int32_t value);
+int find(const char* name);
+const char* get_result_name(runtime_config_param param);
+bool refresh(runtime_config_snapshot& snapshot);
+} // namespace runtime_config
+
+#endif // _RUNTIME_CONFIG_H_
@@ -0,0 +1,95 @@
+#include <logging/log.h>
+LOG_MODULE_REGISTER(status_leds, LOG_LEVEL_DBG);
+
+#include <device.h>
+#include <drivers/gpio.h>
+#include "log_ratelimit/log_ratelimit.h"
+#include "status_leds.h"
+
+LOG_RATELIMIT_REGISTER();
+
+#define LED0_NODE DT_ALIAS(led0)
+#define LED1_NODE DT_ALIAS(led1)
+#define LED2_NODE DT_ALIAS(led2)
+
+static bool led_is_on[STATUS_LED_COUNT];
+
+#if DT_NODE_HAS_STATUS(LED0_NODE, okay) && DT_NODE_HAS_STATUS(LED1_NODE, okay) && DT_NODE_HAS_STATUS(LED2_NODE, okay)
+
+#define LED0   DT_GPIO_LABEL(LED0_NODE, gpios)
+#define PIN0   DT_GPIO_PIN(LED0_NODE, gpios)
+#define FLAGS0 DT_GPIO_FLAGS(LED0_NODE, gpios)
+#define LED1   DT_GPIO_LABEL(LED1_NODE, gpios)
+#define PIN1   DT_GPIO_PIN(LED1_NODE, gpios)
+#define FLAGS1 DT_GPIO_FLAGS(LED1_NODE, gpios)
+#define LED2   DT_GPIO_LABEL(LED2_NODE, gpios)
+#define PIN2   DT_GPIO_PIN(LED2_NODE, gpios)
+#define FLAGS2 DT_GPIO_FLAGS(LED2_NODE, gpios)
+
+static const struct device* led_arr[STATUS_LED_COUNT];
+static const int pin_arr[] = { PIN0, PIN1, PIN2 };
+static const int flags_arr[] = { FLAGS0, FLAGS1, FLAGS2 };
+
+/**
+ * @brief	Initialize GPIO LEDs.
+ * @author	Lau Lee Hong
+ * @return	Success status
+ */
+bool status_leds::init(void)
+{
+	led_arr[0] = device_get_binding(LED0);
+	led_arr[1] = device_get_binding(LED1);
+	led_arr[2] = device_get_binding(LED2);
+	if (led_arr[0] == NULL || led_arr[1] == NULL || led_arr[2] == NULL) {
+		LOG_ERR("Failed to get LED device bindings");
+		return false;
+	}
+
+	for (int i = 0; i < STATUS_LED_COUNT; i++) {
+		int ret = gpio_pin_configure(led_arr[i], pin_arr[i], GPIO_OUTPUT_ACTIVE | flags_arr[i]);
+		if (ret < 0) {
+			LOG_ERR("Failed to configure LED %d: %d", i, ret);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief	Set the LED to its stored state and invert the stored state.
+ * @author	Lau Lee Hong
+ * @param	led_id	Index of LED (0 to STATUS_LED_COUNT - 1)
+ */
+void status_leds::toggle(int led_id)
+{
+	gpio_pin_set(led_arr[led_id], pin_arr[led_id], (int)led_is_on[led_id]);
+	led_is_on[led_id] = !led_is_on[led_id];
+}
+
+#else
+
+/**
+ * @brief	Initialize emulated LEDs.
+ * @author	Lau Lee Hong
+ * @return	Success status
+ */
+bool status_leds::init(void)
+{
+	LOG_INF("No GPIO LEDs in devicetree - LED states will be logged");
+
+	return true;
+}
+
+/**
+ * @brief	Log the LED state and invert the stored state.
+ * @author	Lau Lee Hong
+ * @param	led_id	Index of LED (0 to STATUS_LED_COUNT - 1)
+ */
+void status_leds::toggle(int led_id)
+{
+	LOG_DBG_RATELIMIT("LED %d: %s", led_id, led_is_on[led_id] ? "on" : "off");
+	led_is_on[led_id] = !led_is_on[led_id];
+}
+
+#endif
@@ -0,0 +1,34 @@
+/*******************************************************************************************************
+ * Copyright (c) 2021 Government Technology Agency of Singapore (GovTech)
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied.
+ *
+ * See the License for the specific language governing permissions and limitations under the License.
+ *******************************************************************************************************/
+#ifndef _STATUS_LEDS_H_
+#define _STATUS_LEDS_H_
+
+#include <zephyr.h>
+
+#define STATUS_LED_COUNT 3
+
+/*
+ * Boards with led0 - led2 aliases in their devicetree drive GPIO LEDs.
+ * Other boards (e.g. native_posix) fall back to logging LED state changes.
+ */
+
+namespace status_leds
+{
+bool init(void);
+void toggle(int led_id);
+} // namespace status_leds
+
+#endif // _STATUS_LEDS_H_
@@ -0,0 +1,29 @@
+/*******************************************************************************************************
+ * Copyright (c) 2021 Government Technology Agency of Singapore (GovTech)
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied.
+ *
+ * See the License for the specific language governing permissions and limitations under the License.
+ *******************************************************************************************************/
+#ifndef _THREADING_ALT_H_
+#define _THREADING_ALT_H_
+
+#include <zephyr.h>
+
+/*
+ * Mutex type for MBEDTLS_THREADING_ALT, included by mbedTLS itself. The lock functions are registered
+ * by crypto_engine/mbedtls_threading.cpp before the mbedTLS heap is initialized.
+ */
+typedef struct mbedtls_threading_mutex_t {
+	struct k_mutex mutex;
+} mbedtls_threading_mutex_t;
+
+#endif // _THREADING_ALT_H_
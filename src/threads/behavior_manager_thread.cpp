@@ -2,95 +2,103 @@
 LOG_MODULE_REGISTER(behavior_manager_thread, LOG_LEVEL_DBG);
 
 #include "ArduinoJson.hpp"
+#include <stdlib.h>
 #include <zephyr.h>
-#include <device.h>
-#include <drivers/gpio.h>
-#include <drivers/watchdog.h>
 #include "conversions/conversions.h"
 #include "device_uuid/device_uuid.h"
+#include "diagnostics/alloc_profiler.h"
+#include "diagnostics/metrics.h"
+#include "diagnostics/sample_trace.h"
+#include "log_ratelimit/log_ratelimit.h"
+#include "runtime_config/runtime_config.h"
+#include "sensor_sample.h"
+#include "status_leds/status_leds.h"
 #include "threads.h"
 #include "time_engine/time_engine.h"
-#include "watchdog_config/watchdog_config.h"
-
-#define LED0_NODE DT_ALIAS(led0)
-#define LED1_NODE DT_ALIAS(led1)
-#define LED2_NODE DT_ALIAS(led2)
-
-#define LED0   DT_GPIO_LABEL(LED0_NODE, gpios)
-#define PIN0   DT_GPIO_PIN(LED0_NODE, gpios)
-#define FLAGS0 DT_GPIO_FLAGS(LED0_NODE, gpios)
-#define LED1   DT_GPIO_LABEL(LED1_NODE, gpios)
-#define PIN1   DT_GPIO_PIN(LED1_NODE, gpios)
-#define FLAGS1 DT_GPIO_FLAGS(LED1_NODE, gpios)
-#define LED2   DT_GPIO_LABEL(LED2_NODE, gpios)
-#define PIN2   DT_GPIO_PIN(LED2_NODE, gpios)
-#define FLAGS2 DT_GPIO_FLAGS(LED2_NODE, gpios)
+#include "user_config.h"
+#include "watchdog_config/task_watchdog.h"
+
+LOG_RATELIMIT_REGISTER();
+
+/**
+ *  @brief	Sleep for the sensor poll period, checking in with the task watchdog along the way
+ *  @author	Lee Tze Han
+ *  @param	wdt_task_id	Task watchdog ID of the thread
+ *  @param	poll_rate_ms	Sensor poll period (ms)
+ */
+static void sleep_until_next_sample(int wdt_task_id, int32_t poll_rate_ms)
+{
+	task_watchdog::check_in(wdt_task_id);
+
+	while (poll_rate_ms > THREAD_CHECK_IN_PERIOD_MS) {
+		k_msleep(THREAD_CHECK_IN_PERIOD_MS);
+		task_watchdog::check_in(wdt_task_id);
+		poll_rate_ms -= THREAD_CHECK_IN_PERIOD_MS;
+	}
+	k_msleep(poll_rate_ms);
+}
 
 void execute_behavior_manager_thread(int watchdog_id)
 {
-	const int sleep_time_ms = 10 * MSEC_PER_SEC;
-	const struct device* wdt = watchdog_config::get_device_instance();
-	const int wdt_channel_id = watchdog_id;
-
-	const std::string decada_protocol_version = "1.0";
-	const std::string decada_method_of_device = "thing.measurepoint.post";
-
-	/* Init GPIO LEDs */
-	const struct device* led0;
-	const struct device* led1;
-	const struct device* led2;
-	int ret;
-	led0 = device_get_binding(LED0);
-	led1 = device_get_binding(LED1);
-	led2 = device_get_binding(LED2);
-	if (led0 == NULL || led1 == NULL || led2 == NULL) {
+	const int wdt_task_id = watchdog_id;
+	AllocScope alloc_scope(ALLOC_MODULE_BEHAVIOR_MANAGER);
+
+	/* Init LEDs */
+	if (!status_leds::init()) {
 		return;
 	}
-	bool led_is_on[] = { false, false, false };
-	const struct device* led_arr[] = { led0, led1, led2 };
-	int pin_arr[] = { PIN0, PIN1, PIN2 };
-	int flags_arr[] = { FLAGS0, FLAGS1, FLAGS2 };
 	int current_led_id = 0;
-	for (int i = 0; i < 3; i++) {
-		ret = gpio_pin_configure(led_arr[i], pin_arr[i], GPIO_OUTPUT_ACTIVE | flags_arr[i]);
-		if (ret < 0) {
-			return;
-		}
-	}
 
 	TimeEngine pseudo_sensor;
 	std::string sensor_data;
 
+	/* Poll rate and deadband, refreshed from runtime_config once per sample */
+	struct runtime_config_snapshot config = {};
+	bool sample_sent = false;
+	int64_t last_sent_reading = 0;
+
 	/* Wait for DECADA connection to be up before continuing */
 	k_poll(decada_connect_ok_events, 1, K_FOREVER);
 
 	while (true) {
+		alloc_profiler::iteration_begin(ALLOC_LOOP_BEHAVIOR_MANAGER);
+		runtime_config::refresh(config);
+
 		/* Moving LEDs example*/
-		gpio_pin_set(led_arr[current_led_id], pin_arr[current_led_id], (int)led_is_on[current_led_id]);
-		led_is_on[current_led_id] = !led_is_on[current_led_id];
-		current_led_id = (current_led_id + 1) % 3;
+		status_leds::toggle(current_led_id);
+		current_led_id = (current_led_id + 1) % STATUS_LED_COUNT;
 
 		/* Use timestamp as a dummy sensor reading */
+		struct sample_trace_record trace;
+		sample_trace::begin(trace);
+		metric_timer sample_timer = metrics::start_timer();
 		sensor_data = pseudo_sensor.get_timestamp_s_str();
-		LOG_DBG("sensor_data: %s", sensor_data.c_str());
+		LOG_DBG_RATELIMIT("sensor_data: %s", log_strdup(sensor_data.c_str()));
+
+		/* Readings within the deadband of the last one sent are not published */
+		int64_t reading = strtoll(sensor_data.c_str(), NULL, 10);
+		int32_t deadband = config.values[RUNTIME_CONFIG_SENSOR_DEADBAND];
+		if (deadband > 0 && sample_sent && llabs(reading - last_sent_reading) < deadband) {
+			metrics::observe_since(METRIC_SAMPLE_GENERATION, sample_timer);
+			metrics::increment(METRIC_SAMPLES_GENERATED);
+			alloc_profiler::iteration_end(ALLOC_LOOP_BEHAVIOR_MANAGER);
+			sleep_until_next_sample(wdt_task_id, config.values[RUNTIME_CONFIG_POLL_RATE_MS]);
+			continue;
+		}
+		sample_sent = true;
+		last_sent_reading = reading;
 
 		/* Format data into DECADA-compliant JSON */
-		ArduinoJson::DynamicJsonDocument params(64);
-		params["measurepoints"]["chronos_s"] = sensor_data;
-
-		ArduinoJson::DynamicJsonDocument json(512);
-		json["id"] = device_uuid;
-		json["version"] = decada_protocol_version;
-		json["params"] = params;
-		json["method"] = decada_method_of_device;
-
-		std::string json_body;
-		ArduinoJson::serializeJson(json, json_body);
+		ArduinoJson::DynamicJsonDocument json(SAMPLE_JSON_CAPACITY);
+		build_sample_json(device_uuid, sensor_data, json);
+		metrics::observe_since(METRIC_SAMPLE_GENERATION, sample_timer);
+		metrics::increment(METRIC_SAMPLES_GENERATED);
 
-		/* Data is placed on the heap */
-		int buf_len = json_body.size();
-		char* buf = (char*)malloc(buf_len);
-		memcpy(buf, json_body.c_str(), buf_len);
+		sample_trace::mark(trace, SAMPLE_TRACE_SERIALIZE);
+		metric_timer serialize_timer = metrics::start_timer();
+		size_t buf_len;
+		char* buf = serialize_sample(json, buf_len);
+		metrics::observe_since(METRIC_SERIALIZATION, serialize_timer);
 
 		/* Populate Mailbox and send data to CommunicationsThread */
 		struct k_mbox_msg send_msg;
@@ -99,9 +107,12 @@ void execute_behavior_manager_thread(int watchdog_id)
 		send_msg.tx_data = buf;
 		send_msg.tx_block.data = NULL;
 		send_msg.tx_target_thread = K_ANY;
+		sample_trace::mark(trace, SAMPLE_TRACE_ENQUEUE);
+		memcpy(buf, &trace, sizeof(trace));
 		k_mbox_async_put(&data_mailbox, &send_msg, NULL);
+		metrics::gauge_add(METRIC_QUEUE_DEPTH, 1);
+		alloc_profiler::iteration_end(ALLOC_LOOP_BEHAVIOR_MANAGER);
 
-		wdt_feed(wdt, wdt_channel_id);
-		k_msleep(sleep_time_ms);
+		sleep_until_next_sample(wdt_task_id, config.values[RUNTIME_CONFIG_POLL_RATE_MS]);
 	}
 }
\ No newline at end of file
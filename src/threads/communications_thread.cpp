@@ -4,16 +4,30 @@ LOG_MODULE_REGISTER(communications_thread, LOG_LEVEL_DBG);
 #include <net/tls_credentials.h>
 #include <power/reboot.h>
 #include <time.h>
+#include "boot_pipeline/boot_pipeline.h"
 #include "decada_manager/decada_manager.h"
 #include "device_uuid/device_uuid.h"
+#include "diagnostics/alloc_profiler.h"
+#include "diagnostics/boot_profiler.h"
+#include "diagnostics/cpu_profiler.h"
+#include "diagnostics/metrics.h"
+#include "diagnostics/sample_trace.h"
+#include "diagnostics/soak_report.h"
+#include "diagnostics/stack_monitor.h"
+#include "diagnostics/tls_heap_monitor.h"
+#include "log_ratelimit/log_ratelimit.h"
 #include "networking/http/http_request.h"
+#include "networking/fault/net_fault.h"
 #include "networking/http/http_response.h"
 #include "networking/wifi/wifi_connect.h"
 #include "persist_store/persist_store.h"
+#include "runtime_config/runtime_config.h"
 #include "threads.h"
 #include "time_engine/time_manager.h"
 #include "tls_certs.h"
-#include "watchdog_config/watchdog_config.h"
+#include "watchdog_config/task_watchdog.h"
+
+LOG_RATELIMIT_REGISTER();
 
 /* Sensor readings topic */
 const std::string sensor_pub_topic =
@@ -23,9 +37,27 @@ const std::string decada_service_topic =
 	std::string("/sys/") + USER_CONFIG_DECADA_PRODUCT_KEY + "/" + device_uuid + "/thing/service/";
 /* DECADA Service - Sensor poll rate */
 const std::string sensor_poll_topic = decada_service_topic + "sensorpollrate";
+/* DECADA Service - Runtime configuration (see runtime_config/runtime_config.h) */
+const std::string runtime_config_topic = decada_service_topic + "runtimeconfig";
+
+/* Boot report topic */
+const std::string boot_report_pub_topic =
+	std::string("/sys/") + USER_CONFIG_DECADA_PRODUCT_KEY + "/" + device_uuid + "/thing/event/boot_report/post";
+
+/* Runtime metrics topic */
+const std::string metrics_pub_topic =
+	std::string("/sys/") + USER_CONFIG_DECADA_PRODUCT_KEY + "/" + device_uuid + "/thing/event/metrics/post";
+
+/* Stack usage topic */
+const std::string stack_usage_pub_topic =
+	std::string("/sys/") + USER_CONFIG_DECADA_PRODUCT_KEY + "/" + device_uuid + "/thing/event/stack_usage/post";
+
+/* CPU usage topic */
+const std::string cpu_usage_pub_topic =
+	std::string("/sys/") + USER_CONFIG_DECADA_PRODUCT_KEY + "/" + device_uuid + "/thing/event/cpu_usage/post";
 
 /* Topics to subscribe to */
-std::vector<std::string> subscription_topics = { sensor_poll_topic };
+std::vector<std::string> subscription_topics = { sensor_poll_topic, runtime_config_topic };
 
 struct k_poll_signal decada_connect_ok_signal;
 struct k_poll_event decada_connect_ok_events[] = {
@@ -50,49 +82,180 @@ void add_tls_ca_certs(void)
 	}
 }
 
-void execute_communications_thread(int watchdog_id)
-{
-	const int sleep_time_ms = 250;
-	const struct device* wdt = watchdog_config::get_device_instance();
-	const int wdt_channel_id = watchdog_id;
-	const int rx_buf_size = 512;
+/* State shared by the boot stages of the communications thread */
+struct comms_boot_ctx {
+	DecadaManager* decada_manager;
+	TimeManager* time_manager;
+};
 
-	k_poll_signal_init(&wifi_signal);
-	k_poll_signal_init(&decada_connect_ok_signal);
+enum comms_boot_stage_id {
+	BOOT_WIFI,
+	BOOT_CA_CERTS,
+	BOOT_PERSIST_STORE,
+	BOOT_CREDENTIALS,
+	BOOT_KEYPAIR,
+	BOOT_DNS_PREFETCH,
+	BOOT_SNTP,
+	BOOT_PROVISION,
+	BOOT_MQTT_CONNECT,
+	BOOT_SUBSCRIBE,
+	BOOT_STAGE_COUNT,
+};
+
+static bool boot_wifi(void* ctx)
+{
+	ARG_UNUSED(ctx);
 
 	/* Setup WiFi connection */
+	boot_profiler::begin(BOOT_PROFILE_WIFI_ASSOCIATION);
 	wifi_mgmt_event_init();
 	wifi_connect();
 
 	/* Block until WiFi connection is established */
 	k_poll(wifi_events, 1, K_FOREVER);
-	wdt_feed(wdt, wdt_channel_id);
+	boot_profiler::end(BOOT_PROFILE_WIFI_ASSOCIATION);
+
+	return true;
+}
+
+static bool boot_ca_certs(void* ctx)
+{
+	ARG_UNUSED(ctx);
 
 	/* Add recognized CA certificates to secure socket layer */
+	boot_profiler::begin(BOOT_PROFILE_TLS_CREDENTIALS);
 	add_tls_ca_certs();
+	boot_profiler::end(BOOT_PROFILE_TLS_CREDENTIALS);
 
-	TimeManager time_manager;
-	time_manager.sync_sntp_rtc();
-	wdt_feed(wdt, wdt_channel_id);
+	return true;
+}
 
+static bool boot_persist_store(void* ctx)
+{
+	ARG_UNUSED(ctx);
+
+	boot_profiler::begin(BOOT_PROFILE_NVS_INIT);
 	init_persist_storage();
+	boot_profiler::end(BOOT_PROFILE_NVS_INIT);
 	write_sw_ver("R1.0.0");
 
-	DecadaManager decada_manager(wdt_channel_id);
-	wdt_feed(wdt, wdt_channel_id);
+	/* Apply configuration saved by earlier service commands */
+	runtime_config::load();
+
+	return true;
+}
+
+static bool boot_credentials(void* ctx)
+{
+	static_cast<comms_boot_ctx*>(ctx)->decada_manager->load_credentials();
+
+	/* Missing credentials are handled by generating a keypair */
+	return true;
+}
+
+static bool boot_keypair(void* ctx)
+{
+	return static_cast<comms_boot_ctx*>(ctx)->decada_manager->prepare_keypair();
+}
+
+static bool boot_dns_prefetch(void* ctx)
+{
+	static_cast<comms_boot_ctx*>(ctx)->decada_manager->prefetch_dns();
+
+	/* Hostnames that could not be prefetched are resolved again on use */
+	return true;
+}
+
+static bool boot_sntp(void* ctx)
+{
+	boot_profiler::begin(BOOT_PROFILE_SNTP_SYNC);
+	static_cast<comms_boot_ctx*>(ctx)->time_manager->sync_sntp_rtc();
+	boot_profiler::end(BOOT_PROFILE_SNTP_SYNC);
+
+	return true;
+}
+
+static bool boot_provision(void* ctx)
+{
+	static_cast<comms_boot_ctx*>(ctx)->decada_manager->provision();
+
+	return true;
+}
+
+static bool boot_mqtt_connect(void* ctx)
+{
+	return static_cast<comms_boot_ctx*>(ctx)->decada_manager->connect();
+}
+
+static bool boot_subscribe(void* ctx)
+{
+	static_cast<comms_boot_ctx*>(ctx)->decada_manager->subscribe(subscription_topics);
+
+	return true;
+}
+
+/*
+ * Boot stages of the communications thread. Stages using the CryptoEngine state of DecadaManager
+ * (credentials, keypair, provision, MQTT connect) are chained through their dependencies and only
+ * overlap with stages waiting on the network or flash. Stages making TLS connections run on the
+ * communications thread for its larger stack. Stages on worker threads are given a timeout, after
+ * which the communications thread stops checking in and the task watchdog resets the device; stages on
+ * the communications thread check in themselves. Entries are indexed by comms_boot_stage_id.
+ */
+static const struct boot_stage comms_boot_stages[BOOT_STAGE_COUNT] = {
+	{ "wifi", boot_wifi, 0, false, 2 * 60 * MSEC_PER_SEC },
+	{ "ca_certs", boot_ca_certs, 0, false, 5 * MSEC_PER_SEC },
+	{ "persist_store", boot_persist_store, 0, false, 10 * MSEC_PER_SEC },
+	{ "credentials", boot_credentials, BOOT_DEP(BOOT_PERSIST_STORE), false, 10 * MSEC_PER_SEC },
+	{ "keypair", boot_keypair, BOOT_DEP(BOOT_CREDENTIALS), false, 60 * MSEC_PER_SEC },
+	{ "dns_prefetch", boot_dns_prefetch, BOOT_DEP(BOOT_WIFI), false, 30 * MSEC_PER_SEC },
+	{ "sntp", boot_sntp, BOOT_DEP(BOOT_WIFI), false, 60 * MSEC_PER_SEC },
+	{ "provision", boot_provision,
+	  BOOT_DEP(BOOT_CA_CERTS) | BOOT_DEP(BOOT_KEYPAIR) | BOOT_DEP(BOOT_DNS_PREFETCH) | BOOT_DEP(BOOT_SNTP), true,
+	  0 },
+	{ "mqtt_connect", boot_mqtt_connect, BOOT_DEP(BOOT_PROVISION), true, 0 },
+	{ "subscribe", boot_subscribe, BOOT_DEP(BOOT_MQTT_CONNECT), true, 0 },
+};
+
+void execute_communications_thread(int watchdog_id)
+{
+#if defined(USER_CONFIG_SOAK_SAMPLE_RATE_HZ)
+	int64_t next_soak_report_ms = k_uptime_get();
+#endif
+	const int wdt_task_id = watchdog_id;
+	const int rx_buf_size = sizeof(struct sample_trace_record) + 512;
+	AllocScope alloc_scope(ALLOC_MODULE_COMMUNICATIONS);
+
+	k_poll_signal_init(&wifi_signal);
+	k_poll_signal_init(&decada_connect_ok_signal);
+
+	TimeManager time_manager;
+	DecadaManager decada_manager(wdt_task_id);
+	struct comms_boot_ctx boot_ctx = { .decada_manager = &decada_manager, .time_manager = &time_manager };
 
-	if (!decada_manager.connect()) {
+	/* WiFi, flash, DNS, SNTP and credential setup overlap; see comms_boot_stages */
+	BootPipeline boot_pipeline(comms_boot_stages, BOOT_STAGE_COUNT, &boot_ctx);
+	if (!boot_pipeline.run(wdt_task_id)) {
 		sys_reboot(SYS_REBOOT_WARM);
 	}
-	wdt_feed(wdt, wdt_channel_id);
+	task_watchdog::check_in(wdt_task_id);
 
-	decada_manager.subscribe(subscription_topics);
+	tls_heap_monitor::log_report();
 
 	/* Signal other threads that DECADA connection is up */
 	k_poll_signal_raise(&decada_connect_ok_signal, 0);
+	net_fault::start();
 
 	std::string sw_ver = read_sw_ver();
-	LOG_DBG("sw_ver (read from flash): %s", sw_ver.c_str());
+	LOG_DBG("sw_ver (read from flash): %s", log_strdup(sw_ver.c_str()));
+
+#if USER_CONFIG_METRICS_PUBLISH_INTERVAL_S > 0
+	int64_t next_metrics_report_ms = k_uptime_get() + USER_CONFIG_METRICS_PUBLISH_INTERVAL_S * MSEC_PER_SEC;
+#endif
+
+	/* Batch size and publish interval, refreshed from runtime_config once per message */
+	struct runtime_config_snapshot config = {};
+	int batch_count = 0;
 
 	while (true) {
 		struct k_mbox_msg recv_msg;
@@ -101,21 +264,98 @@ void execute_communications_thread(int watchdog_id)
 		recv_msg.size = rx_buf_size;
 		recv_msg.rx_source_thread = K_ANY;
 
+		/* Client certificate renewal is stepped here; its keypair is generated in the background */
+		decada_manager.poll_cert_renewal();
+
 		/* Try receiving data from BehaviorManager Thread via Mailbox */
-		k_mbox_get(&data_mailbox, &recv_msg, rx_buf, K_FOREVER);
-		std::string payload(rx_buf, recv_msg.size);
+		if (k_mbox_get(&data_mailbox, &recv_msg, rx_buf, K_MSEC(THREAD_CHECK_IN_PERIOD_MS)) != 0) {
+			/* No sample within the period, e.g. at a slow sensor poll rate */
+			task_watchdog::check_in(wdt_task_id);
+			continue;
+		}
+		alloc_profiler::iteration_begin(ALLOC_LOOP_COMMUNICATIONS);
+		runtime_config::refresh(config);
 		free(recv_msg.tx_data);
+		metrics::gauge_add(METRIC_QUEUE_DEPTH, -1);
 
-		if (recv_msg.size != recv_msg.info) {
-			LOG_WRN("Mail data corrupted during transfer");
-			LOG_INF("Expected size: %d, actual size %d", recv_msg.info, recv_msg.size);
+		if (recv_msg.size != recv_msg.info || recv_msg.size < sizeof(struct sample_trace_record)) {
+			LOG_WRN_RATELIMIT("Mail data corrupted during transfer (expected size %d, actual size %d)",
+					  recv_msg.info, recv_msg.size);
+			alloc_profiler::iteration_end(ALLOC_LOOP_COMMUNICATIONS);
+			task_watchdog::check_in(wdt_task_id);
+			continue;
 		}
-		LOG_DBG("Received from mail: %s", payload.c_str());
-		if (!decada_manager.publish(sensor_pub_topic, payload)) {
+
+		/* Mail holds the trace record of the sample followed by its payload */
+		struct sample_trace_record trace;
+		memcpy(&trace, rx_buf, sizeof(trace));
+		sample_trace::mark(trace, SAMPLE_TRACE_DEQUEUE);
+		std::string payload(rx_buf + sizeof(trace), recv_msg.size - sizeof(trace));
+
+		LOG_DBG_RATELIMIT("Received from mail: %s", log_strdup(payload.c_str()));
+		sample_trace::mark(trace, SAMPLE_TRACE_PUBLISH_START);
+		metric_timer publish_timer = metrics::start_timer();
+		bool published = decada_manager.publish(sensor_pub_topic, payload);
+		metrics::observe_since(METRIC_PUBLISH_LATENCY, publish_timer);
+		if (!published) {
+			metrics::increment(METRIC_PUBLISH_FAILURES);
+#if defined(USER_CONFIG_NET_FAULT_PROFILE)
+			/* Recover in place, so that the fault step is followed up to the next successful publish */
+			if (!decada_manager.reconnect(subscription_topics, USER_CONFIG_NET_FAULT_RECONNECT_ATTEMPTS)) {
+				sys_reboot(SYS_REBOOT_WARM);
+			}
+
+			/* The sample is lost, and is counted as such in the NET_FAULT line of the step */
+			alloc_profiler::iteration_end(ALLOC_LOOP_COMMUNICATIONS);
+			task_watchdog::check_in(wdt_task_id);
+			continue;
+#else
 			sys_reboot(SYS_REBOOT_WARM);
+#endif
 		}
+		sample_trace::mark(trace, SAMPLE_TRACE_PUBLISH_COMPLETE);
+		sample_trace::finish(trace);
+		metrics::increment(METRIC_SAMPLES_PUBLISHED);
 
-		wdt_feed(wdt, wdt_channel_id);
-		k_msleep(sleep_time_ms);
+		/* Report where boot time went, once per boot */
+		if (boot_profiler::mark_first_publish()) {
+			boot_profiler::log_report();
+			decada_manager.publish(boot_report_pub_topic, boot_profiler::get_report_json());
+			task_watchdog::log_report();
+			stack_monitor::log_report();
+			alloc_profiler::log_report();
+
+			/* Start-up allocations are done; anything allocated per iteration from here on is flagged */
+			alloc_profiler::set_steady_state();
+		}
+
+#if USER_CONFIG_METRICS_PUBLISH_INTERVAL_S > 0
+		if (k_uptime_get() >= next_metrics_report_ms) {
+			metrics::log_report();
+			decada_manager.publish(metrics_pub_topic, metrics::get_report_json(sw_ver));
+			stack_monitor::log_report();
+			decada_manager.publish(stack_usage_pub_topic, stack_monitor::get_report_json());
+			cpu_profiler::log_report();
+			decada_manager.publish(cpu_usage_pub_topic, cpu_profiler::get_report_json());
+			alloc_profiler::log_report();
+			next_metrics_report_ms += USER_CONFIG_METRICS_PUBLISH_INTERVAL_S * MSEC_PER_SEC;
+		}
+#endif
+
+#if defined(USER_CONFIG_SOAK_SAMPLE_RATE_HZ)
+		if (k_uptime_get() >= next_soak_report_ms) {
+			soak_report::log();
+			next_soak_report_ms += USER_CONFIG_SOAK_REPORT_INTERVAL_S * MSEC_PER_SEC;
+		}
+#endif
+
+		alloc_profiler::iteration_end(ALLOC_LOOP_COMMUNICATIONS);
+		task_watchdog::check_in(wdt_task_id);
+
+		/* Pause after each batch of samples; samples arriving meanwhile wait in the mailbox */
+		if (++batch_count >= config.values[RUNTIME_CONFIG_PUBLISH_BATCH_SIZE]) {
+			batch_count = 0;
+			k_msleep(config.values[RUNTIME_CONFIG_PUBLISH_INTERVAL_MS]);
+		}
 	}
 }
\ No newline at end of file
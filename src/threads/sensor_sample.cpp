@@ -0,0 +1,44 @@
+#include <stdlib.h>
+#include <string.h>
+#include "diagnostics/sample_trace.h"
+#include "sensor_sample.h"
+
+static const char* const decada_protocol_version = "1.0";
+static const char* const decada_method_of_device = "thing.measurepoint.post";
+
+/**
+ * @brief	Format a sensor reading into DECADA-compliant JSON
+ * @author	Lee Tze Han
+ * @param	device_id	Device UUID registered in DECADA
+ * @param	sensor_data	Sensor reading
+ * @param	json		Document to fill, of at least SAMPLE_JSON_CAPACITY
+ */
+void build_sample_json(const std::string& device_id, const std::string& sensor_data, ArduinoJson::JsonDocument& json)
+{
+	ArduinoJson::DynamicJsonDocument params(64);
+	params["measurepoints"]["chronos_s"] = sensor_data;
+
+	json["id"] = device_id;
+	json["version"] = decada_protocol_version;
+	json["params"] = params;
+	json["method"] = decada_method_of_device;
+}
+
+/**
+ * @brief	Serialize a sample into mail for the communications thread
+ * @author	Lee Tze Han
+ * @param	json	Document from build_sample_json
+ * @param	len	Set to the length of the mail
+ * @return	Heap-allocated mail, with room for the sample_trace_record at the start; freed by the receiver
+ */
+char* serialize_sample(const ArduinoJson::JsonDocument& json, size_t& len)
+{
+	std::string json_body;
+	ArduinoJson::serializeJson(json, json_body);
+
+	len = sizeof(struct sample_trace_record) + json_body.size();
+	char* buf = (char*)malloc(len);
+	memcpy(buf + sizeof(struct sample_trace_record), json_body.c_str(), json_body.size());
+
+	return buf;
+}
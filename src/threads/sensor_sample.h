@@ -0,0 +1,33 @@
+/*******************************************************************************************************
+ * Copyright (c) 2021 Government Technology Agency of Singapore (GovTech)
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied.
+ *
+ * See the License for the specific language governing permissions and limitations under the License.
+ *******************************************************************************************************/
+#ifndef _SENSOR_SAMPLE_H_
+#define _SENSOR_SAMPLE_H_
+
+#include <string>
+#include "ArduinoJson.hpp"
+
+/* Capacity of the document passed to build_sample_json */
+#define SAMPLE_JSON_CAPACITY (512)
+
+/*
+ * Construction of the samples mailed from the behavior manager to the communications thread. Mail
+ * holds the sample_trace_record of the sample followed by its DECADA measurepoint post.
+ */
+
+void build_sample_json(const std::string& device_id, const std::string& sensor_data, ArduinoJson::JsonDocument& json);
+char* serialize_sample(const ArduinoJson::JsonDocument& json, size_t& len);
+
+#endif // _SENSOR_SAMPLE_H_
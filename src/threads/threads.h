@@ -18,6 +18,12 @@
 
 #include <zephyr.h>
 
+/*
+ * Longest time either thread waits before checking in with the task watchdog, so the sensor poll rate
+ * and publish interval can be raised at runtime beyond the watchdog deadlines
+ */
+#define THREAD_CHECK_IN_PERIOD_MS (5 * MSEC_PER_SEC)
+
 extern struct k_mbox data_mailbox;
 extern struct k_poll_signal decada_connect_ok_signal;
 extern struct k_poll_event decada_connect_ok_events[];
@@ -3,7 +3,6 @@ LOG_MODULE_REGISTER(time_engine, LOG_LEVEL_DBG);
 
 #include <sstream>
 #include <time.h>
-#include "networking/dns/dns_lookup.h"
 #include "time_engine.h"
 #include "user_config.h"
 
@@ -211,10 +210,52 @@ void TimeEngine::update_rtc_time(uint64_t timestamp)
 	else {
 		char buffer[256];
 		strftime(buffer, sizeof(buffer), "%c", &info);
-		LOG_INF("RTC Updated: %s", buffer);
+		LOG_INF("RTC Updated: %s", log_strdup(buffer));
 	}
 }
 
+#elif defined(CONFIG_BOARD_NATIVE_POSIX) || defined(CONFIG_QEMU_TARGET)
+/*
+ * Emulated RTC kept as an offset from system uptime. Like an unset STM32 RTC, it starts
+ * from 00:00:00 UTC 1st Jan 2000 until updated.
+ */
+static int64_t rtc_epoch_offset = 946684800;
+
+/**
+ * @brief	Get datetime from emulated RTC.
+ * @author	Lee Tze Han
+ * @param	timestamp_ptr	Pointer to store Unix epoch timestamp. Set to NULL if unneeded
+ * @return	tm struct containing time in broken-down representation
+ */
+struct tm TimeEngine::get_rtc_datetime(int64_t* timestamp_ptr)
+{
+	time_t timestamp = rtc_epoch_offset + k_uptime_get() / MSEC_PER_SEC;
+
+	struct tm time;
+	if (!gmtime_r(&timestamp, &time)) {
+		LOG_WRN("Failed to convert emulated RTC timestamp");
+	}
+
+	/* Store timestamp in given pointer */
+	if (timestamp_ptr) {
+		*timestamp_ptr = timestamp;
+	}
+
+	return time;
+}
+
+/**
+ * @brief	Set the current timestamp of the emulated RTC.
+ * @author	Lee Tze Han
+ * @param	timestamp    Unix epoch timestamp (seconds since 00:00:00 UTC 1st Jan 1970)
+ */
+void TimeEngine::update_rtc_time(uint64_t timestamp)
+{
+	rtc_epoch_offset = (int64_t)timestamp - k_uptime_get() / MSEC_PER_SEC;
+
+	LOG_INF("RTC Updated: %u", (uint32_t)timestamp);
+}
+
 #else
 #error "TimeEngine requires RTC driver dependent code that may not be compatible with the current implementation"
 #endif
\ No newline at end of file
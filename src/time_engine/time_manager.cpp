@@ -1,41 +1,276 @@
 #include <logging/log.h>
 LOG_MODULE_REGISTER(time_manager, LOG_LEVEL_DBG);
 
-#include <net/sntp.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <net/socket.h>
+#include <sys/byteorder.h>
 #include <time.h>
 #include "networking/dns/dns_lookup.h"
 #include "time_manager.h"
 #include "user_config.h"
 
-#define SNTP_TIMEOUT (10 * MSEC_PER_SEC)
+#define SNTP_PORT	      (123)
+#define SNTP_PACKET_LEN	      (48)
+#define SNTP_ROUND_TIMEOUT    (2 * MSEC_PER_SEC)
+#define SNTP_MAX_ROUNDS	      (3)
+#define SNTP_MAX_DELAY_US     (2 * USEC_PER_SEC)
+#define SNTP_OUTLIER_LIMIT_US (500 * USEC_PER_MSEC)
+
+/* Seconds between the NTP epoch (1900) and the Unix epoch (1970) */
+#define NTP_UNIX_EPOCH_DIFF (2208988800LL)
+
+/* LI = 0 (no warning), VN = 4, Mode = 3 (client) */
+#define SNTP_LI_VN_MODE_CLIENT (0x23)
+#define SNTP_MODE_SERVER       (4)
+
+const char* sntp_servers[] = USER_CONFIG_SNTP_SERVER_ADDRS;
+
+/* Bounds the per-server state of a query round, which is kept on the stack */
+#define SNTP_MAX_SERVERS ARRAY_SIZE(sntp_servers)
+
+/**
+ * @brief	Get the local reference clock used to timestamp SNTP exchanges.
+ * @author	Lee Tze Han
+ * @return	Uptime in microseconds
+ */
+static int64_t sntp_local_us(void)
+{
+	return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+/**
+ * @brief	Convert a 64-bit NTP timestamp in network byte order to Unix epoch microseconds.
+ * @author	Lee Tze Han
+ * @param	buf	Pointer to the 8-byte timestamp field
+ * @return	Unix epoch timestamp in microseconds
+ */
+static int64_t ntp_to_unix_us(const uint8_t* buf)
+{
+	uint32_t seconds = sys_get_be32(buf);
+	uint32_t fraction = sys_get_be32(buf + 4);
+
+	return ((int64_t)seconds - NTP_UNIX_EPOCH_DIFF) * USEC_PER_SEC + (((uint64_t)fraction * USEC_PER_SEC) >> 32);
+}
 
 /**
  * @brief	Syncs RTC to timestamp from SNTP query
  * @author	Lee Tze Han
  * @return	Success status
+ * @details	All configured servers are queried concurrently. Rounds are repeated up to SNTP_MAX_ROUNDS
+ * 		times until an acceptable sample is obtained; the RTC is left untouched otherwise.
  */
 bool TimeManager::sync_sntp_rtc(void)
 {
-	/* Resolve SNTP server hostname */
-	DnsLookup dns_lookup(USER_CONFIG_SNTP_SERVER_ADDR);
-	std::string ipaddr = dns_lookup.get_ipaddr();
+	const int server_count = SNTP_MAX_SERVERS;
+	sntp_sample samples[SNTP_MAX_SERVERS];
 
-	struct sntp_time sntp_time;
+	for (int round = 1; round <= SNTP_MAX_ROUNDS; round++) {
+		int responses = query_servers(samples, server_count, SNTP_ROUND_TIMEOUT);
+		LOG_DBG("SNTP round %d/%d: %d/%d responses", round, SNTP_MAX_ROUNDS, responses, server_count);
 
-	int rc = sntp_simple(ipaddr.c_str(), SNTP_TIMEOUT, &sntp_time);
-	if (rc < 0) {
-		LOG_WRN("Failure in SNTP query: %d", rc);
-		return false;
+		const sntp_sample* best = select_sample(samples, server_count);
+		if (best) {
+			apply_sample(*best);
+			return true;
+		}
 	}
 
-	LOG_INF("SNTP timestamp: %" PRIu64, sntp_time.seconds);
+	LOG_WRN("Failure in SNTP query - RTC is not updated");
 
-	LOG_DBG("Before sync: %" PRId64, get_timestamp());
+	return false;
+}
 
-	/* Update RTC */
-	update_rtc_time(sntp_time.seconds);
+/**
+ * @brief	Query all SNTP servers concurrently.
+ * @author	Lee Tze Han
+ * @param	samples		Array of count samples to be filled, indexed as sntp_servers
+ * @param	count		Number of servers to query (at most SNTP_MAX_SERVERS)
+ * @param	timeout_ms	Time allowed for DNS resolution and all responses
+ * @return	Number of valid samples
+ */
+int TimeManager::query_servers(sntp_sample* samples, int count, int timeout_ms)
+{
+	__ASSERT(count <= (int)SNTP_MAX_SERVERS, "Too many SNTP servers");
+	count = MIN(count, (int)SNTP_MAX_SERVERS);
+
+	const int64_t deadline = k_uptime_get() + timeout_ms;
+
+	/* Start all DNS queries before waiting on any of them */
+	std::vector<std::unique_ptr<DnsLookup>> lookups;
+	for (int i = 0; i < count; i++) {
+		lookups.emplace_back(new DnsLookup(sntp_servers[i]));
+	}
+
+	struct pollfd fds[SNTP_MAX_SERVERS];
+	int64_t sent_us[SNTP_MAX_SERVERS];
+	uint8_t packet[SNTP_PACKET_LEN];
+
+	for (int i = 0; i < count; i++) {
+		samples[i] = { .valid = false };
+		fds[i].fd = -1;
+		fds[i].events = POLLIN;
+
+		int64_t remaining = MAX(deadline - k_uptime_get(), 0);
+		if (!lookups[i]->wait_resolved(K_MSEC(remaining))) {
+			LOG_WRN("Failed to resolve %s", sntp_servers[i]);
+			continue;
+		}
+
+		struct sockaddr_in addr = lookups[i]->get_sockaddr_in();
+		addr.sin_port = htons(SNTP_PORT);
+
+		int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (sock < 0) {
+			LOG_WRN("Failed to create socket: %d", -errno);
+			continue;
+		}
+
+		if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+			LOG_WRN("Failed to connect to %s: %d", sntp_servers[i], -errno);
+			close(sock);
+			continue;
+		}
+
+		/* The transmit timestamp is echoed back as the originate timestamp */
+		memset(packet, 0, sizeof(packet));
+		packet[0] = SNTP_LI_VN_MODE_CLIENT;
+		sent_us[i] = sntp_local_us();
+		sys_put_be64((uint64_t)sent_us[i], &packet[40]);
+
+		if (send(sock, packet, sizeof(packet), 0) < 0) {
+			LOG_WRN("Failed to send SNTP request to %s: %d", sntp_servers[i], -errno);
+			close(sock);
+			continue;
+		}
+
+		fds[i].fd = sock;
+	}
+
+	int pending = 0;
+	for (int i = 0; i < count; i++) {
+		pending += (fds[i].fd >= 0);
+	}
 
-	LOG_DBG("After sync: %" PRId64, get_timestamp());
+	int responses = 0;
+	while (pending > 0) {
+		int64_t remaining = deadline - k_uptime_get();
+		if (remaining <= 0 || poll(fds, count, remaining) <= 0) {
+			break;
+		}
+
+		for (int i = 0; i < count; i++) {
+			if (fds[i].fd < 0 || !(fds[i].revents & POLLIN)) {
+				continue;
+			}
+
+			int len = recv(fds[i].fd, packet, sizeof(packet), 0);
+			int64_t received_us = sntp_local_us();
+
+			close(fds[i].fd);
+			fds[i].fd = -1;
+			pending--;
+
+			/* Reject malformed, unsynchronized (stratum 0) or mismatched responses */
+			if (len < SNTP_PACKET_LEN || (packet[0] & 0x07) != SNTP_MODE_SERVER || packet[1] == 0 ||
+			    sys_get_be64(&packet[24]) != (uint64_t)sent_us[i])
+			{
+				LOG_WRN("Invalid SNTP response from %s", sntp_servers[i]);
+				continue;
+			}
+
+			/* t1: request sent, t2: request received, t3: response sent, t4: response received */
+			int64_t t1 = sent_us[i];
+			int64_t t2 = ntp_to_unix_us(&packet[32]);
+			int64_t t3 = ntp_to_unix_us(&packet[40]);
+			int64_t t4 = received_us;
+
+			samples[i].delay_us = (t4 - t1) - (t3 - t2);
+			samples[i].offset_us = ((t2 - t1) + (t3 - t4)) / 2;
+			samples[i].valid = (samples[i].delay_us >= 0 && samples[i].delay_us <= SNTP_MAX_DELAY_US);
+			responses += samples[i].valid;
+
+			LOG_DBG("%s: delay %d us", sntp_servers[i], (int32_t)samples[i].delay_us);
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (fds[i].fd >= 0) {
+			LOG_WRN("No SNTP response from %s", sntp_servers[i]);
+			close(fds[i].fd);
+		}
+	}
+
+	return responses;
+}
+
+/**
+ * @brief	Select the most accurate sample after rejecting outliers.
+ * @author	Lee Tze Han
+ * @param	samples		Array of samples
+ * @param	count		Number of samples
+ * @return	Pointer to sample with the lowest round-trip delay, or NULL if none is acceptable
+ * @details	Samples whose offset differs from the median offset by more than SNTP_OUTLIER_LIMIT_US
+ * 		are discarded. With fewer than three samples, no sample can be identified as an outlier.
+ */
+const sntp_sample* TimeManager::select_sample(const sntp_sample* samples, int count) const
+{
+	std::vector<int64_t> offsets;
+	for (int i = 0; i < count; i++) {
+		if (samples[i].valid) {
+			offsets.push_back(samples[i].offset_us);
+		}
+	}
+
+	if (offsets.empty()) {
+		return NULL;
+	}
+
+	std::nth_element(offsets.begin(), offsets.begin() + offsets.size() / 2, offsets.end());
+	int64_t median = offsets[offsets.size() / 2];
+	bool reject_outliers = offsets.size() >= 3;
+
+	const sntp_sample* best = NULL;
+	for (int i = 0; i < count; i++) {
+		if (!samples[i].valid) {
+			continue;
+		}
+
+		if (reject_outliers && llabs(samples[i].offset_us - median) > SNTP_OUTLIER_LIMIT_US) {
+			LOG_WRN("Rejected %s as outlier", sntp_servers[i]);
+			continue;
+		}
+
+		if (!best || samples[i].delay_us < best->delay_us) {
+			best = &samples[i];
+		}
+	}
+
+	return best;
+}
+
+/**
+ * @brief	Update RTC using the offset from an SNTP sample.
+ * @author	Lee Tze Han
+ * @param	sample	Selected SNTP sample
+ * @note	The RTC only has a resolution of one second, so the update is delayed to the next
+ * 		second boundary to avoid truncating up to a second from the timestamp.
+ */
+void TimeManager::apply_sample(const sntp_sample& sample)
+{
+	int64_t now_us = sntp_local_us() + sample.offset_us;
+	int64_t fraction_us = now_us % USEC_PER_SEC;
+
+	k_usleep(USEC_PER_SEC - fraction_us);
+	uint64_t timestamp = (now_us - fraction_us) / USEC_PER_SEC + 1;
+
+	LOG_INF("SNTP timestamp: %u (delay %d us)", (uint32_t)timestamp, (int32_t)sample.delay_us);
+
+	LOG_DBG("Before sync: %u", (uint32_t)get_timestamp());
+
+	/* Update RTC */
+	update_rtc_time(timestamp);
 
-	return true;
-}
\ No newline at end of file
+	LOG_DBG("After sync: %u", (uint32_t)get_timestamp());
+}
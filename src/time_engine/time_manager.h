@@ -18,6 +18,16 @@
 
 #include "time_engine/time_engine.h"
 
+/* Result of a single SNTP exchange, referenced to the local uptime clock */
+struct sntp_sample {
+	/* Indicates if struct contains valid values */
+	bool valid;
+	/* Estimated (Unix epoch - uptime) in microseconds */
+	int64_t offset_us;
+	/* Round-trip delay excluding server processing time in microseconds */
+	int64_t delay_us;
+};
+
 /*
  * TimeManager should only be included in one thread responsible
  * for periodically syncing the RTC with the SNTP server.
@@ -29,6 +39,11 @@ class TimeManager : public TimeEngine
 {
 public:
 	bool sync_sntp_rtc(void);
+
+private:
+	int query_servers(sntp_sample* samples, int count, int timeout_ms);
+	const sntp_sample* select_sample(const sntp_sample* samples, int count) const;
+	void apply_sample(const sntp_sample& sample);
 };
 
 #endif // _TIME_MANAGER_H
\ No newline at end of file
@@ -31,11 +31,12 @@
         ("")
 
 /**
- *      SNTP Server address
+ *      SNTP Server addresses
  */
 
-#define USER_CONFIG_SNTP_SERVER_ADDR \
-        ("pool.ntp.org")
+// Servers are queried concurrently; order is used as the tie-breaker between equally good samples
+#define USER_CONFIG_SNTP_SERVER_ADDRS \
+        { "pool.ntp.org", "time.google.com", "time.cloudflare.com" }
 
 /**
  *      Device Provisioning Key Generation
@@ -44,6 +45,116 @@
 // Use ECC SECP256R1 as key generation method; Comment out the next line to use RSA.
 #define USER_CONFIG_USE_ECC_SECP256R1
 
+/**
+ *      TLS Record Buffers
+ */
+
+// Zephyr's TLS sockets request the max_fragment_length extension (RFC 6066) on every MQTT and HTTPS connection, for
+// CONFIG_MBEDTLS_SSL_MAX_CONTENT_LEN in zephyr/prj.conf capped at 4096. mbedTLS fails to open any TLS socket unless
+// both record buffers below can hold the requested length, which mbedtls_config.h checks at build time.
+
+// Size of the buffer holding records received from the server. Servers that honour max_fragment_length (including
+// tools/mock_decada) send no larger records. mbedTLS cannot resize it at runtime, so for servers that ignore the
+// extension raise this to the largest record they send (up to 16384).
+#define USER_CONFIG_TLS_IN_CONTENT_LEN \
+        (4096)
+
+// Size of the buffer holding records sent to the server; larger writes are split across multiple records.
+// Must fit the client certificate handshake message.
+#define USER_CONFIG_TLS_OUT_CONTENT_LEN \
+        (4096)
+
+/**
+ *      Diagnostics
+ */
+
+// Interval between runtime metrics reports (see diagnostics/metrics.h); 0 disables the reports
+#define USER_CONFIG_METRICS_PUBLISH_INTERVAL_S \
+        (300)
+
+// Log the stage latencies of every sample as a JSON line (see diagnostics/sample_trace.h)
+// #define USER_CONFIG_SAMPLE_TRACE_STREAM
+
+// Inject network faults on a schedule once connected (see networking/fault/net_fault.h for the profiles).
+// Link faults take down the default network interface, so this is intended for host and emulated builds.
+// #define USER_CONFIG_NET_FAULT_PROFILE (NET_FAULT_PROFILE_LINK_FLAP)
+
+// With a fault profile, a failed publish is followed by this many attempts to reconnect in place, 5 s apart,
+// before rebooting, so that recovery can be measured. Without a profile, a failed publish reboots the device.
+#define USER_CONFIG_NET_FAULT_RECONNECT_ATTEMPTS \
+        (30)
+
+/**
+ *      Runtime Configuration (see runtime_config/runtime_config.h)
+ */
+
+// Defaults until changed by a DECADA service command
+#define USER_CONFIG_SENSOR_POLL_RATE_MS \
+        (10 * MSEC_PER_SEC)
+#define USER_CONFIG_PUBLISH_BATCH_SIZE \
+        (1)
+#define USER_CONFIG_PUBLISH_INTERVAL_MS \
+        (250)
+#define USER_CONFIG_SENSOR_DEADBAND \
+        (0)
+
+// Keep values set by service commands across reboots
+#define USER_CONFIG_RUNTIME_CONFIG_PERSIST
+
+/**
+ *      Logging
+ */
+
+// Messages allowed per period for each module using LOG_*_RATELIMIT (see log_ratelimit/log_ratelimit.h)
+#define USER_CONFIG_LOG_RATELIMIT_BURST \
+        (5)
+#define USER_CONFIG_LOG_RATELIMIT_PERIOD_MS \
+        (10 * MSEC_PER_SEC)
+
+/**
+ *      Soak Testing (see tools/soak)
+ */
+
+// Generate synthetic samples at this rate instead of every 10 s, publish without pacing and log a SOAK summary
+// line every USER_CONFIG_SOAK_REPORT_INTERVAL_S. Also enables the sample trace stream. Intended for host builds.
+// #define USER_CONFIG_SOAK_SAMPLE_RATE_HZ (20)
+
+#define USER_CONFIG_SOAK_REPORT_INTERVAL_S \
+        (10)
+
+/**
+ *      DECADA Endpoints
+ */
+
+#if defined(CONFIG_BOARD_NATIVE_POSIX)
+
+// Local stand-ins reachable through the native_posix TAP interface (see README)
+#define USER_CONFIG_DECADA_API_URL \
+        ("https://192.0.2.2:8443")
+
+#define USER_CONFIG_DECADA_MQTT_HOSTNAME \
+        ("192.0.2.2")
+
+#define USER_CONFIG_DECADA_MQTT_PORT \
+        (8883)
+
+// Local stand-ins use self-signed certificates that cannot be verified against the DECADA CAs
+#define USER_CONFIG_TLS_SKIP_PEER_VERIFY
+
+// Used in place of a factory flashed UID (24-character hex string)
+#define USER_CONFIG_DEVICE_UUID \
+        ("000000000000000000000001")
+
+#else
+
+#define USER_CONFIG_DECADA_API_URL \
+        ("https://ag.decada.gov.sg")
+
+#define USER_CONFIG_DECADA_MQTT_HOSTNAME \
+        ("mqtt.decada.gov.sg")
+
+#endif // CONFIG_BOARD_NATIVE_POSIX
+
 /**
  *      DECADA Credentials
  */
@@ -0,0 +1,146 @@
+#include <logging/log.h>
+LOG_MODULE_REGISTER(soft_watchdog, LOG_LEVEL_DBG);
+
+#include <device.h>
+#include <drivers/watchdog.h>
+#include <power/reboot.h>
+#include "soft_watchdog.h"
+
+#if defined(CONFIG_BOARD_NATIVE_POSIX)
+
+struct soft_wdt_data {
+	struct k_timer timer;
+	uint32_t timeout_ms;
+	bool installed;
+	bool running;
+};
+
+static struct soft_wdt_data soft_wdt;
+
+/**
+ * @brief	Timer expiry handler emulating a watchdog reset.
+ * @author	Lau Lee Hong
+ * @param	timer	Expired timer
+ */
+static void soft_wdt_expiry(struct k_timer* timer)
+{
+	ARG_UNUSED(timer);
+
+	LOG_ERR("Watchdog expired - resetting");
+	sys_reboot(SYS_REBOOT_COLD);
+}
+
+/**
+ * @brief	Start the watchdog with the installed timeout.
+ * @author	Lau Lee Hong
+ * @param	dev	Watchdog device
+ * @param	options	Ignored (no debugger halt support)
+ * @return	0 on success, negative errno otherwise
+ */
+static int soft_wdt_setup(const struct device* dev, uint8_t options)
+{
+	struct soft_wdt_data* data = dev->data;
+	ARG_UNUSED(options);
+
+	if (!data->installed) {
+		return -EINVAL;
+	}
+
+	k_timer_start(&data->timer, K_MSEC(data->timeout_ms), K_NO_WAIT);
+	data->running = true;
+
+	return 0;
+}
+
+/**
+ * @brief	Stop the watchdog.
+ * @author	Lau Lee Hong
+ * @param	dev	Watchdog device
+ * @return	0 on success
+ */
+static int soft_wdt_disable(const struct device* dev)
+{
+	struct soft_wdt_data* data = dev->data;
+
+	k_timer_stop(&data->timer);
+	data->running = false;
+	data->installed = false;
+
+	return 0;
+}
+
+/**
+ * @brief	Install the single supported timeout.
+ * @author	Lau Lee Hong
+ * @param	dev	Watchdog device
+ * @param	cfg	Timeout configuration; windowed mode is not supported
+ * @return	Channel id (always 0) on success, negative errno otherwise
+ */
+static int soft_wdt_install_timeout(const struct device* dev, const struct wdt_timeout_cfg* cfg)
+{
+	struct soft_wdt_data* data = dev->data;
+
+	if (data->running) {
+		return -EBUSY;
+	}
+	if (data->installed) {
+		return -ENOMEM;
+	}
+	if (cfg->window.min != 0U || cfg->window.max == 0U) {
+		return -EINVAL;
+	}
+
+	data->timeout_ms = cfg->window.max;
+	data->installed = true;
+
+	return 0;
+}
+
+/**
+ * @brief	Restart the watchdog timer.
+ * @author	Lau Lee Hong
+ * @param	dev		Watchdog device
+ * @param	channel_id	Channel returned by soft_wdt_install_timeout
+ * @return	0 on success, negative errno otherwise
+ */
+static int soft_wdt_feed(const struct device* dev, int channel_id)
+{
+	struct soft_wdt_data* data = dev->data;
+
+	if (channel_id != 0) {
+		return -EINVAL;
+	}
+
+	if (data->running) {
+		k_timer_start(&data->timer, K_MSEC(data->timeout_ms), K_NO_WAIT);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief	Driver initialization.
+ * @author	Lau Lee Hong
+ * @param	dev	Watchdog device
+ * @return	0 on success
+ */
+static int soft_wdt_init(const struct device* dev)
+{
+	struct soft_wdt_data* data = dev->data;
+
+	k_timer_init(&data->timer, soft_wdt_expiry, NULL);
+
+	return 0;
+}
+
+static const struct wdt_driver_api soft_wdt_api = {
+	.setup = soft_wdt_setup,
+	.disable = soft_wdt_disable,
+	.install_timeout = soft_wdt_install_timeout,
+	.feed = soft_wdt_feed,
+};
+
+DEVICE_DEFINE(soft_watchdog, SOFT_WDT_DEV_NAME, soft_wdt_init, device_pm_control_nop, &soft_wdt, NULL, POST_KERNEL,
+	      CONFIG_KERNEL_INIT_PRIORITY_DEVICE, &soft_wdt_api);
+
+#endif // CONFIG_BOARD_NATIVE_POSIX
@@ -0,0 +1,25 @@
+/*******************************************************************************************************
+ * Copyright (c) 2021 Government Technology Agency of Singapore (GovTech)
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied.
+ *
+ * See the License for the specific language governing permissions and limitations under the License.
+ *******************************************************************************************************/
+#ifndef _SOFT_WATCHDOG_H_
+#define _SOFT_WATCHDOG_H_
+
+/*
+ * Single-channel watchdog driver backed by a kernel timer, for boards without a
+ * hardware watchdog (e.g. native_posix). Expiry reboots the system.
+ */
+#define SOFT_WDT_DEV_NAME "SOFT_WDT"
+
+#endif // _SOFT_WATCHDOG_H_
@@ -0,0 +1,201 @@
+#include <logging/log.h>
+LOG_MODULE_REGISTER(task_watchdog, LOG_LEVEL_DBG);
+
+#include "task_watchdog.h"
+#include "watchdog_config.h"
+
+/* Supervision runs several times per hardware window so that a healthy system is always fed in time */
+#define TASK_WDT_SUPERVISE_PERIOD_MS (WDT_MAX_WINDOW_MS / 4)
+
+struct watched_task {
+	const char* name;
+	uint32_t deadline_ms;
+	/* Maximum time from registration to the first check-in */
+	uint32_t boot_deadline_ms;
+	/* Time of the last check-in, or of registration before the first check-in */
+	int64_t last_check_in_ms;
+	uint32_t max_interval_ms;
+	uint32_t check_ins;
+	/* Set once a missed deadline has been logged, to avoid repeating it every period */
+	bool overdue_reported;
+};
+
+static struct watched_task tasks[TASK_WDT_MAX_TASKS];
+static int task_count = 0;
+static struct k_spinlock tasks_lock;
+
+static const struct device* hw_wdt;
+static int hw_channel;
+static struct k_delayed_work supervisor_work;
+
+/**
+ * @brief	Feed the hardware watchdog if every supervised task is within its deadline.
+ * @author	Lau Lee Hong
+ * @param	work_item	Unused
+ * @note	Runs on the system workqueue, so a stalled workqueue (which also runs the MQTT loop)
+ * 		is caught as well.
+ */
+static void supervise(struct k_work* work_item)
+{
+	ARG_UNUSED(work_item);
+
+	int64_t now = k_uptime_get();
+	const char* overdue_name = NULL;
+	int64_t overdue_ms = 0;
+	bool healthy = true;
+
+	k_spinlock_key_t key = k_spin_lock(&tasks_lock);
+	for (int i = 0; i < task_count; i++) {
+		struct watched_task& task = tasks[i];
+		uint32_t deadline_ms = task.check_ins > 0 ? task.deadline_ms : task.boot_deadline_ms;
+
+		int64_t since_check_in = now - task.last_check_in_ms;
+		if (since_check_in > deadline_ms) {
+			healthy = false;
+			if (!task.overdue_reported) {
+				task.overdue_reported = true;
+				overdue_name = task.name;
+				overdue_ms = since_check_in;
+			}
+		}
+	}
+	k_spin_unlock(&tasks_lock, key);
+
+	if (overdue_name) {
+		LOG_ERR("Task %s has not checked in for %u ms - withholding watchdog feed", overdue_name,
+			(uint32_t)overdue_ms);
+	}
+
+	if (healthy) {
+		wdt_feed(hw_wdt, hw_channel);
+	}
+
+	k_delayed_work_submit(&supervisor_work, K_MSEC(TASK_WDT_SUPERVISE_PERIOD_MS));
+}
+
+/**
+ * @brief	Start supervising registered tasks.
+ * @author	Lau Lee Hong
+ * @param	hw_channel_id	Hardware watchdog channel from watchdog_config::add_watchdog
+ * @note	The hardware watchdog must already be started
+ */
+void task_watchdog::start(int hw_channel_id)
+{
+	hw_wdt = watchdog_config::get_device_instance();
+	hw_channel = hw_channel_id;
+
+	k_delayed_work_init(&supervisor_work, supervise);
+	k_delayed_work_submit(&supervisor_work, K_NO_WAIT);
+}
+
+/**
+ * @brief	Register a task to be supervised.
+ * @author	Lau Lee Hong
+ * @param	name		Task name used in logs (must remain valid)
+ * @param	deadline_ms		Maximum time allowed between check-ins
+ * @param	boot_deadline_ms	Maximum time allowed from registration to the first check-in
+ * @return	Task id to check in with, or -ENOMEM if too many tasks are registered
+ * @note	Supervision starts at registration, so a task that hangs before its main loop (e.g.
+ * 		waiting for the network) stops the watchdog feed once boot_deadline_ms has passed
+ */
+int task_watchdog::register_task(const char* name, uint32_t deadline_ms, uint32_t boot_deadline_ms)
+{
+	int64_t now = k_uptime_get();
+
+	k_spinlock_key_t key = k_spin_lock(&tasks_lock);
+	if (task_count >= TASK_WDT_MAX_TASKS) {
+		k_spin_unlock(&tasks_lock, key);
+		LOG_ERR("Cannot register task %s - increase TASK_WDT_MAX_TASKS", name);
+		return -ENOMEM;
+	}
+
+	int task_id = task_count++;
+	tasks[task_id] = { .name = name,
+			   .deadline_ms = deadline_ms,
+			   .boot_deadline_ms = boot_deadline_ms,
+			   .last_check_in_ms = now,
+			   .max_interval_ms = 0,
+			   .check_ins = 0,
+			   .overdue_reported = false };
+	k_spin_unlock(&tasks_lock, key);
+
+	LOG_INF("Registered task %s with %u ms deadline (%u ms to first check-in)", name, deadline_ms,
+		boot_deadline_ms);
+
+	return task_id;
+}
+
+/**
+ * @brief	Report that a task is alive.
+ * @author	Lau Lee Hong
+ * @param	task_id	Id from register_task
+ */
+void task_watchdog::check_in(int task_id)
+{
+	if (task_id < 0 || task_id >= task_count) {
+		return;
+	}
+
+	int64_t now = k_uptime_get();
+
+	k_spinlock_key_t key = k_spin_lock(&tasks_lock);
+	struct watched_task& task = tasks[task_id];
+	if (task.check_ins > 0) {
+		task.max_interval_ms = MAX(task.max_interval_ms, (uint32_t)(now - task.last_check_in_ms));
+	}
+	task.last_check_in_ms = now;
+	task.check_ins++;
+	task.overdue_reported = false;
+	k_spin_unlock(&tasks_lock, key);
+}
+
+/**
+ * @brief	Get number of registered tasks.
+ * @author	Lau Lee Hong
+ * @return	Number of tasks; ids range from 0 to count - 1
+ */
+int task_watchdog::get_task_count(void)
+{
+	return task_count;
+}
+
+/**
+ * @brief	Get check-in statistics of a task.
+ * @author	Lau Lee Hong
+ * @param	task_id	Id from register_task
+ * @return	task_watchdog_stats struct
+ */
+task_watchdog_stats task_watchdog::get_stats(int task_id)
+{
+	task_watchdog_stats stats = {};
+	if (task_id < 0 || task_id >= task_count) {
+		return stats;
+	}
+
+	int64_t now = k_uptime_get();
+
+	k_spinlock_key_t key = k_spin_lock(&tasks_lock);
+	const struct watched_task& task = tasks[task_id];
+	stats.name = task.name;
+	stats.deadline_ms = task.deadline_ms;
+	stats.since_check_in_ms = task.check_ins > 0 ? now - task.last_check_in_ms : -1;
+	stats.max_interval_ms = task.max_interval_ms;
+	stats.check_ins = task.check_ins;
+	k_spin_unlock(&tasks_lock, key);
+
+	return stats;
+}
+
+/**
+ * @brief	Log check-in statistics of all tasks.
+ * @author	Lau Lee Hong
+ */
+void task_watchdog::log_report(void)
+{
+	for (int i = 0; i < get_task_count(); i++) {
+		task_watchdog_stats stats = get_stats(i);
+
+		LOG_INF("%s: last check-in %u ms ago, longest interval %u/%u ms over %u check-ins", stats.name,
+			(uint32_t)stats.since_check_in_ms, stats.max_interval_ms, stats.deadline_ms, stats.check_ins);
+	}
+}
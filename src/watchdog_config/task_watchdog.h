@@ -0,0 +1,51 @@
+/*******************************************************************************************************
+ * Copyright (c) 2021 Government Technology Agency of Singapore (GovTech)
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied.
+ *
+ * See the License for the specific language governing permissions and limitations under the License.
+ *******************************************************************************************************/
+#ifndef _TASK_WATCHDOG_H_
+#define _TASK_WATCHDOG_H_
+
+#include <zephyr.h>
+
+/*
+ * Software watchdog multiplexing tasks onto the single hardware watchdog channel. Each task
+ * registers with its own deadline and is supervised from registration, with a separate deadline
+ * for its first check-in to allow for start-up; the hardware watchdog is only fed while every
+ * task has checked in within its deadline.
+ */
+
+#define TASK_WDT_MAX_TASKS (4)
+
+struct task_watchdog_stats {
+	const char* name;
+	uint32_t deadline_ms;
+	/* Time since the last check-in, or -1 if the task has not checked in yet */
+	int64_t since_check_in_ms;
+	/* Longest interval between consecutive check-ins */
+	uint32_t max_interval_ms;
+	uint32_t check_ins;
+};
+
+namespace task_watchdog
+{
+void start(int hw_channel_id);
+int register_task(const char* name, uint32_t deadline_ms, uint32_t boot_deadline_ms);
+void check_in(int task_id);
+
+int get_task_count(void);
+task_watchdog_stats get_stats(int task_id);
+void log_report(void);
+} // namespace task_watchdog
+
+#endif // _TASK_WATCHDOG_H_
@@ -18,12 +18,15 @@
 
 #include <device.h>
 #include <drivers/watchdog.h>
+#include "soft_watchdog.h"
 
 #if DT_HAS_COMPAT_STATUS_OKAY(st_stm32_watchdog)
 #define WDT_NODE DT_INST(0, st_stm32_watchdog)
 #endif
 #ifdef WDT_NODE
 #define WDT_DEV_NAME DT_LABEL(WDT_NODE)
+#elif defined(CONFIG_BOARD_NATIVE_POSIX)
+#define WDT_DEV_NAME SOFT_WDT_DEV_NAME
 #else
 #define WDT_DEV_NAME ""
 #error "Unsupported SoC and no watchdog0 alias in zephyr.dts"
@@ -0,0 +1,221 @@
+/*******************************************************************************************************
+ * Copyright (c) 2021 Government Technology Agency of Singapore (GovTech)
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied.
+ *
+ * See the License for the specific language governing permissions and limitations under the License.
+ *******************************************************************************************************/
+#include <ztest.h>
+#include <string.h>
+#include "ArduinoJson.hpp"
+#include "conversions/conversions.h"
+#include "decada_manager/service_command.h"
+#include "diagnostics/sample_trace.h"
+#include "networking/http/http_response.h"
+#include "networking/http/http_url.h"
+#include "threads/sensor_sample.h"
+#include "time_engine/time_engine.h"
+
+#define BENCH_ITERATIONS (100)
+
+/*
+ * Allocation counters, updated through the --wrap linker options in CMakeLists.txt. Benchmarks run
+ * on the ztest thread only, so plain counters are sufficient.
+ */
+static uint32_t heap_bytes;
+static uint32_t heap_allocs;
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+	heap_bytes += size;
+	heap_allocs++;
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+	heap_bytes += count * size;
+	heap_allocs++;
+	return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+	heap_bytes += size;
+	heap_allocs++;
+	return __real_realloc(ptr, size);
+}
+}
+
+/* Results are written here so that the measured work cannot be optimized away */
+static volatile size_t bench_sink;
+
+/**
+ * @brief	Measure a function and print the result as a BENCH line.
+ * @author	Lee Tze Han
+ * @param	name	Benchmark name
+ * @param	fn	Function to measure; called BENCH_ITERATIONS times after one warm-up call
+ */
+template <typename Fn> static void run_benchmark(const char* name, Fn fn)
+{
+	/* Warm-up, so that one-time initialization is not counted */
+	fn();
+
+	heap_bytes = 0;
+	heap_allocs = 0;
+
+	uint32_t start_cycles = k_cycle_get_32();
+	for (int i = 0; i < BENCH_ITERATIONS; i++) {
+		fn();
+	}
+	uint32_t cycles = k_cycle_get_32() - start_cycles;
+
+	printk("BENCH {\"name\":\"%s\",\"iterations\":%u,\"cycles_per_iter\":%u,\"heap_bytes_per_iter\":%u,"
+	       "\"allocs_per_iter\":%u}\n",
+	       name, BENCH_ITERATIONS, cycles / BENCH_ITERATIONS, heap_bytes / BENCH_ITERATIONS,
+	       heap_allocs / BENCH_ITERATIONS);
+}
+
+/* Sample construction of the sensor loop in execute_behavior_manager_thread, up to the mailbox */
+static void test_sample_json_build(void)
+{
+	const std::string device_uuid = "000000000000000000000001";
+	const std::string sensor_data = "1618300800";
+
+	run_benchmark("sample_json_build", [&]() {
+		ArduinoJson::DynamicJsonDocument json(SAMPLE_JSON_CAPACITY);
+		build_sample_json(device_uuid, sensor_data, json);
+
+		size_t len;
+		char* mail = serialize_sample(json, len);
+		free(mail);
+		bench_sink = len;
+	});
+
+	zassert_true(bench_sink > sizeof(struct sample_trace_record), "Sample JSON is empty");
+}
+
+static void test_hash_sha256(void)
+{
+	/* Similar in size to the signature input of a DECADA API request */
+	const std::string input = std::string(64, 'k') + "1618300800000" + std::string(128, 'p') + std::string(64, 's');
+
+	std::string hash;
+	run_benchmark("hash_sha256", [&]() {
+		hash = hash_sha256(input);
+		bench_sink = hash.size();
+	});
+
+	zassert_equal(hash.size(), SHA256_HEX_SIZE - 1, "Unexpected hash length");
+}
+
+static void test_int_to_string(void)
+{
+	std::string str;
+	run_benchmark("int_to_string", [&]() {
+		str = int_to_string(1618300800);
+		bench_sink = str.size();
+	});
+
+	zassert_true(str == "1618300800", "Unexpected conversion: %s", str.c_str());
+}
+
+static void test_time_engine_format(void)
+{
+	TimeEngine time_engine;
+
+	run_benchmark("timestamp_s_str", [&]() { bench_sink = time_engine.get_timestamp_s_str().size(); });
+	run_benchmark("timestamp_ms_str", [&]() { bench_sink = time_engine.get_timestamp_ms_str().size(); });
+
+	zassert_true(bench_sink > 0, "Timestamp string is empty");
+}
+
+static void test_parse_url(void)
+{
+	const std::string url = "https://ag.decada.gov.sg:443/2.1/provision/device/register?orgId=abc&productKey=def";
+
+	http_url parsed;
+	run_benchmark("parse_url", [&]() {
+		parsed = parse_http_url(url, 80);
+		bench_sink = parsed.endpoint.size();
+	});
+
+	zassert_true(parsed.hostname == "ag.decada.gov.sg", "Unexpected hostname: %s", parsed.hostname.c_str());
+	zassert_equal(parsed.port, 443, "Unexpected port");
+}
+
+static void test_append_body(void)
+{
+	/* Response body delivered in chunks the size of HttpBase's receive buffer */
+	const size_t chunk_size = 512;
+	const int chunk_count = 4;
+	static uint8_t recv_buf[chunk_size];
+	memset(recv_buf, 'b', sizeof(recv_buf));
+
+	std::string body;
+	run_benchmark("append_body", [&]() {
+		HttpResponse response;
+
+		struct http_response resp;
+		memset(&resp, 0, sizeof(resp));
+		resp.recv_buf = recv_buf;
+		resp.recv_buf_len = sizeof(recv_buf);
+		resp.body_found = 1;
+
+		for (int i = 0; i < chunk_count; i++) {
+			resp.processed += chunk_size;
+			response.append_body(&resp);
+		}
+
+		body = response.get_body();
+		bench_sink = body.size();
+	});
+
+	zassert_equal(body.size(), chunk_size * chunk_count, "Unexpected body length");
+}
+
+/* Same parsing as DecadaManager::subscription_callback, without the MQTT response */
+static void test_subscription_parse(void)
+{
+	const char message[] = "{\"id\":\"1234567890\",\"version\":\"1.0\",\"method\":\"thing.service.sensorpollrate\","
+			       "\"params\":{\"sensor_poll_rate\":5000}}";
+	const char* const params[] = { "sensor_poll_rate" };
+
+	bool found = false;
+	run_benchmark("subscription_parse", [&]() {
+		/* Parsing is done in place, so each iteration starts from a fresh copy as received from MQTT */
+		char payload[sizeof(message)];
+		memcpy(payload, message, sizeof(message));
+
+		service_command_doc doc;
+		struct service_command command;
+		found = parse_service_command(payload, sizeof(message) - 1, params, ARRAY_SIZE(params), doc, command) &&
+			!command.params["sensor_poll_rate"].isNull();
+		bench_sink = command.params.size();
+	});
+
+	zassert_true(found, "sensor_poll_rate not parsed");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(benchmarks, ztest_unit_test(test_sample_json_build), ztest_unit_test(test_hash_sha256),
+			 ztest_unit_test(test_int_to_string), ztest_unit_test(test_time_engine_format),
+			 ztest_unit_test(test_parse_url), ztest_unit_test(test_append_body),
+			 ztest_unit_test(test_subscription_parse));
+
+	ztest_run_test_suite(benchmarks);
+}
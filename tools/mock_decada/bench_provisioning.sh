@@ -0,0 +1,113 @@
+#!/usr/bin/env bash
+#
+# Benchmark boot and provisioning time of a native_posix build against the mock DECADA server.
+#
+# Each run starts the executable, waits for the boot pipeline to finish and records the time reported
+# for the pipeline and each of its stages. Cold runs erase the simulated flash and restart the mock server
+# with no devices, so the device secret and client certificate are provisioned from scratch. Warm runs keep
+# both, so saved credentials are used.
+#
+# Prerequisites: TAP interface at 192.0.2.2, mosquitto, openssl and python3 (see README)
+#
+# Usage: bench_provisioning.sh <cold|warm> <runs> [path to zephyr.exe] [output directory]
+#
+# Extra arguments for mock_decada.py (e.g. --latency-ms 200) can be given in MOCK_DECADA_ARGS.
+#
+
+set -e
+
+MODE=${1:?"Usage: $0 <cold|warm> <runs> [zephyr.exe] [output directory]"}
+RUNS=${2:?"Usage: $0 <cold|warm> <runs> [zephyr.exe] [output directory]"}
+ZEPHYR_EXE=$(realpath "${3:-build/zephyr/zephyr.exe}")
+OUT_DIR=$(realpath -m "${4:-provisioning_${MODE}_$(date +%Y%m%d_%H%M%S)}")
+
+# Upper bound on a single run, in case provisioning never completes
+RUN_TIMEOUT_S=${RUN_TIMEOUT_S:-120}
+
+TOOLS_DIR=$(cd "$(dirname "$0")/.." && pwd)
+
+if [ "$MODE" != "cold" ] && [ "$MODE" != "warm" ]; then
+    echo "Mode must be cold or warm" >&2
+    exit 1
+fi
+
+mkdir -p "$OUT_DIR"
+cd "$OUT_DIR"
+
+"$TOOLS_DIR/mock_decada/gen_certs.sh" "$OUT_DIR/certs" > /dev/null
+
+mosquitto -c "$TOOLS_DIR/soak/mosquitto.conf" > mosquitto.log 2>&1 &
+BROKER_PID=$!
+REST_PID=
+trap 'kill $BROKER_PID $REST_PID 2> /dev/null || true' EXIT
+
+start_mock() {
+    python3 "$TOOLS_DIR/mock_decada/mock_decada.py" --cert-dir "$OUT_DIR/certs" --mqtt-port 8883 \
+        --state-file "$OUT_DIR/devices.json" $MOCK_DECADA_ARGS >> mock_decada.log 2>&1 &
+    REST_PID=$!
+    sleep 1
+}
+
+stop_mock() {
+    kill "$REST_PID" 2> /dev/null || true
+    wait "$REST_PID" 2> /dev/null || true
+}
+
+# Warm runs need credentials from a previous boot
+if [ "$MODE" = "warm" ]; then
+    rm -f flash.bin devices.json
+    start_mock
+    timeout "$RUN_TIMEOUT_S" "$ZEPHYR_EXE" --flash=flash.bin > warmup.log 2>&1 &
+    DEVICE_PID=$!
+    ( tail -f --pid=$DEVICE_PID warmup.log & ) | grep -q -m 1 "Boot pipeline" || true
+    kill $DEVICE_PID 2> /dev/null || true
+    wait $DEVICE_PID 2> /dev/null || true
+    stop_mock
+fi
+
+echo "run,boot_ms,result" > runs.csv
+
+for run in $(seq 1 "$RUNS"); do
+    if [ "$MODE" = "cold" ]; then
+        rm -f flash.bin devices.json
+    fi
+    start_mock
+
+    LOG="run_$run.log"
+    timeout "$RUN_TIMEOUT_S" "$ZEPHYR_EXE" --flash=flash.bin > "$LOG" 2>&1 &
+    DEVICE_PID=$!
+    ( tail -f --pid=$DEVICE_PID "$LOG" & ) | grep -q -m 1 "Boot pipeline" || true
+    kill $DEVICE_PID 2> /dev/null || true
+    wait $DEVICE_PID 2> /dev/null || true
+    stop_mock
+
+    RESULT=$(grep -o "Boot pipeline [a-z]* in [0-9]* ms" "$LOG" | awk '{ print $3 "," $5 }')
+    BOOT_MS=${RESULT#*,}
+    echo "$run,${BOOT_MS:-},${RESULT%,*}" >> runs.csv
+    echo "Run $run: ${RESULT:-timed out}"
+done
+
+# Per-stage timings from "Boot stage <name> <start> - <end> ms" lines
+python3 - "$OUT_DIR" "$RUNS" << 'PYTHON'
+import glob, json, re, statistics, sys
+
+out_dir, runs = sys.argv[1], int(sys.argv[2])
+stage_re = re.compile(r"Boot stage (\S+)\s+(\d+) -\s+(\d+) ms")
+total_re = re.compile(r"Boot pipeline completed in (\d+) ms")
+
+stages, totals = {}, []
+for run in range(1, runs + 1):
+    with open("%s/run_%d.log" % (out_dir, run), errors="replace") as f:
+        text = f.read()
+    for name, start, end in stage_re.findall(text):
+        stages.setdefault(name, []).append(int(end) - int(start))
+    totals += [int(ms) for ms in total_re.findall(text)]
+
+def describe(values):
+    return {"runs": len(values), "median_ms": statistics.median(values), "min_ms": min(values), "max_ms": max(values)}
+
+summary = {"boot": describe(totals) if totals else None, "stages": {k: describe(v) for k, v in stages.items()}}
+print(json.dumps(summary, indent=2))
+with open("%s/summary.json" % out_dir, "w") as f:
+    json.dump(summary, f, indent=2)
+PYTHON
@@ -0,0 +1,31 @@
+#!/usr/bin/env bash
+#
+# Generate a local CA and a server certificate for the DECADA stand-ins.
+# The CA also signs device CSRs submitted to the mock certificate endpoint.
+#
+# Usage: gen_certs.sh [output directory] [server address]
+#
+
+set -e
+
+OUT_DIR=${1:-"$(dirname "$0")/certs"}
+SERVER_ADDR=${2:-"192.0.2.2"}
+
+mkdir -p "$OUT_DIR"
+cd "$OUT_DIR"
+
+if [ ! -f ca.key ]; then
+    openssl ecparam -name prime256v1 -genkey -noout -out ca.key
+    openssl req -x509 -new -key ca.key -sha256 -days 3650 -subj "/CN=Mock DECADA CA" -out ca.crt
+fi
+
+if [ ! -f server.key ]; then
+    openssl ecparam -name prime256v1 -genkey -noout -out server.key
+    openssl req -new -key server.key -subj "/CN=$SERVER_ADDR" -out server.csr
+    printf "subjectAltName=IP:%s,DNS:localhost\n" "$SERVER_ADDR" > server.ext
+    openssl x509 -req -in server.csr -CA ca.crt -CAkey ca.key -CAcreateserial -sha256 -days 3650 \
+        -extfile server.ext -out server.crt
+    rm -f server.csr server.ext
+fi
+
+echo "Certificates in $OUT_DIR"
@@ -0,0 +1,435 @@
+"""
+Local stand-in for the DECADA cloud used by DecadaManager.
+
+Serves HTTPS on port 8443 (see USER_CONFIG_DECADA_API_URL for host builds):
+  POST /apim-token-service/v2.0/token/get
+  GET  /connect-service/v2.1/devices?action=get
+  POST /connect-service/v2.1/devices?action=create
+  POST /connect-service/v2.0/certificates?action=apply
+
+With --mqtt-port, also accepts MQTT over TLS and validates securemode=2 credentials before relaying to a
+plaintext broker (see mqtt_auth.py).
+
+Requests are signed as DECADA expects, with credentials read from src/user_config.h unless overridden:
+  token/get:  encryption    = sha256(appKey + timestamp + accessSecret)
+  others:     apim-signature = sha256(accessToken + sorted query keys and values + body + timestamp + accessSecret)
+
+Devices are kept in memory (or in --state-file, to keep device secrets across restarts) and CSRs are signed
+with the CA from gen_certs.sh. Latency, errors and rate limits can be injected to benchmark provisioning.
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import random
+import re
+import secrets
+import signal
+import ssl
+import subprocess
+import tempfile
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qsl, urlparse
+
+from mqtt_auth import MqttAuthProxy
+
+TOOLS_DIR = os.path.dirname(os.path.abspath(__file__))
+CERT_DIR = os.path.join(TOOLS_DIR, "certs")
+USER_CONFIG = os.path.join(TOOLS_DIR, "..", "..", "src", "user_config.h")
+
+TOKEN_TTL_S = 7200
+
+
+def read_user_config(path):
+    """Read the DECADA credentials defined in user_config.h."""
+    names = {
+        "USER_CONFIG_DECADA_OU_ID": "org_id",
+        "USER_CONFIG_DECADA_ACCESS_KEY": "access_key",
+        "USER_CONFIG_DECADA_ACCESS_SECRET": "access_secret",
+        "USER_CONFIG_DECADA_PRODUCT_KEY": "product_key",
+    }
+    config = {value: "" for value in names.values()}
+
+    try:
+        with open(path) as f:
+            text = f.read()
+    except OSError:
+        return config
+
+    for define, key in names.items():
+        match = re.search(r"#define\s+%s\s*\\?\s*\(\s*\"([^\"]*)\"\s*\)" % define, text)
+        if match:
+            config[key] = match.group(1)
+
+    return config
+
+
+def sha256_hex(*pieces):
+    return hashlib.sha256("".join(pieces).encode()).hexdigest()
+
+
+class Faults:
+    """Injectable latency, failures and rate limits, applied per endpoint."""
+
+    def __init__(self, latency_ms, jitter_ms, error_rate, rate_limit, endpoints):
+        self.latency_ms = latency_ms
+        self.jitter_ms = jitter_ms
+        self.error_rate = error_rate
+        self.rate_limit = rate_limit
+        self.endpoints = set(endpoints) if endpoints else None
+        self.lock = threading.Lock()
+        self.window = []
+
+    def applies(self, endpoint):
+        return self.endpoints is None or endpoint in self.endpoints
+
+    def delay(self, endpoint):
+        if self.applies(endpoint) and (self.latency_ms or self.jitter_ms):
+            time.sleep((self.latency_ms + random.uniform(0, self.jitter_ms)) / 1000.0)
+
+    def should_fail(self, endpoint):
+        return self.applies(endpoint) and random.random() < self.error_rate
+
+    def rate_limited(self, endpoint):
+        """Sliding one second window shared by all endpoints the faults apply to."""
+        if not self.rate_limit or not self.applies(endpoint):
+            return False
+
+        now = time.monotonic()
+        with self.lock:
+            self.window = [t for t in self.window if now - t < 1.0]
+            if len(self.window) >= self.rate_limit:
+                return True
+            self.window.append(now)
+            return False
+
+
+class DecadaState:
+    def __init__(self, cert_dir, credentials, state_file, max_skew_s, verbose):
+        self.cert_dir = cert_dir
+        self.credentials = credentials
+        self.state_file = state_file
+        self.max_skew_s = max_skew_s
+        self.verbose = verbose
+        self.lock = threading.Lock()
+        # deviceKey -> {"productKey", "deviceSecret"}
+        self.devices = {}
+        # accessToken -> expiry (monotonic seconds)
+        self.tokens = {}
+        self.requests = {}
+        self.first_request = None
+        self.connects = []
+
+        if state_file and os.path.exists(state_file):
+            with open(state_file) as f:
+                self.devices = json.load(f)
+
+    def log(self, message):
+        print(message, flush=True)
+
+    def count(self, endpoint):
+        with self.lock:
+            if self.first_request is None:
+                self.first_request = time.monotonic()
+            self.requests[endpoint] = self.requests.get(endpoint, 0) + 1
+
+    def record_connect(self, device_key, auth_s):
+        with self.lock:
+            since_first_ms = (time.monotonic() - self.first_request) * 1000 if self.first_request else 0
+            self.connects.append({"device": device_key, "since_first_request_ms": round(since_first_ms)})
+
+        if self.verbose or len(self.connects) == 1:
+            self.log("MQTT CONNECT accepted for %s, %.0f ms after first request (auth %.1f ms)" %
+                     (device_key, since_first_ms, auth_s * 1000))
+
+    def timestamp_valid(self, timestamp_ms):
+        if not self.max_skew_s:
+            return True
+        try:
+            return abs(time.time() - int(timestamp_ms) / 1000.0) <= self.max_skew_s
+        except ValueError:
+            return False
+
+    def new_token(self):
+        token = secrets.token_hex(16)
+        with self.lock:
+            self.tokens[token] = time.monotonic() + TOKEN_TTL_S
+        return token
+
+    def token_valid(self, token):
+        with self.lock:
+            return self.tokens.get(token, 0) > time.monotonic()
+
+    def get_device(self, device_key):
+        with self.lock:
+            return self.devices.get(device_key)
+
+    def create_device(self, product_key, device_key):
+        with self.lock:
+            device = self.devices.get(device_key)
+            if device is None:
+                device = {"productKey": product_key, "deviceSecret": secrets.token_hex(16)}
+                self.devices[device_key] = device
+                self.save()
+            return device
+
+    def save(self):
+        if self.state_file:
+            with open(self.state_file, "w") as f:
+                json.dump(self.devices, f, indent=2)
+
+    def summary(self):
+        with self.lock:
+            return {"requests": self.requests, "connects": self.connects}
+
+    def sign_csr(self, csr, valid_days):
+        with tempfile.TemporaryDirectory() as tmp:
+            csr_path = os.path.join(tmp, "device.csr")
+            crt_path = os.path.join(tmp, "device.crt")
+            with open(csr_path, "w") as f:
+                f.write(csr)
+
+            subprocess.run(
+                [
+                    "openssl", "x509", "-req", "-in", csr_path,
+                    "-CA", os.path.join(self.cert_dir, "ca.crt"),
+                    "-CAkey", os.path.join(self.cert_dir, "ca.key"),
+                    "-CAcreateserial", "-CAserial", os.path.join(tmp, "ca.srl"),
+                    "-sha256", "-days", str(valid_days), "-out", crt_path,
+                ],
+                check=True,
+                capture_output=True,
+            )
+
+            serial = subprocess.run(
+                ["openssl", "x509", "-in", crt_path, "-noout", "-serial"],
+                check=True,
+                capture_output=True,
+                text=True,
+            ).stdout.strip().split("=")[-1]
+
+            with open(crt_path) as f:
+                return f.read(), serial
+
+
+class DecadaHandler(BaseHTTPRequestHandler):
+    # One request per connection, as made by HttpBase
+    protocol_version = "HTTP/1.0"
+
+    def log_message(self, fmt, *args):
+        if self.server.state.verbose:
+            super().log_message(fmt, *args)
+
+    def send_json(self, body, status=200):
+        payload = json.dumps(body).encode()
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json;charset=UTF-8")
+        self.send_header("Content-Length", str(len(payload)))
+        self.end_headers()
+        self.wfile.write(payload)
+
+    def read_body(self):
+        length = int(self.headers.get("Content-Length", 0))
+        return self.rfile.read(length).decode() if length else ""
+
+    def reject(self, endpoint, status, message):
+        self.server.state.count(endpoint + "_rejected")
+        self.server.state.log("%s %s rejected: %s" % (self.command, self.path, message))
+        self.send_json({"code": status, "status": status, "msg": message}, status=status)
+
+    def apply_faults(self, endpoint):
+        """Count the request and apply injected faults, returning False if a response was already sent."""
+        faults = self.server.faults
+        self.server.state.count(endpoint)
+
+        if faults.rate_limited(endpoint):
+            self.reject(endpoint, 429, "Too many requests")
+            return False
+
+        faults.delay(endpoint)
+
+        if faults.should_fail(endpoint):
+            self.reject(endpoint, 500, "Injected failure")
+            return False
+
+        return True
+
+    def check_signature(self, endpoint, query, body):
+        """Check the apim headers of a signed request, returning False if a response was already sent."""
+        state = self.server.state
+        token = self.headers.get("apim-accesstoken", "")
+        timestamp = self.headers.get("apim-timestamp", "")
+
+        if not state.token_valid(token):
+            self.reject(endpoint, 401, "Invalid or expired access token")
+            return False
+
+        if not state.timestamp_valid(timestamp):
+            self.reject(endpoint, 401, "Timestamp outside allowed skew")
+            return False
+
+        sorted_query = "".join(key + value for key, value in sorted(query))
+        expected = sha256_hex(token, sorted_query, body, timestamp, state.credentials["access_secret"])
+        if self.headers.get("apim-signature", "") != expected:
+            self.reject(endpoint, 401, "Signature verification failed")
+            return False
+
+        return True
+
+    def do_GET(self):
+        url = urlparse(self.path)
+        query = parse_qsl(url.query)
+        params = dict(query)
+
+        if url.path == "/connect-service/v2.1/devices" and params.get("action") == "get":
+            if not self.apply_faults("device_get") or not self.check_signature("device_get", query, ""):
+                return
+
+            device = self.server.state.get_device(params.get("deviceKey", ""))
+            if device is None:
+                self.send_json({"code": 11404, "msg": "Device not found", "data": None})
+            else:
+                self.send_json({"code": 0, "msg": "OK", "data": {"deviceSecret": device["deviceSecret"]}})
+            return
+
+        self.send_json({"code": 404, "msg": "Not found"}, status=404)
+
+    def do_POST(self):
+        url = urlparse(self.path)
+        query = parse_qsl(url.query)
+        params = dict(query)
+        raw = self.read_body()
+
+        try:
+            body = json.loads(raw) if raw else {}
+        except ValueError:
+            self.send_json({"code": 400, "msg": "Malformed JSON"}, status=400)
+            return
+
+        if url.path == "/apim-token-service/v2.0/token/get":
+            if not self.apply_faults("token_get"):
+                return
+
+            credentials = self.server.state.credentials
+            timestamp = str(body.get("timestamp", ""))
+            expected = sha256_hex(credentials["access_key"], timestamp, credentials["access_secret"])
+            if body.get("appKey") != credentials["access_key"] or body.get("encryption") != expected:
+                self.reject("token_get", 401, "Invalid app key or encryption")
+                return
+            if not self.server.state.timestamp_valid(timestamp):
+                self.reject("token_get", 401, "Timestamp outside allowed skew")
+                return
+
+            token = self.server.state.new_token()
+            self.send_json({"status": 0, "msg": "Success", "data": {"accessToken": token, "expire": TOKEN_TTL_S}})
+            return
+
+        if url.path == "/connect-service/v2.1/devices" and params.get("action") == "create":
+            if not self.apply_faults("device_create") or not self.check_signature("device_create", query, raw):
+                return
+
+            device = self.server.state.create_device(body.get("productKey", ""), body.get("deviceKey", ""))
+            self.send_json({"code": 0, "msg": "OK", "data": {"deviceSecret": device["deviceSecret"]}})
+            return
+
+        if url.path == "/connect-service/v2.0/certificates" and params.get("action") == "apply":
+            if not self.apply_faults("csr_apply") or not self.check_signature("csr_apply", query, raw):
+                return
+
+            if self.server.state.get_device(params.get("deviceKey", "")) is None:
+                self.send_json({"code": 11404, "msg": "Device not found", "data": None})
+                return
+
+            cert, serial = self.server.state.sign_csr(body.get("csr", ""), body.get("validDay", 365))
+            self.send_json({"code": 0, "msg": "OK", "data": {"cert": cert, "certSN": serial}})
+            return
+
+        self.send_json({"code": 404, "msg": "Not found"}, status=404)
+
+
+def interrupt(signum, frame):
+    raise KeyboardInterrupt
+
+
+def make_context(cert_dir):
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    context.load_cert_chain(os.path.join(cert_dir, "server.crt"), os.path.join(cert_dir, "server.key"))
+    return context
+
+
+def make_server(args, state, faults):
+    server = ThreadingHTTPServer((args.host, args.port), DecadaHandler)
+    server.state = state
+    server.faults = faults
+    server.socket = make_context(args.cert_dir).wrap_socket(server.socket, server_side=True)
+
+    return server
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="192.0.2.2", help="Address to listen on")
+    parser.add_argument("--port", type=int, default=8443, help="HTTPS port")
+    parser.add_argument("--cert-dir", default=CERT_DIR, help="Directory populated by gen_certs.sh")
+    parser.add_argument("-v", "--verbose", action="store_true", help="Log every request")
+
+    group = parser.add_argument_group("credentials")
+    group.add_argument("--user-config", default=USER_CONFIG, help="user_config.h to read credentials from")
+    group.add_argument("--org-id", help="Override USER_CONFIG_DECADA_OU_ID")
+    group.add_argument("--access-key", help="Override USER_CONFIG_DECADA_ACCESS_KEY")
+    group.add_argument("--access-secret", help="Override USER_CONFIG_DECADA_ACCESS_SECRET")
+    group.add_argument("--product-key", help="Override USER_CONFIG_DECADA_PRODUCT_KEY")
+    group.add_argument("--max-skew-s", type=float, default=0, help="Reject timestamps further off (0 to disable)")
+    group.add_argument("--state-file", help="Keep created devices in this JSON file across restarts")
+
+    group = parser.add_argument_group("MQTT")
+    group.add_argument("--mqtt-port", type=int, help="Accept MQTT over TLS on this port (e.g. 8883)")
+    group.add_argument("--broker", default="127.0.0.1:1883", help="Plaintext broker to relay accepted sessions to")
+
+    group = parser.add_argument_group("fault injection")
+    group.add_argument("--latency-ms", type=float, default=0, help="Added to every response")
+    group.add_argument("--jitter-ms", type=float, default=0, help="Uniformly distributed extra latency")
+    group.add_argument("--error-rate", type=float, default=0, help="Fraction of requests failed (REST 500, CONNACK 3)")
+    group.add_argument("--rate-limit", type=int, default=0, help="Requests per second before returning 429")
+    group.add_argument(
+        "--fault-endpoints",
+        nargs="*",
+        help="Limit faults to these endpoints (token_get device_get device_create csr_apply mqtt_connect)",
+    )
+    args = parser.parse_args()
+
+    credentials = read_user_config(args.user_config)
+    for key in credentials:
+        if getattr(args, key) is not None:
+            credentials[key] = getattr(args, key)
+
+    state = DecadaState(args.cert_dir, credentials, args.state_file, args.max_skew_s, args.verbose)
+    faults = Faults(args.latency_ms, args.jitter_ms, args.error_rate, args.rate_limit, args.fault_endpoints)
+
+    server = make_server(args, state, faults)
+    print("Mock DECADA REST server on https://%s:%d" % (args.host, args.port), flush=True)
+
+    if args.mqtt_port:
+        broker_host, broker_port = args.broker.rsplit(":", 1)
+        proxy = MqttAuthProxy(state, faults, (broker_host, int(broker_port)))
+        threading.Thread(
+            target=proxy.serve_forever, args=(args.host, args.mqtt_port, make_context(args.cert_dir)), daemon=True
+        ).start()
+        print("Mock DECADA MQTT front on %s:%d relaying to %s" % (args.host, args.mqtt_port, args.broker), flush=True)
+
+    # Print the summary when stopped by run_soak.sh or bench_provisioning.sh as well as by Ctrl-C
+    signal.signal(signal.SIGTERM, interrupt)
+
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        print("Summary: %s" % json.dumps(state.summary()), flush=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,202 @@
+"""
+MQTT front for the mock DECADA server.
+
+Terminates TLS from the device, validates the securemode=2 credentials in the CONNECT packet against the
+device secrets issued by the REST endpoints, then relays the session to a plaintext broker (mosquitto).
+
+  clientId: <deviceKey>|securemode=2,signmethod=sha256,timestamp=<ms>|
+  username: <deviceKey>&<productKey>
+  password: sha256("clientId" <deviceKey> "deviceKey" <deviceKey> "productKey" <productKey>
+                   "timestamp" <ms> <deviceSecret>)
+
+Invalid credentials are answered with CONNACK return code 4 and unknown devices with 5, as DECADA does.
+"""
+
+import hashlib
+import re
+import socket
+import struct
+import threading
+import time
+
+MQTT_CONNECT = 0x10
+MQTT_CONNACK = 0x20
+
+CONNACK_ACCEPTED = 0
+CONNACK_SERVER_UNAVAILABLE = 3
+CONNACK_BAD_CREDENTIALS = 4
+CONNACK_NOT_AUTHORIZED = 5
+
+CLIENT_ID_RE = re.compile(r"^([^|]+)\|securemode=2,signmethod=sha256,timestamp=(\d+)\|$")
+
+RELAY_BUFFER_SIZE = 4096
+
+
+def recv_exact(conn, size):
+    data = b""
+    while len(data) < size:
+        chunk = conn.recv(size - len(data))
+        if not chunk:
+            raise ConnectionError("Connection closed")
+        data += chunk
+    return data
+
+
+def read_packet(conn):
+    """Read one MQTT control packet, returning (raw bytes, packet type, variable header + payload)."""
+    header = recv_exact(conn, 1)
+
+    remaining = 0
+    multiplier = 1
+    length_bytes = b""
+    while True:
+        byte = recv_exact(conn, 1)
+        length_bytes += byte
+        remaining += (byte[0] & 0x7F) * multiplier
+        if not byte[0] & 0x80:
+            break
+        multiplier *= 128
+        if len(length_bytes) > 4:
+            raise ValueError("Malformed remaining length")
+
+    body = recv_exact(conn, remaining)
+    return header + length_bytes + body, header[0] & 0xF0, body
+
+
+def parse_connect(body):
+    """Return the client id, username and password fields of a CONNECT packet."""
+    offset = 0
+
+    def read_field():
+        nonlocal offset
+        (size,) = struct.unpack_from("!H", body, offset)
+        value = body[offset + 2 : offset + 2 + size]
+        offset += 2 + size
+        return value
+
+    read_field()  # Protocol name
+    flags = body[offset + 1]
+    offset += 4  # Protocol level, connect flags and keep alive
+
+    client_id = read_field().decode()
+    if flags & 0x04:
+        read_field()  # Will topic
+        read_field()  # Will message
+    username = read_field().decode() if flags & 0x80 else ""
+    password = read_field().decode() if flags & 0x40 else ""
+
+    return client_id, username, password
+
+
+def connack(return_code):
+    return bytes([MQTT_CONNACK, 2, 0, return_code])
+
+
+class MqttAuthProxy:
+    def __init__(self, state, faults, broker_addr):
+        self.state = state
+        self.faults = faults
+        self.broker_addr = broker_addr
+
+    def check_credentials(self, client_id, username, password):
+        match = CLIENT_ID_RE.match(client_id)
+        if match is None:
+            return CONNACK_BAD_CREDENTIALS, "Malformed client id %r" % client_id
+
+        device_key, timestamp = match.groups()
+        if "&" not in username or username.split("&", 1)[0] != device_key:
+            return CONNACK_BAD_CREDENTIALS, "Username %r does not match client id" % username
+
+        product_key = username.split("&", 1)[1]
+        device = self.state.get_device(device_key)
+        if device is None or device["productKey"] != product_key:
+            return CONNACK_NOT_AUTHORIZED, "Unknown device %s" % device_key
+
+        if not self.state.timestamp_valid(timestamp):
+            return CONNACK_BAD_CREDENTIALS, "Timestamp %s outside allowed skew" % timestamp
+
+        expected = hashlib.sha256(
+            (
+                "clientId" + device_key + "deviceKey" + device_key + "productKey" + product_key + "timestamp" +
+                timestamp + device["deviceSecret"]
+            ).encode()
+        ).hexdigest()
+        if password != expected:
+            return CONNACK_BAD_CREDENTIALS, "Password mismatch for %s" % device_key
+
+        return CONNACK_ACCEPTED, device_key
+
+    def handle(self, conn, addr):
+        try:
+            raw, packet_type, body = read_packet(conn)
+            if packet_type != MQTT_CONNECT:
+                return
+
+            start = time.monotonic()
+            self.state.count("mqtt_connect")
+            self.faults.delay("mqtt_connect")
+
+            if self.faults.should_fail("mqtt_connect"):
+                self.state.count("mqtt_refused")
+                conn.sendall(connack(CONNACK_SERVER_UNAVAILABLE))
+                return
+
+            return_code, detail = self.check_credentials(*parse_connect(body))
+            if return_code != CONNACK_ACCEPTED:
+                self.state.count("mqtt_rejected")
+                self.state.log("MQTT CONNECT from %s rejected (%d): %s" % (addr[0], return_code, detail))
+                conn.sendall(connack(return_code))
+                return
+
+            broker = socket.create_connection(self.broker_addr)
+        except (ConnectionError, OSError, ValueError, IndexError, struct.error) as e:
+            self.state.log("MQTT connection from %s dropped: %s" % (addr[0], e))
+            return
+
+        # The broker answers the forwarded CONNECT with its own CONNACK
+        broker.sendall(raw)
+        self.state.record_connect(detail, time.monotonic() - start)
+        self.relay(conn, broker)
+
+    def relay(self, conn, broker):
+        def pipe(src, dst):
+            try:
+                while True:
+                    data = src.recv(RELAY_BUFFER_SIZE)
+                    if not data:
+                        break
+                    dst.sendall(data)
+            except OSError:
+                pass
+            finally:
+                for s in (src, dst):
+                    try:
+                        s.shutdown(socket.SHUT_RDWR)
+                    except OSError:
+                        pass
+
+        upstream = threading.Thread(target=pipe, args=(conn, broker), daemon=True)
+        upstream.start()
+        pipe(broker, conn)
+        upstream.join()
+
+        conn.close()
+        broker.close()
+
+    def serve_forever(self, host, port, context):
+        listener = socket.create_server((host, port), reuse_port=False)
+        while True:
+            sock, addr = listener.accept()
+            threading.Thread(target=self.accept, args=(sock, addr, context), daemon=True).start()
+
+    def accept(self, sock, addr, context):
+        try:
+            conn = context.wrap_socket(sock, server_side=True)
+        except OSError as e:
+            self.state.log("TLS handshake with %s failed: %s" % (addr[0], e))
+            sock.close()
+            return
+
+        # Closed here for rejected connections; relayed sessions are already closed by the time this returns
+        self.handle(conn, addr)
+        conn.close()
@@ -0,0 +1,41 @@
+#!/usr/bin/env bash
+#
+# Soak test of a native_posix build against local DECADA stand-ins.
+#
+# Prerequisites:
+#   - TAP interface at 192.0.2.2 (net-setup.sh from the Zephyr net-tools repository)
+#   - mosquitto, openssl and python3 on the PATH
+#   - Build with USER_CONFIG_SOAK_SAMPLE_RATE_HZ defined in src/user_config.h:
+#       west build -b native_posix zephyr -- -DARDUINOJSON_DIR=<path to ArduinoJson>
+#
+# Usage: run_soak.sh <duration in seconds> [path to zephyr.exe] [output directory]
+#
+# Extra arguments for mock_decada.py (e.g. fault injection) can be given in MOCK_DECADA_ARGS.
+#
+
+set -e
+
+DURATION=${1:?"Usage: $0 <duration in seconds> [zephyr.exe] [output directory]"}
+ZEPHYR_EXE=$(realpath "${2:-build/zephyr/zephyr.exe}")
+OUT_DIR=$(realpath -m "${3:-soak_$(date +%Y%m%d_%H%M%S)}")
+
+TOOLS_DIR=$(cd "$(dirname "$0")/.." && pwd)
+
+mkdir -p "$OUT_DIR"
+cd "$OUT_DIR"
+
+"$TOOLS_DIR/mock_decada/gen_certs.sh" "$OUT_DIR/certs" > /dev/null
+
+mosquitto -c "$TOOLS_DIR/soak/mosquitto.conf" > mosquitto.log 2>&1 &
+BROKER_PID=$!
+python3 "$TOOLS_DIR/mock_decada/mock_decada.py" --cert-dir "$OUT_DIR/certs" --mqtt-port 8883 $MOCK_DECADA_ARGS \
+    > mock_decada.log 2>&1 &
+REST_PID=$!
+trap 'kill $BROKER_PID $REST_PID 2> /dev/null || true' EXIT
+
+# Give the stand-ins time to start listening
+sleep 1
+
+echo "Soak test for $DURATION s - results in $OUT_DIR"
+"$ZEPHYR_EXE" --stop_at="$DURATION" 2>&1 | tee device.log | python3 "$TOOLS_DIR/soak/soak_report.py" --follow \
+    --output "$OUT_DIR/summary.json"
@@ -0,0 +1,161 @@
+"""
+Summarize a soak test from the device log.
+
+Reads SOAK lines (diagnostics/soak_report), per-sample trace lines (diagnostics/sample_trace) and
+NET_FAULT lines (networking/fault/net_fault) from a log file or stdin and reports throughput, latency
+percentiles per stage, queue and heap trends, and recovery time and samples lost per injected fault. With --follow, a progress line is printed for every SOAK line as the log is read.
+"""
+
+import argparse
+import json
+import re
+import sys
+
+SOAK_RE = re.compile(r"SOAK (\{.*\})")
+TRACE_RE = re.compile(r"sample_trace: (\{\"trace\".*\})")
+FAULT_RE = re.compile(r"NET_FAULT (\{.*\})")
+
+STAGES = ["build_us", "serialize_us", "queue_us", "dispatch_us", "publish_us", "total_us"]
+PERCENTILES = [50, 90, 99, 99.9]
+
+
+def percentile(sorted_values, pct):
+    if not sorted_values:
+        return None
+    idx = min(len(sorted_values) - 1, int(round(pct / 100.0 * (len(sorted_values) - 1))))
+    return sorted_values[idx]
+
+
+def slope_per_hour(points):
+    """Least-squares slope of (uptime_ms, value) points, per hour."""
+    if len(points) < 2:
+        return 0.0
+    n = len(points)
+    mean_x = sum(x for x, _ in points) / n
+    mean_y = sum(y for _, y in points) / n
+    var_x = sum((x - mean_x) ** 2 for x, _ in points)
+    if var_x == 0:
+        return 0.0
+    cov = sum((x - mean_x) * (y - mean_y) for x, y in points)
+    return cov / var_x * 3600 * 1000
+
+
+class SoakSummary:
+    def __init__(self):
+        self.reports = []
+        self.latencies = {stage: [] for stage in STAGES}
+        self.faults = []
+
+    def add_line(self, line):
+        match = TRACE_RE.search(line)
+        if match:
+            trace = json.loads(match.group(1))
+            for stage in STAGES:
+                if trace.get(stage, -1) >= 0:
+                    self.latencies[stage].append(trace[stage])
+            return None
+
+        match = FAULT_RE.search(line)
+        if match:
+            self.faults.append(json.loads(match.group(1)))
+            return None
+
+        match = SOAK_RE.search(line)
+        if match:
+            report = json.loads(match.group(1))
+            self.reports.append(report)
+            return report
+
+        return None
+
+    def rate(self, first, last, key):
+        elapsed_s = (last["uptime_ms"] - first["uptime_ms"]) / 1000.0
+        return (last[key] - first[key]) / elapsed_s if elapsed_s > 0 else 0.0
+
+    def progress(self, report):
+        if len(self.reports) < 2:
+            return "t=%6.0fs waiting for second report" % (report["uptime_ms"] / 1000.0)
+        previous = self.reports[-2]
+        return "t=%6.0fs %7.1f msg/s published, queue %d (peak %d), heap %d B, failures %d, reconnects %d" % (
+            report["uptime_ms"] / 1000.0,
+            self.rate(previous, report, "published"),
+            report["queue_depth"],
+            report["queue_peak"],
+            report["heap_used"],
+            report["publish_failures"],
+            report["mqtt_reconnects"],
+        )
+
+    def summary(self):
+        result = {"reports": len(self.reports)}
+
+        if len(self.reports) >= 2:
+            first, last = self.reports[0], self.reports[-1]
+            result["duration_s"] = (last["uptime_ms"] - first["uptime_ms"]) / 1000.0
+            result["generated_per_s"] = self.rate(first, last, "generated")
+            result["published_per_s"] = self.rate(first, last, "published")
+            result["publish_failures"] = last["publish_failures"]
+            result["mqtt_reconnects"] = last["mqtt_reconnects"]
+            result["queue_peak"] = last["queue_peak"]
+            result["heap_used_first"] = first["heap_used"]
+            result["heap_used_last"] = last["heap_used"]
+            result["heap_used_max"] = max(r["heap_used"] for r in self.reports)
+            result["heap_slope_bytes_per_hour"] = slope_per_hour([(r["uptime_ms"], r["heap_used"]) for r in self.reports])
+            result["queue_slope_per_hour"] = slope_per_hour([(r["uptime_ms"], r["queue_depth"]) for r in self.reports])
+
+        latency = {}
+        for stage in STAGES:
+            values = sorted(self.latencies[stage])
+            if values:
+                latency[stage] = {"count": len(values), "max": values[-1]}
+                for pct in PERCENTILES:
+                    latency[stage]["p%g" % pct] = percentile(values, pct)
+        result["latency_us"] = latency
+
+        faults = {}
+        for fault in self.faults:
+            entry = faults.setdefault(fault["type"], {"steps": 0, "unrecovered": 0, "lost": 0, "recovery_ms": []})
+            entry["steps"] += 1
+            entry["lost"] += fault["lost"]
+            if fault["recovery_ms"] < 0:
+                entry["unrecovered"] += 1
+            else:
+                entry["recovery_ms"].append(fault["recovery_ms"])
+        for entry in faults.values():
+            values = sorted(entry.pop("recovery_ms"))
+            if values:
+                entry["recovery_ms"] = {"median": percentile(values, 50), "max": values[-1]}
+        if faults:
+            result["faults"] = faults
+
+        return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("log", nargs="?", help="Device log (stdin if omitted)")
+    parser.add_argument("--follow", action="store_true", help="Print progress for every SOAK line")
+    parser.add_argument("--output", help="Write the summary as JSON to this file")
+    args = parser.parse_args()
+
+    summary = SoakSummary()
+    source = open(args.log, errors="replace") if args.log else sys.stdin
+
+    try:
+        for line in source:
+            report = summary.add_line(line)
+            if report and args.follow:
+                print(summary.progress(report), flush=True)
+    except KeyboardInterrupt:
+        pass
+
+    result = summary.summary()
+    print(json.dumps(result, indent=2))
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(result, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()